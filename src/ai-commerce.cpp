@@ -15,8 +15,8 @@ class worker_searcher {
 			myciv(myciv_), maxrange(maxrange_), found_unit(NULL), self(self_) { }
 		const unit* get_found_unit() const { return found_unit; }
 		bool operator()(const coord& co) {
-			const std::list<unit*>& units = myciv->m->units_on_spot(co.x, co.y);
-			for(std::list<unit*>::const_iterator it = units.begin();
+			unit_stack units = myciv->m->units_on_spot(co.x, co.y);
+			for(unit_stack::const_iterator it = units.begin();
 					it != units.end();
 					++it) {
 				if((*it)->uconf->worker && (*it) != self) {
@@ -71,45 +71,41 @@ bool get_next_improv_spot(int startx, int starty, const civilization* civ,
 		int* tgtx, int *tgty,
 		improvement_type* tgt_imp)
 {
-	for(int i = -2; i <= 2; i++) {
-		for(int j = -2; j <= 2; j++) {
-			if(abs(i) == 2 && abs(j) == 2)
+	for(int k = 0; k < neighbourhood::num_city_tiles; k++) {
+		int xp = startx + neighbourhood::city_offsets[k][0];
+		int yp = starty + neighbourhood::city_offsets[k][1];
+		if(civ->m->get_land_owner(xp, yp) == (int)civ->civ_id) {
+			if(civ->m->city_on_spot(xp, yp) != NULL)
 				continue;
-			int xp = startx + i;
-			int yp = starty + j;
-			if(civ->m->get_land_owner(xp, yp) == (int)civ->civ_id) {
-				if(civ->m->city_on_spot(xp, yp) != NULL)
+			unit_stack units = civ->m->units_on_spot(xp, yp);
+			for(unit_stack::const_iterator it = units.begin();
+					it != units.end(); ++it) {
+				if((*it)->civ_id == (int)civ->civ_id &&
+					(*it)->uconf->worker)
 					continue;
-				const std::list<unit*>& units = civ->m->units_on_spot(xp, yp);
-				for(std::list<unit*>::const_iterator it = units.begin();
-						it != units.end(); ++it) {
-					if((*it)->civ_id == (int)civ->civ_id &&
-						(*it)->uconf->worker)
-						continue;
-				}
-				if((civ->m->get_improvements_on(xp, yp) & ~improv_road) == 0) {
-					if(civ->m->can_improve_terrain(xp,
-								yp, civ->civ_id, improv_irrigation)) {
-						*tgtx = xp;
-						*tgty = yp;
-						*tgt_imp = improv_irrigation;
-						return true;
-					}
-					else if(civ->m->can_improve_terrain(xp,
-								yp, civ->civ_id, improv_mine)) {
-						*tgtx = xp;
-						*tgty = yp;
-						*tgt_imp = improv_mine;
-						return true;
-					}
-				}
+			}
+			if((civ->m->get_improvements_on(xp, yp) & ~improv_road) == 0) {
 				if(civ->m->can_improve_terrain(xp,
-							yp, civ->civ_id, improv_road)) {
+							yp, civ->civ_id, improv_irrigation)) {
 					*tgtx = xp;
 					*tgty = yp;
-					*tgt_imp = improv_road;
+					*tgt_imp = improv_irrigation;
 					return true;
 				}
+				else if(civ->m->can_improve_terrain(xp,
+							yp, civ->civ_id, improv_mine)) {
+					*tgtx = xp;
+					*tgty = yp;
+					*tgt_imp = improv_mine;
+					return true;
+				}
+			}
+			if(civ->m->can_improve_terrain(xp,
+						yp, civ->civ_id, improv_road)) {
+				*tgtx = xp;
+				*tgty = yp;
+				*tgt_imp = improv_road;
+				return true;
 			}
 		}
 	}
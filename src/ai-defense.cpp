@@ -2,6 +2,7 @@
 
 #include "ai-defense.h"
 #include "ai-debug.h"
+#include "ai-distance.h"
 
 bool compare_defense_units(const unit_configuration& lhs,
 		const unit_configuration& rhs)
@@ -42,12 +43,13 @@ int defense_objective::get_unit_points(const unit& u) const
 	int prio = 1;
 	tgtx = u.xpos;
 	tgty = u.ypos;
-	if(myciv->cities.size() != 0) {
-		city* c = find_nearest_city(myciv, u, true);
+	coord tgt;
+	if(fields->get_distance(target_own_city, u, &tgt) >= 0) {
+		city* c = myciv->m->city_on_spot(tgt.x, tgt.y);
 		if(c) {
 			tgtx = c->xpos;
 			tgty = c->ypos;
-			const std::list<unit*>& units = myciv->m->units_on_spot(tgtx, tgty);
+			unit_stack units = myciv->m->units_on_spot(tgtx, tgty);
 			int num_units = std::count_if(units.begin(),
 					units.end(),
 					std::mem_fun(&unit::is_military_unit));
@@ -67,10 +69,10 @@ bool defense_objective::add_unit(unit* u)
 	int tgtx, tgty;
 	tgtx = u->xpos;
 	tgty = u->ypos;
-	city* c = find_nearest_city(myciv, *u, true);
-	if(c) {
-		tgtx = c->xpos;
-		tgty = c->ypos;
+	coord tgt;
+	if(fields->get_distance(target_own_city, *u, &tgt) >= 0) {
+		tgtx = tgt.x;
+		tgty = tgt.y;
 	}
 	orders* o = new defend_orders(myciv, u, tgtx, tgty, 50);
 	ordersmap.insert(std::make_pair(u->unit_id, o));
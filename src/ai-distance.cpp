@@ -0,0 +1,368 @@
+#include "ai-distance.h"
+#include "map-graph.h"
+#include "map-astar.h"
+
+bool explore_picker::operator()(const coord& c) const
+{
+	for(int i = -1; i <= 1; i++) {
+		for(int j = -1; j <= 1; j++) {
+			if(i == 0 && j == 0)
+				continue;
+			if(c.x + i < 0 || c.x + i >= civ.m->size_x())
+				continue;
+			if(c.y + j < 0 || c.y + j >= civ.m->size_y())
+				continue;
+			if(civ.get_fog().get_value(c.x + i, c.y + j) == 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool city_picker::operator()(const coord& co) const
+{
+	const city* c = myciv->m->city_on_spot(co.x, co.y);
+	if(!c) {
+		return false;
+	}
+	else {
+		if(my_city) {
+			return c->civ_id == myciv->civ_id;
+		}
+		else {
+			return c->civ_id != myciv->civ_id &&
+				myciv->get_relationship_to_civ(c->civ_id) == relationship_war;
+		}
+	}
+}
+
+bool enemy_picker::operator()(const coord& co) const
+{
+	const city* c = myciv->m->city_on_spot(co.x, co.y);
+	unit_stack units = myciv->m->units_on_spot(co.x, co.y);
+	int civid = -1;
+	if(myciv->fog_at(co.x, co.y) != 2)
+		return false;
+	if(c)
+		civid = c->civ_id;
+	else if(!units.empty())
+		civid = units.front()->civ_id;
+	return civid != -1 && civid != (int)myciv->civ_id &&
+		 myciv->get_relationship_to_civ(civid) == relationship_war;
+}
+
+distance_fields::distance_fields(const civilization* civ_)
+	: civ(civ_),
+	fog_pos(0),
+	tile_pos(0)
+{
+	for(int i = 0; i < num_distance_targets; i++) {
+		for(int j = 0; j < (int)movement_class::road; j++)
+			fields[i][j].gen = 0;
+	}
+	scratch.gen = 0;
+	clear();
+}
+
+void distance_fields::clear()
+{
+	for(int i = 0; i < num_distance_targets; i++) {
+		for(int j = 0; j < (int)movement_class::road; j++) {
+			fields[i][j].built = false;
+			fields[i][j].queries = 0;
+		}
+		found[i] = false;
+	}
+	if(civ->m) {
+		civ->get_fog().get_newly_known(fog_pos, changes);
+		civ->m->get_tile_changes(tile_pos, changes);
+		changes.clear();
+	}
+}
+
+void distance_fields::check_changes()
+{
+	bool fog_ok = civ->get_fog().get_newly_known(fog_pos, changes);
+	bool tiles_ok = civ->m->get_tile_changes(tile_pos, changes);
+	if(!fog_ok || !tiles_ok || !changes.empty())
+		clear();
+	changes.clear();
+}
+
+// The same tiles as the pickers accept, without running them on every tile.
+const std::vector<int>& distance_fields::get_targets(distance_target t)
+{
+	std::vector<int>& ret = targets[t];
+	if(found[t])
+		return ret;
+	const map& m = *civ->m;
+	int sx = m.size_x();
+	int sy = m.size_y();
+	ret.clear();
+	switch(t) {
+		case target_own_city:
+			for(slot_map<city*>::const_iterator it = civ->cities.begin();
+					it != civ->cities.end();
+					++it) {
+				ret.push_back(it->second->ypos * sx + it->second->xpos);
+			}
+			break;
+		case target_frontier:
+			// known tiles next to unknown ones, without wrapping; the
+			// unknown ones can't be entered nor stood on
+			known.resize(sx * sy);
+			for(int y = 0; y < sy; y++)
+				for(int x = 0; x < sx; x++)
+					known[y * sx + x] = civ->get_fog().get_value(x, y) != 0;
+			for(int y = 0; y < sy; y++) {
+				for(int x = 0; x < sx; x++) {
+					if(!known[y * sx + x])
+						continue;
+					bool frontier = false;
+					for(int j = std::max(0, y - 1); !frontier && j <= std::min(sy - 1, y + 1); j++) {
+						for(int i = std::max(0, x - 1); i <= std::min(sx - 1, x + 1); i++) {
+							if(!known[j * sx + i]) {
+								frontier = true;
+								break;
+							}
+						}
+					}
+					if(frontier)
+						ret.push_back(y * sx + x);
+				}
+			}
+			break;
+		case target_enemy:
+			{
+				enemy_picker picker(civ);
+				for(int y = 0; y < sy; y++) {
+					for(int x = 0; x < sx; x++) {
+						if(civ->get_fog().get_value(x, y) == 2 && picker(coord(x, y)))
+							ret.push_back(y * sx + x);
+					}
+				}
+			}
+			break;
+		default:
+			break;
+	}
+	found[t] = true;
+	return ret;
+}
+
+void distance_fields::new_generation(field& f)
+{
+	const map& m = *civ->m;
+	int sx = m.size_x();
+	int sy = m.size_y();
+	if((int)f.tiles.size() != sx * sy) {
+		tile ti = { 0, -1, -1, -1 };
+		f.tiles.assign(sx * sy, ti);
+		f.gen = 0;
+	}
+	f.gen++;
+	if(f.gen == 0) {
+		for(unsigned int i = 0; i < f.tiles.size(); i++)
+			f.tiles[i].gen = 0;
+		f.gen = 1;
+	}
+	f.queue.clear();
+	f.head = 0;
+}
+
+template<typename Graph>
+void distance_fields::start(const Graph& g, distance_target t, field& f)
+{
+	int sx = civ->m->size_x();
+	new_generation(f);
+	const std::vector<int>& ts = get_targets(t);
+	for(unsigned int k = 0; k < ts.size(); k++) {
+		int i = ts[k];
+		tile& ti = f.tiles[i];
+		ti.gen = f.gen;
+		ti.dist = 0;
+		ti.next = i;
+		ti.target = i;
+		// targets the unit can't enter are only reached by standing on them
+		if(g.passable(i % sx, i / sx))
+			f.queue.push_back(i);
+	}
+	f.built = true;
+}
+
+// A BFS from the unit that finishes the step the first target is found
+// on, so that of the nearest targets it picks the same as the fields.
+template<typename Graph, typename Picker>
+int distance_fields::search_nearest(const Graph& g, const Picker& picker,
+		const unit& u, coord* target, coord* next)
+{
+	field& f = scratch;
+	int sx = civ->m->size_x();
+	new_generation(f);
+	int own = u.ypos * sx + u.xpos;
+	tile& to = f.tiles[own];
+	to.gen = f.gen;
+	to.dist = 0;
+	to.next = own;
+	f.queue.push_back(own);
+	int best = -1;
+	while(f.head < f.queue.size()) {
+		int i = f.queue[f.head++];
+		const tile& ti = f.tiles[i];
+		if(best != -1 && ti.dist > f.tiles[best].dist)
+			break;
+		if(picker(coord(i % sx, i / sx))) {
+			if(best == -1 || i < best)
+				best = i;
+			continue;
+		}
+		neighbour_buffer expanded;
+		g(coord(i % sx, i / sx), expanded);
+		for(const coord* it = expanded.begin();
+				it != expanded.end();
+				++it) {
+			int j = it->y * sx + it->x;
+			tile& tj = f.tiles[j];
+			if(tj.gen != f.gen) {
+				tj.gen = f.gen;
+				tj.dist = ti.dist + 1;
+				tj.next = i == own ? j : ti.next;
+				f.queue.push_back(j);
+			}
+		}
+	}
+	if(best == -1)
+		return -1;
+	if(target)
+		*target = coord(best % sx, best / sx);
+	if(next)
+		*next = coord(f.tiles[best].next % sx, f.tiles[best].next / sx);
+	return f.tiles[best].dist;
+}
+
+template<typename Graph>
+int distance_fields::search(const Graph& g, distance_target t,
+		const unit& u, coord* target, coord* next)
+{
+	switch(t) {
+		case target_own_city:
+			{
+				// don't search the whole continent if there's no city on it
+				bool reachable = false;
+				for(slot_map<city*>::const_iterator it = civ->cities.begin();
+						it != civ->cities.end() && !reachable;
+						++it) {
+					reachable = map_connected(*civ->m, u, coord(u.xpos, u.ypos),
+							coord(it->second->xpos, it->second->ypos));
+				}
+				if(!reachable)
+					return -1;
+			}
+			return search_nearest(g, city_picker(civ, true), u, target, next);
+		case target_frontier:
+			return search_nearest(g, explore_picker(*civ), u, target, next);
+		case target_enemy:
+			return search_nearest(g, enemy_picker(civ), u, target, next);
+		default:
+			return -1;
+	}
+}
+
+// A unit may path from any tile onto its passable neighbours, so the BFS
+// from the targets only expands passable tiles. Being breadth first, the
+// distance of a tile is final once it's reached, and the target, the
+// lowest tile index of the nearest ones, once the tiles a step nearer
+// are expanded. The BFS is only continued until that's the case for the
+// neighbours of the unit.
+template<typename Graph>
+int distance_fields::lookup(const Graph& g, distance_target t,
+		movement_class mc, const unit& u, coord* target, coord* next)
+{
+	field& f = fields[t][(int)mc];
+	if(!f.built) {
+		// most fields are only asked for once per turn, and a plain
+		// search stops at the nearest targets
+		if(f.queries++ == 0)
+			return search(g, t, u, target, next);
+		start(g, t, f);
+	}
+	int sx = civ->m->size_x();
+	int own = u.ypos * sx + u.xpos;
+	if(f.tiles[own].gen == f.gen && f.tiles[own].dist == 0) {
+		if(target)
+			*target = coord(u.xpos, u.ypos);
+		if(next)
+			*next = coord(u.xpos, u.ypos);
+		return 0;
+	}
+	neighbour_buffer children;
+	g(coord(u.xpos, u.ypos), children);
+	int dist = -1;
+	int step = -1;
+	while(1) {
+		for(const coord* it = children.begin();
+				it != children.end();
+				++it) {
+			int j = it->y * sx + it->x;
+			const tile& tj = f.tiles[j];
+			if(tj.gen != f.gen)
+				continue;
+			if(dist == -1 || tj.dist + 1 < dist ||
+					(tj.dist + 1 == dist && tj.target < f.tiles[step].target)) {
+				dist = tj.dist + 1;
+				step = j;
+			}
+		}
+		if(f.head == f.queue.size())
+			break;
+		if(dist != -1 && f.tiles[f.queue[f.head]].dist >= dist - 1)
+			break;
+		int i = f.queue[f.head++];
+		const tile& ti = f.tiles[i];
+		neighbour_buffer expanded;
+		g(coord(i % sx, i / sx), expanded);
+		for(const coord* it = expanded.begin();
+				it != expanded.end();
+				++it) {
+			int j = it->y * sx + it->x;
+			tile& tj = f.tiles[j];
+			if(tj.gen != f.gen) {
+				tj.gen = f.gen;
+				tj.dist = ti.dist + 1;
+				tj.next = i;
+				tj.target = ti.target;
+				f.queue.push_back(j);
+			}
+			else if(tj.dist == ti.dist + 1 && ti.target < tj.target) {
+				tj.next = i;
+				tj.target = ti.target;
+			}
+		}
+		dist = -1;
+		step = -1;
+	}
+	if(dist == -1)
+		return -1;
+	if(target)
+		*target = coord(f.tiles[step].target % sx, f.tiles[step].target / sx);
+	if(next)
+		*next = coord(step % sx, step / sx);
+	return dist;
+}
+
+int distance_fields::get_distance(distance_target t, const unit& u,
+		coord* target, coord* next)
+{
+	check_changes();
+	bool ignore_enemy = t == target_enemy;
+	if(u.is_land_unit())
+		return lookup(land_graph(*civ, u, ignore_enemy, NULL),
+				t, movement_class::land, u, target, next);
+	else if(u.uconf->ocean_unit)
+		return lookup(ocean_graph(*civ, u, ignore_enemy, NULL),
+				t, movement_class::ocean, u, target, next);
+	else
+		return lookup(sea_graph(*civ, u, ignore_enemy, NULL),
+				t, movement_class::sea, u, target, next);
+}
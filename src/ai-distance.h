@@ -0,0 +1,105 @@
+#ifndef AI_DISTANCE_H
+#define AI_DISTANCE_H
+
+#include <vector>
+
+#include "civ.h"
+#include "map-hierarchy.h"
+
+class explore_picker {
+	private:
+		const civilization& civ;
+	public:
+		explore_picker(const civilization& civ_) : civ(civ_) { }
+		bool operator()(const coord& c) const;
+};
+
+class city_picker {
+	private:
+		const civilization* myciv;
+		bool my_city;
+	public:
+		city_picker(const civilization* myciv_, bool my_city_) :
+			myciv(myciv_), my_city(my_city_) { }
+		bool operator()(const coord& co) const;
+};
+
+class enemy_picker {
+	private:
+		const civilization* myciv;
+	public:
+		enemy_picker(const civilization* myciv_) :
+			myciv(myciv_) { }
+		bool operator()(const coord& co) const;
+};
+
+enum distance_target {
+	target_own_city,     // city_picker, own cities
+	target_frontier,     // explore_picker
+	target_enemy,        // enemy_picker, ignoring enemies on the way
+	num_distance_targets // must be last
+};
+
+// Distances from every tile to the nearest target, as map_path_to_nearest()
+// would find them. There's one field per target and movement class, grown
+// by a BFS from all the targets at once only as far as the queries need.
+// The first query of a field is answered by a plain search instead.
+// The fields clear themselves when tiles become known or change, and
+// must be cleared when relations change and when the other civs have
+// moved. Foreign units seen on the way aren't followed, so while the
+// civ moves its own units the fields may lag behind them. That's good
+// enough for picking targets, as the paths there are searched anew.
+class distance_fields {
+	public:
+		distance_fields(const civilization* civ_);
+		void clear();
+		// Number of steps from the unit to the nearest target or -1 if
+		// there's none. The target, the one with the lowest tile index
+		// of the nearest ones, and the first tile on the way (the tile
+		// of the unit if it's on the target) are stored if asked for.
+		int get_distance(distance_target t, const unit& u,
+				coord* target = NULL, coord* next = NULL);
+	private:
+		struct tile {
+			unsigned int gen; // reached if equal to the field's
+			int dist;
+			int next;   // tile index
+			int target; // tile index
+		};
+		struct field {
+			bool built;
+			int queries; // since cleared
+			unsigned int gen;
+			std::vector<tile> tiles;
+			std::vector<int> queue;
+			unsigned int head;
+		};
+		void new_generation(field& f);
+		template<typename Graph>
+		void start(const Graph& g, distance_target t, field& f);
+		template<typename Graph, typename Picker>
+		int search_nearest(const Graph& g, const Picker& picker,
+				const unit& u, coord* target, coord* next);
+		template<typename Graph>
+		int search(const Graph& g, distance_target t, const unit& u,
+				coord* target, coord* next);
+		template<typename Graph>
+		int lookup(const Graph& g, distance_target t, movement_class mc,
+				const unit& u, coord* target, coord* next);
+		const std::vector<int>& get_targets(distance_target t);
+		void check_changes();
+		const civilization* civ;
+		// for land, sea and ocean units
+		field fields[num_distance_targets][(int)movement_class::road];
+		field scratch; // for the plain searches
+		bool found[num_distance_targets];
+		std::vector<int> targets[num_distance_targets]; // tile indices
+		std::vector<char> known; // for finding the frontier
+		// positions in the newly known tiles of the fog and in the tile
+		// changes of the map as of the last clear
+		unsigned int fog_pos;
+		unsigned int tile_pos;
+		std::vector<coord> changes;
+};
+
+#endif
@@ -107,9 +107,8 @@ int points_for_city_founding(const civilization* civ,
 	int food_points = 0;
 	int prod_points = 0;
 	int comm_points = 0;
-	civ->m->get_total_city_resources(co.x, co.y, &food_points,
-			&prod_points, &comm_points,
-			&civ->researched_advances, civ->gov->production_cap);
+	civ->get_total_city_resources(co.x, co.y, &food_points,
+			&prod_points, &comm_points);
 	food_points *= found_city.food_coeff;
 	prod_points *= found_city.prod_coeff;
 	comm_points *= found_city.comm_coeff;
@@ -365,7 +364,7 @@ bool expansion_objective::add_unit(unit* u)
 				if(oit != ordersmap.end()) {
 					// orders for the designated escorter found
 					delete oit->second;
-					std::map<unsigned int, unit*>::iterator uit = myciv->units.find(eit->second);
+					slot_map<unit*>::iterator uit = myciv->units.find(eit->second);
 					if(uit != myciv->units.end()) {
 						// designated escorter still exists
 						ordersmap[eit->second] = new escort_orders(myciv,
@@ -425,7 +424,7 @@ bool expansion_objective::add_unit(unit* u)
 				// delete transportee's previous orders (wait_orders)
 				delete oit->second;
 			}
-			std::map<unsigned int, unit*>::iterator transportee_it = myciv->units.find(it->second);
+			slot_map<unit*>::iterator transportee_it = myciv->units.find(it->second);
 			if(transportee_it == myciv->units.end()) {
 				// transportee's gone missing - oh hell, 
 				// transport the rest anyway.
@@ -523,7 +522,7 @@ found_city_orders::found_city_orders(const civilization* civ_,
 		unit* u_, const city_plan_map_t& planned_,
 		const ai_tunables_found_city& found_city_, 
 		int x_, int y_)
-	: goto_orders(civ_, u_, false, x_, y_),
+	: goto_orders(civ_, u_, false, x_, y_, false, true),
 	found_city(found_city_), failed(false),
 	planned(planned_)
 {
@@ -624,7 +623,7 @@ bool escort_orders::finished()
 
 bool escort_orders::replan()
 {
-	std::map<unsigned int, unit*>::const_iterator uit = civ->units.find(escortee_id);
+	slot_map<unit*>::const_iterator uit = civ->units.find(escortee_id);
 	if(uit != civ->units.end()) {
 		tgtx = uit->second->xpos;
 		tgty = uit->second->ypos;
@@ -648,7 +647,7 @@ void escort_orders::clear()
 
 transport_orders::transport_orders(const civilization* civ_, unit* u_, 
 		int tgtx_, int tgty_)
-	: goto_orders(civ_, u_, false, tgtx_, tgty_, true)
+	: goto_orders(civ_, u_, false, tgtx_, tgty_, true, true)
 {
 }
 
@@ -748,7 +747,7 @@ bool transported_orders::replan()
 {
 	if(done)
 		return false;
-	std::map<unsigned int, unit*>::const_iterator it = civ->units.find(transporter_id);
+	slot_map<unit*>::const_iterator it = civ->units.find(transporter_id);
 	if(it == civ->units.end()) {
 		// no transporter
 		done = true;
@@ -1,38 +1,5 @@
 #include "ai-exploration.h"
-#include "map-astar.h"
-
-class explore_picker {
-	private:
-		const civilization& civ;
-	public:
-		explore_picker(const civilization& civ_) : civ(civ_) { }
-		bool operator()(const coord& c) {
-			for(int i = -1; i <= 1; i++) {
-				for(int j = -1; j <= 1; j++) {
-					if(i == 0 && j == 0)
-						continue;
-					if(c.x + i < 0 || c.x + i >= civ.m->size_x())
-						continue;
-					if(c.y + j < 0 || c.y + j >= civ.m->size_y())
-						continue;
-					if(civ.fog.get_value(c.x + i, c.y + j) == 0) {
-						return true;
-					}
-				}
-			}
-			return false;
-		}
-};
-
-std::list<coord> exploration_path(const civilization& civ, const unit& u)
-{
-	explore_picker picker(civ);
-	return map_path_to_nearest(civ, 
-			u, 
-			false,
-			coord(u.xpos, u.ypos), 
-			picker);
-}
+#include "ai-distance.h"
 
 int exploration_distance_to_points(unsigned int dist, int map_dim)
 {
@@ -79,7 +46,7 @@ int exploration_objective::get_unit_points(const unit& u) const
 {
 	if(!usable_unit(*u.uconf))
 		return -1;
-	unsigned int dist = exploration_path(*myciv, u).size();
+	unsigned int dist = fields->get_distance(target_frontier, u) + 1;
 	int val = exploration_distance_to_points(dist, 
 			std::max(myciv->m->size_x(), myciv->m->size_y()));
 	return val;
@@ -99,12 +66,13 @@ orders* exploration_objective::create_exploration_orders(unit* u) const
 	if(u->uconf->settler || u->uconf->worker)
 		return NULL;
 	else
-		return new explore_orders(myciv, u, false);
+		return new explore_orders(myciv, u, fields, false);
 }
 
 explore_orders::explore_orders(const civilization* civ_, unit* u_,
-		bool autocontinue_)
+		distance_fields* fields_, bool autocontinue_)
 	: goto_orders(civ_, u_, false, u_->xpos, u_->ypos),
+	fields(fields_),
 	autocontinue(autocontinue_)
 {
 	get_new_path();
@@ -113,10 +81,10 @@ explore_orders::explore_orders(const civilization* civ_, unit* u_,
 void explore_orders::get_new_path()
 {
 	path.clear();
-	std::list<coord> fog_path = exploration_path(*civ, *u);
-	if(!fog_path.empty()) {
-		tgtx = fog_path.back().x;
-		tgty = fog_path.back().y;
+	coord tgt;
+	if(fields->get_distance(target_frontier, *u, &tgt) >= 0) {
+		tgtx = tgt.x;
+		tgty = tgt.y;
 		goto_orders::get_new_path();
 	}
 }
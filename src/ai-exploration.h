@@ -24,12 +24,13 @@ class exploration_objective : public objective {
 class explore_orders : public goto_orders {
 	public:
 		explore_orders(const civilization* civ_, unit* u_, 
-				bool autocontinue_);
+				distance_fields* fields_, bool autocontinue_);
 		void drop_action();
 		bool replan();
 		void clear();
 	private:
 		void get_new_path();
+		distance_fields* fields; // shared by the objectives of the civ
 		bool autocontinue;
 };
 
@@ -4,7 +4,7 @@
 #include "ai-debug.h"
 
 objective::objective(pompelmous* r_, civilization* myciv_, const std::string& obj_name_)
-	: r(r_), myciv(myciv_), obj_name(obj_name_)
+	: r(r_), myciv(myciv_), obj_name(obj_name_), fields(NULL)
 {
 }
 
@@ -88,7 +88,7 @@ void objective::process(std::set<unsigned int>* freed_units)
 {
 	ordersmap_t::iterator oit = ordersmap.begin();
 	while(oit != ordersmap.end()) {
-		std::map<unsigned int, unit*>::iterator uit = myciv->units.find(oit->first);
+		slot_map<unit*>::iterator uit = myciv->units.find(oit->first);
 		if(uit == myciv->units.end()) {
 			// unit lost
 			ordersmap.erase(oit++);
@@ -186,3 +186,8 @@ void objective::forget_everything()
 }
 
 
+
+void objective::set_distance_fields(distance_fields* fields_)
+{
+	fields = fields_;
+}
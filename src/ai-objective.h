@@ -6,6 +6,8 @@
 #include "pompelmous.h"
 #include "ai-orders.h"
 
+class distance_fields;
+
 typedef std::map<unsigned int, orders*> ordersmap_t;
 
 typedef bool(*unit_comp_func_t)(const unit_configuration& lhs, 
@@ -24,6 +26,7 @@ class objective {
 		virtual void process(std::set<unsigned int>* freed_units);
 		const std::string& get_name() const;
 		virtual void forget_everything();
+		void set_distance_fields(distance_fields* fields_);
 	protected:
 		virtual bool compare_units(const unit_configuration& lhs,
 				const unit_configuration& rhs) const = 0;
@@ -34,6 +37,7 @@ class objective {
 		civilization* myciv;
 		ordersmap_t ordersmap;
 		std::string obj_name;
+		distance_fields* fields; // shared by the objectives of the civ
 	private:
 		city_production best_unit_production(const city& c,
 				int* points) const;
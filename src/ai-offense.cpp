@@ -1,30 +1,10 @@
 #include "map-astar.h"
+#include "ai-distance.h"
 
 #include "ai-offense.h"
 #include "ai-defense.h"
 #include "ai-debug.h"
 
-class enemy_picker {
-	private:
-		const civilization* myciv;
-	public:
-		enemy_picker(const civilization* myciv_) : 
-			myciv(myciv_) { }
-		bool operator()(const coord& co) {
-			const city* c = myciv->m->city_on_spot(co.x, co.y);
-			const std::list<unit*>& units = myciv->m->units_on_spot(co.x, co.y);
-			int civid = -1;
-			if(myciv->fog_at(co.x, co.y) != 2)
-				return false;
-			if(c)
-				civid = c->civ_id;
-			else if(!units.empty())
-				civid = units.front()->civ_id;
-			return civid != -1 && civid != (int)myciv->civ_id &&
-				 myciv->get_relationship_to_civ(civid) == relationship_war;
-		}
-};
-
 bool find_nearest_enemy(const civilization* myciv, const unit* u, int* tgtx, int* tgty)
 {
 	enemy_picker picker(myciv);
@@ -58,14 +38,12 @@ int offense_objective::get_unit_points(const unit& u) const
 		return -1;
 	if(u.uconf->is_water_unit())
 		return -1;
-	int tgtx, tgty;
 	int prio = -1;
-	tgtx = u.xpos;
-	tgty = u.ypos;
-	if(find_nearest_enemy(myciv, &u, &tgtx, &tgty)) {
+	coord tgt;
+	if(fields->get_distance(target_enemy, u, &tgt) >= 0) {
 		prio = std::max<int>(0, max_offense_prio + 
 				unit_strength_prio_coeff * u.uconf->max_strength * u.uconf->max_strength - 
-				offense_dist_prio_coeff * myciv->m->manhattan_distance(tgtx, tgty,
+				offense_dist_prio_coeff * myciv->m->manhattan_distance(tgt.x, tgt.y,
 					u.xpos, u.ypos));
 	}
 	return prio;
@@ -73,13 +51,11 @@ int offense_objective::get_unit_points(const unit& u) const
 
 bool offense_objective::add_unit(unit* u)
 {
-	int tgtx, tgty;
-	tgtx = u->xpos;
-	tgty = u->ypos;
-	if(!find_nearest_enemy(myciv, u, &tgtx, &tgty)) {
+	coord tgt;
+	if(fields->get_distance(target_enemy, *u, &tgt) < 0) {
 		return false;
 	}
-	attack_orders* o = new attack_orders(myciv, u, tgtx, tgty);
+	attack_orders* o = new attack_orders(myciv, u, tgt.x, tgt.y);
 	ordersmap.insert(std::make_pair(u->unit_id, o));
 	return true;
 }
@@ -4,6 +4,7 @@
 #include "ai-orders.h"
 #include "ai-debug.h"
 #include "map-astar.h"
+#include "ai-distance.h"
 
 primitive_orders::primitive_orders(const action& a_)
 	: a(a_), finished_flag(false)
@@ -38,21 +39,47 @@ void primitive_orders::clear()
 }
 
 goto_orders::goto_orders(const civilization* civ_, unit* u_, 
-		bool ignore_enemy_, int x_, int y_, bool coastal_)
+		bool ignore_enemy_, int x_, int y_, bool coastal_,
+		bool incremental_)
 	: tgtx(x_),
 	tgty(y_),
 	civ(civ_),
 	u(u_),
 	ignore_enemy(ignore_enemy_),
-	coastal(coastal_)
+	coastal(coastal_),
+	replanner(NULL),
+	incremental(incremental_)
 {
 	get_new_path();
 }
 
+goto_orders::~goto_orders()
+{
+	delete replanner;
+}
+
 void goto_orders::get_new_path()
 {
-	path = map_astar(*civ, *u, ignore_enemy, coord(u->xpos, u->ypos), 
-			coord(tgtx, tgty), coastal);
+	coord start(u->xpos, u->ypos);
+	coord goal(tgtx, tgty);
+	if(!incremental) {
+		if(coastal)
+			path = map_astar(*civ, *u, ignore_enemy, start, goal, coastal);
+		else
+			path = map_hierarchical_astar(*civ, *u, ignore_enemy, start, goal);
+	}
+	else {
+		if(replanner && replanner->get_goal() != goal)
+			replanner->set_goal(goal);
+		if(!coastal && !map_connected(*civ->m, *u, start, goal)) {
+			path.clear();
+		}
+		else {
+			if(!replanner)
+				replanner = map_dstar(*civ, *u, ignore_enemy, goal, coastal);
+			path = replanner->find(start);
+		}
+	}
 	if(!path.empty())
 		path.pop_front();
 }
@@ -151,32 +178,23 @@ void wait_orders::clear()
 	rounds_to_go = 0;
 }
 
-class city_picker {
-	private:
-		const civilization* myciv;
-		bool my_city;
-	public:
-		city_picker(const civilization* myciv_, bool my_city_) : 
-			myciv(myciv_), my_city(my_city_) { }
-		bool operator()(const coord& co) {
-			const city* c = myciv->m->city_on_spot(co.x, co.y);
-			if(!c) {
-				return false;
-			}
-			else {
-				if(my_city) {
-					return c->civ_id == myciv->civ_id;
-				}
-				else {
-					return c->civ_id != myciv->civ_id && 
-						myciv->get_relationship_to_civ(c->civ_id) == relationship_war;
-				}
-			}
-		}
-};
-
 city* find_nearest_city(const civilization* myciv, const unit& u, bool own)
 {
+	if(own) {
+		// don't search the whole continent if there's no city on it
+		bool reachable = false;
+		for(slot_map<city*>::const_iterator it = myciv->cities.begin();
+				it != myciv->cities.end();
+				++it) {
+			if(map_connected(*myciv->m, u, coord(u.xpos, u.ypos),
+						coord(it->second->xpos, it->second->ypos))) {
+				reachable = true;
+				break;
+			}
+		}
+		if(!reachable)
+			return NULL;
+	}
 	city_picker picker(myciv, own);
 	std::list<coord> path_to_city = map_path_to_nearest(*myciv, 
 			u, 
@@ -5,6 +5,8 @@
 
 #include "pompelmous.h"
 
+class map_replanner;
+
 class orders {
 	public:
 		virtual ~orders() { }
@@ -32,8 +34,8 @@ class goto_orders : public orders {
 	public:
 		goto_orders(const civilization* civ_, unit* u_, 
 				bool ignore_enemy_, int x_, int y_,
-				bool coastal_ = false);
-		virtual ~goto_orders() { }
+				bool coastal_ = false, bool incremental_ = false);
+		virtual ~goto_orders();
 		virtual action get_action();
 		virtual void drop_action();
 		virtual bool finished();
@@ -50,6 +52,13 @@ class goto_orders : public orders {
 		std::list<coord> path;
 		bool ignore_enemy;
 		bool coastal;
+	private:
+		goto_orders(const goto_orders&);
+		goto_orders& operator=(const goto_orders&);
+		// kept between the paths if incremental, started over for a
+		// new target
+		map_replanner* replanner;
+		bool incremental;
 };
 
 class wait_orders : public orders {
@@ -28,7 +28,8 @@ ai_tunable_parameters::ai_tunable_parameters()
 ai::ai(map& m_, pompelmous& r_, civilization* c)
 	: r(r_),
 	myciv(c),
-	planned_new_government_form(0)
+	planned_new_government_form(0),
+	fields(c)
 {
 	if(!myciv->is_minor_civ()) {
 		objectives.push_back(std::make_pair(new defense_objective(&r, myciv, "defense"), 1200));
@@ -45,6 +46,7 @@ ai::ai(map& m_, pompelmous& r_, civilization* c)
 	for(std::list<std::pair<objective*, int> >::iterator it = objectives.begin();
 			it != objectives.end();
 			++it) {
+		it->first->set_distance_fields(&fields);
 	}
 }
 
@@ -94,7 +96,7 @@ bool ai::try_declare_war()
 					num_visible_population += c->get_city_size();
 					// use simple BFS as not to assume which kind of unit
 					// will be used in offensive
-					int this_dist = map_birds_path_to_nearest(
+					int this_dist = map_birds_path_to_nearest(*myciv->m,
 							coord(capital->xpos, capital->ypos),
 							coord(c->xpos, c->ypos)).size();
 					if(this_dist > 0 && this_dist < dist_to_nearest_visible_city_from_capital) {
@@ -122,6 +124,9 @@ bool ai::play()
 		return !r.perform_action(myciv->civ_id, action(action_eot));
 	}
 
+	// the other civs have moved since the last turn
+	fields.clear();
+
 	// handle messages
 	while(!myciv->messages.empty())  {
 		msg& m = myciv->messages.front();
@@ -210,12 +215,13 @@ bool ai::play()
 		}
 		if(relations_changed) {
 			ai_debug_printf(myciv->civ_id, "Relations changed.\n");
+			fields.clear();
 			forget_all_unit_plans();
 		}
 	}
 
 	// assign orders to cities not producing anything
-	for(std::map<unsigned int, city*>::iterator it = myciv->cities.begin();
+	for(slot_map<city*>::iterator it = myciv->cities.begin();
 			it != myciv->cities.end();
 			++it) {
 		city* c = it->second;
@@ -225,7 +231,7 @@ bool ai::play()
 	}
 
 	// check for new units
-	for(std::map<unsigned int, unit*>::iterator it = myciv->units.begin();
+	for(slot_map<unit*>::iterator it = myciv->units.begin();
 			it != myciv->units.end();
 			++it) {
 		if(handled_units.find(it->second->unit_id) == handled_units.end()) {
@@ -240,7 +246,7 @@ bool ai::play()
 	{
 		std::set<unsigned int>::iterator it = free_units.begin();
 		while(it != free_units.end()) {
-			std::map<unsigned int, unit*>::iterator uit = myciv->units.find(*it);
+			slot_map<unit*>::iterator uit = myciv->units.find(*it);
 			if(uit == myciv->units.end()) {
 				free_units.erase(it++);
 			}
@@ -360,7 +366,7 @@ int ai::get_research_goal_points_worker(const advance& a,
 			++uit) {
 		if(uit->second.needed_advance == a.advance_id) {
 			int unit_points = 0;
-			for(std::map<unsigned int, city*>::const_iterator cit = myciv->cities.begin();
+			for(slot_map<city*>::const_iterator cit = myciv->cities.begin();
 					cit != myciv->cities.end();
 					++cit) {
 				unit dummy(0, uit->first, cit->second->xpos, cit->second->ypos, myciv->civ_id,
@@ -386,7 +392,7 @@ int ai::get_research_goal_points_worker(const advance& a,
 			++ciit) {
 		if(ciit->second.needed_advance == a.advance_id) {
 			int city_points = 0;
-			for(std::map<unsigned int, city*>::const_iterator cit = myciv->cities.begin();
+			for(slot_map<city*>::const_iterator cit = myciv->cities.begin();
 					cit != myciv->cities.end();
 					++cit) {
 				for(std::list<std::pair<objective*, int> >::const_iterator oit = objectives.begin();
@@ -510,7 +516,7 @@ void ai::handle_new_improv(const msg& m)
 void ai::handle_new_unit(const msg& m)
 {
 	// allocate new unit to an objective.
-	std::map<unsigned int, unit*>::iterator uit = myciv->units.find(m.msg_data.city_prod_data.unit_id);
+	slot_map<unit*>::iterator uit = myciv->units.find(m.msg_data.city_prod_data.unit_id);
 	if(uit != myciv->units.end()) {
 		bool unit_added = false;
 		std::map<unsigned int, objective*>::iterator oit = 
@@ -552,7 +558,7 @@ void ai::handle_new_unit(const msg& m)
 	}
 
 	// find a new build objective for the city.
-	std::map<unsigned int, city*>::iterator cit = myciv->cities.find(m.msg_data.city_prod_data.building_city_id);
+	slot_map<city*>::iterator cit = myciv->cities.find(m.msg_data.city_prod_data.building_city_id);
 	if(cit != myciv->cities.end()) {
 		ai_debug_printf(myciv->civ_id, "new unit %s built in %s.\n",
 				uit->second->uconf->unit_name.c_str(),
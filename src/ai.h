@@ -14,6 +14,7 @@
 #include "ai-defense.h"
 #include "ai-offense.h"
 #include "ai-commerce.h"
+#include "ai-distance.h"
 
 struct ai_tunable_parameters {
 	ai_tunable_parameters();
@@ -66,6 +67,7 @@ class ai : public diplomat {
 		pompelmous& r;
 		civilization* myciv;
 		unsigned int planned_new_government_form;
+		distance_fields fields;
 };
 
 #endif
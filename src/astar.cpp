@@ -1,99 +1,104 @@
 #include "astar.h"
 
-#include <queue>
-#include <set>
-#include <map>
 #include <utility>
 #include <stdio.h>
 
 // #define DEBUG_ASTAR
 
-class comp_func {
-	public:
-		bool operator()(const std::pair<int, const coord&>& lhs, const std::pair<int, const coord&>& rhs)
-		{
-			return lhs.first > rhs.first;
-		}
-};
+astar_context::astar_context()
+	: sx(0),
+	sy(0),
+	gen(0)
+{
+}
 
-std::list<coord> astar(graphfunc g, costfunc c, heurfunc h, 
-		goaltestfunc gtfunc, const coord& start)
+void astar_context::resize(int x, int y)
 {
-	using namespace std;
+	sx = x;
+	sy = y;
+	gen = 0;
+	nodes.assign(x * y, astar_node());
+	overflow.clear();
+}
 
-	set<coord> visited;
-	std::map<coord, int> cost_here; // real (g) cost
-	list<coord> path;
-	std::map<coord, coord> parents;
-	priority_queue<pair<int, coord>, vector<pair<int, coord> >, comp_func> open_nodes; // key is the total (f) cost
+void astar_context::new_search()
+{
+	gen++;
+	if(gen == 0) {
+		// generation counter wrapped - stale stamps could match again
+		nodes.assign(sx * sy, astar_node());
+		gen = 1;
+	}
+	overflow.clear();
+	open_nodes.clear();
+}
 
-	open_nodes.push(make_pair(0, start));
-	do {
-		// current node is the parent
-		coord current(open_nodes.top().second);
-		open_nodes.pop();
+namespace {
 
-		// when relaxing the edges, previous edges are left in the queue
-		// so check if already visited
-		if(visited.find(current) != visited.end())
-			continue;
+// one context per nesting level - goal tests may start searches of their own
+thread_local std::list<astar_context> context_stack;
+thread_local unsigned int search_depth = 0;
 
-		visited.insert(current);
-		set<coord> children = g(current);
+}
 
-		// check for goal
-		if(gtfunc(current)) {
-			path.push_front(current);
-			break;
-		}
-		for(set<coord>::const_iterator children_it = children.begin();
-				children_it != children.end();
-				++children_it) {
-			// check if already visited
-			if(visited.find(*children_it) != visited.end())
-				continue;
+astar_context_lease::astar_context_lease(int size_x, int size_y)
+{
+	std::list<astar_context>::iterator it = context_stack.begin();
+	for(unsigned int i = 0; i < search_depth && it != context_stack.end(); i++)
+		++it;
+	if(it == context_stack.end())
+		it = context_stack.insert(it, astar_context());
+	ctx = &*it;
+	if(ctx->size_x() != size_x || ctx->size_y() != size_y)
+		ctx->resize(size_x, size_y);
+	search_depth++;
+}
 
-			int edge_cost = c(current, *children_it);
-			if(edge_cost < 0) {
-				fprintf(stderr, "A* error: negative edge cost\n");
-				continue;
-			}
-			int this_g_cost = cost_here[current] + edge_cost;
+astar_context_lease::~astar_context_lease()
+{
+	search_depth--;
+}
 
-			// check if already in open list
-			bool add_this_as_parent = true;
-			std::map<coord, int>::const_iterator already_open_child = cost_here.find(*children_it);
-			if(already_open_child != cost_here.end()) {
-				// already in open list => check if the cost is less than previous
-				int cost_prev = already_open_child->second;
-				if(cost_prev <= this_g_cost)
-					add_this_as_parent = false;
-			}
-			if(add_this_as_parent) {
-				int this_f_cost = this_g_cost + h(*children_it);
-				parents[*children_it] = current;
-				open_nodes.push(make_pair(this_f_cost, *children_it));
-				cost_here[*children_it] = this_g_cost;
+class set_graph {
+	public:
+		set_graph(const graphfunc& g_) : g(g_) { }
+		void operator()(const coord& a, neighbour_buffer& children) const
+		{
+			std::set<coord> s = g(a);
+			for(std::set<coord>::const_iterator it = s.begin();
+					it != s.end();
+					++it) {
+				children.insert(*it);
 			}
 		}
-	} while(!open_nodes.empty());
-	if(path.empty())
-		return path;
-	coord curr_node = path.front();
-	while(1) {
-		std::map<coord, coord>::const_iterator par_it = parents.find(curr_node);
-		if(par_it == parents.end())
-			break;
-		curr_node = par_it->second;
-		path.push_back(curr_node);
-	}
-	path.reverse();
+	private:
+		graphfunc g;
+};
+
+std::list<coord> astar(astar_context& ctx, graphfunc g, costfunc c,
+		heurfunc h, goaltestfunc gtfunc, const coord& start)
+{
+	std::list<coord> path = make_astar(set_graph(g), c, h, gtfunc).find(ctx, start);
 #ifdef DEBUG_ASTAR
 	print_path(stderr, path);
 #endif
 	return path;
 }
 
+std::list<coord> astar(int size_x, int size_y, graphfunc g, costfunc c,
+		heurfunc h, goaltestfunc gtfunc, const coord& start)
+{
+	astar_context_lease lease(size_x, size_y);
+	return astar(lease.get(), g, c, h, gtfunc, start);
+}
+
+std::list<coord> astar(graphfunc g, costfunc c, heurfunc h,
+		goaltestfunc gtfunc, const coord& start)
+{
+	astar_context ctx;
+	return astar(ctx, g, c, h, gtfunc, start);
+}
+
 void print_path(FILE* fp, const std::list<coord>& path)
 {
 	fprintf(fp, "Found path: ");
@@ -104,5 +109,3 @@ void print_path(FILE* fp, const std::list<coord>& path)
 	}
 	fprintf(fp, "\n");
 }
-
-
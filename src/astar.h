@@ -3,6 +3,12 @@
 
 #include <list>
 #include <set>
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdio.h>
+#include <assert.h>
 #include <boost/function.hpp>
 
 #include "coord.h"
@@ -12,7 +18,281 @@ typedef boost::function<int(const coord& a, const coord& b)> costfunc;
 typedef boost::function<int(const coord& a)> heurfunc;
 typedef boost::function<bool(const coord& a)> goaltestfunc;
 
-std::list<coord> astar(graphfunc g, costfunc c, heurfunc h, 
+// Neighbours of a tile, filled in by the graph on each expansion. Kept
+// sorted and unique like the std::set the graphs used to return, so the
+// search order doesn't depend on the order of insertion.
+class neighbour_buffer {
+	public:
+		static const int capacity = 8;
+		neighbour_buffer();
+		void insert(const coord& c);
+		void clear();
+		const coord* begin() const;
+		const coord* end() const;
+		int size() const;
+	private:
+		coord data[capacity];
+		int num;
+};
+
+inline neighbour_buffer::neighbour_buffer()
+	: num(0)
+{
+}
+
+inline void neighbour_buffer::insert(const coord& c)
+{
+	int i = num;
+	while(i > 0 && c < data[i - 1])
+		i--;
+	if(i > 0 && data[i - 1] == c)
+		return;
+	assert(num < capacity);
+	for(int k = num; k > i; k--)
+		data[k] = data[k - 1];
+	data[i] = c;
+	num++;
+}
+
+inline void neighbour_buffer::clear()
+{
+	num = 0;
+}
+
+inline const coord* neighbour_buffer::begin() const
+{
+	return data;
+}
+
+inline const coord* neighbour_buffer::end() const
+{
+	return data + num;
+}
+
+inline int neighbour_buffer::size() const
+{
+	return num;
+}
+
+struct astar_node {
+	astar_node();
+	unsigned int open_gen;   // cost and parent valid if == current generation
+	unsigned int closed_gen; // visited if == current generation
+	int cost;                // real (g) cost
+	coord parent;
+};
+
+// Search state for astar(). The node data is kept in flat per-tile arrays
+// sized to the map, and every search bumps the generation counter instead
+// of clearing them. Coordinates outside the map (the bird and road graphs
+// don't wrap) are kept in a small overflow map.
+class astar_context {
+	public:
+		astar_context();
+		void resize(int x, int y);
+		int size_x() const;
+		int size_y() const;
+		void new_search();
+		unsigned int generation() const;
+		astar_node* get_node(const coord& c);
+		std::vector<std::pair<int, coord> > open_nodes;
+	private:
+		int sx;
+		int sy;
+		unsigned int gen;
+		std::vector<astar_node> nodes;
+		std::map<coord, astar_node> overflow;
+};
+
+inline astar_node::astar_node()
+	: open_gen(0),
+	closed_gen(0),
+	cost(0)
+{
+}
+
+inline int astar_context::size_x() const
+{
+	return sx;
+}
+
+inline int astar_context::size_y() const
+{
+	return sy;
+}
+
+inline unsigned int astar_context::generation() const
+{
+	return gen;
+}
+
+inline astar_node* astar_context::get_node(const coord& c)
+{
+	if((unsigned int)c.x < (unsigned int)sx &&
+			(unsigned int)c.y < (unsigned int)sy)
+		return &nodes[c.y * sx + c.x];
+	return &overflow[c];
+}
+
+// borrows a context from a per-thread stack, sized to the given map
+// dimensions. Nested searches (e.g. started from a goal test) get the
+// next context on the stack.
+class astar_context_lease {
+	public:
+		astar_context_lease(int size_x, int size_y);
+		~astar_context_lease();
+		astar_context& get();
+	private:
+		astar_context_lease(const astar_context_lease&);
+		astar_context_lease& operator=(const astar_context_lease&);
+		astar_context* ctx;
+};
+
+inline astar_context& astar_context_lease::get()
+{
+	return *ctx;
+}
+
+class astar_open_node_comp {
+	public:
+		bool operator()(const std::pair<int, coord>& lhs,
+				const std::pair<int, coord>& rhs) const
+		{
+			return lhs.first > rhs.first;
+		}
+};
+
+// A* with the graph, cost, heuristic and goal test given as types so
+// that the calls in the inner loop can be inlined.
+//
+// Graph: void operator()(const coord& a, neighbour_buffer& children)
+// Cost:  int operator()(const coord& a, const coord& b)
+// Heur:  int operator()(const coord& a)
+// Goal:  bool operator()(const coord& a)
+template<typename Graph, typename Cost, typename Heur, typename Goal>
+class astar_t {
+	public:
+		astar_t(const Graph& g_, const Cost& c_, const Heur& h_,
+				const Goal& gt_);
+		std::list<coord> find(astar_context& ctx, const coord& start);
+		std::list<coord> find(int size_x, int size_y, const coord& start);
+	private:
+		Graph g;
+		Cost c;
+		Heur h;
+		Goal gt;
+};
+
+template<typename Graph, typename Cost, typename Heur, typename Goal>
+astar_t<Graph, Cost, Heur, Goal> make_astar(const Graph& g, const Cost& c,
+		const Heur& h, const Goal& gt)
+{
+	return astar_t<Graph, Cost, Heur, Goal>(g, c, h, gt);
+}
+
+template<typename Graph, typename Cost, typename Heur, typename Goal>
+astar_t<Graph, Cost, Heur, Goal>::astar_t(const Graph& g_, const Cost& c_,
+		const Heur& h_, const Goal& gt_)
+	: g(g_),
+	c(c_),
+	h(h_),
+	gt(gt_)
+{
+}
+
+template<typename Graph, typename Cost, typename Heur, typename Goal>
+std::list<coord> astar_t<Graph, Cost, Heur, Goal>::find(int size_x, int size_y,
+		const coord& start)
+{
+	astar_context_lease lease(size_x, size_y);
+	return find(lease.get(), start);
+}
+
+template<typename Graph, typename Cost, typename Heur, typename Goal>
+std::list<coord> astar_t<Graph, Cost, Heur, Goal>::find(astar_context& ctx,
+		const coord& start)
+{
+	using namespace std;
+
+	astar_open_node_comp comp;
+	list<coord> path;
+	ctx.new_search();
+	const unsigned int gen = ctx.generation();
+	// key is the total (f) cost
+	vector<pair<int, coord> >& open_nodes = ctx.open_nodes;
+
+	astar_node* start_node = ctx.get_node(start);
+	start_node->open_gen = gen;
+	start_node->cost = 0;
+	open_nodes.push_back(make_pair(0, start));
+	do {
+		// current node is the parent
+		coord current(open_nodes.front().second);
+		pop_heap(open_nodes.begin(), open_nodes.end(), comp);
+		open_nodes.pop_back();
+
+		// when relaxing the edges, previous edges are left in the queue
+		// so check if already visited
+		astar_node* current_node = ctx.get_node(current);
+		if(current_node->closed_gen == gen)
+			continue;
+
+		current_node->closed_gen = gen;
+		int current_cost = current_node->cost;
+		neighbour_buffer children;
+		g(current, children);
+
+		// check for goal
+		if(gt(current)) {
+			path.push_front(current);
+			break;
+		}
+		for(const coord* children_it = children.begin();
+				children_it != children.end();
+				++children_it) {
+			// check if already visited
+			astar_node* child_node = ctx.get_node(*children_it);
+			if(child_node->closed_gen == gen)
+				continue;
+
+			int edge_cost = c(current, *children_it);
+			if(edge_cost < 0) {
+				fprintf(stderr, "A* error: negative edge cost\n");
+				continue;
+			}
+			int this_g_cost = current_cost + edge_cost;
+
+			// already in open list => check if the cost is less than previous
+			if(child_node->open_gen == gen && child_node->cost <= this_g_cost)
+				continue;
+
+			int this_f_cost = this_g_cost + h(*children_it);
+			child_node->open_gen = gen;
+			child_node->cost = this_g_cost;
+			child_node->parent = current;
+			open_nodes.push_back(make_pair(this_f_cost, *children_it));
+			push_heap(open_nodes.begin(), open_nodes.end(), comp);
+		}
+	} while(!open_nodes.empty());
+	if(path.empty())
+		return path;
+	coord curr_node = path.front();
+	while(curr_node != start) {
+		curr_node = ctx.get_node(curr_node)->parent;
+		path.push_back(curr_node);
+	}
+	path.reverse();
+	return path;
+}
+
+// graphfunc returns at most neighbour_buffer::capacity neighbours
+std::list<coord> astar(astar_context& ctx, graphfunc g, costfunc c,
+		heurfunc h, goaltestfunc gtfunc, const coord& start);
+
+std::list<coord> astar(int size_x, int size_y, graphfunc g, costfunc c,
+		heurfunc h, goaltestfunc gtfunc, const coord& start);
+
+std::list<coord> astar(graphfunc g, costfunc c, heurfunc h,
 		goaltestfunc gtfunc, const coord& start);
 
 void print_path(FILE* fp, const std::list<coord>& path);
@@ -1,6 +1,8 @@
 #ifndef BUF2D_H
 #define BUF2D_H
 
+#include <algorithm>
+
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/serialization/split_member.hpp>
@@ -8,7 +10,86 @@
 
 #include "utils.h"
 
-template<typename N>
+// The elements row by row.
+class row_major_layout {
+	public:
+		row_major_layout(int x, int y) : size_x(x) { }
+		row_major_layout() : size_x(0) { }
+		static int storage_size(int x, int y) { return x * y; }
+		int index(int x, int y) const { return y * size_x + x; }
+		// calls func(x, y, index) for the rectangle, ends included
+		template<typename F>
+		void for_rectangle(int x0, int y0, int x1, int y1, F& func) const;
+		static const bool row_major = true;
+	private:
+		int size_x;
+};
+
+// The elements in blocks of 8x8, in Z-order (Morton order) in a block
+// and the blocks row by row, so that a small square is in a few cache
+// lines however wide the buffer is. The last blocks of a row or column
+// are padded.
+class tiled_layout {
+	public:
+		tiled_layout(int x, int y) : blocks_x((x + 7) / 8) { }
+		tiled_layout() : blocks_x(0) { }
+		static int storage_size(int x, int y) { return ((x + 7) / 8) * ((y + 7) / 8) * 64; }
+		int index(int x, int y) const;
+		// calls func(x, y, index) for the rectangle, ends included,
+		// a block at a time
+		template<typename F>
+		void for_rectangle(int x0, int y0, int x1, int y1, F& func) const;
+		static const bool row_major = false;
+	private:
+		// the bits of a coordinate within a block, one bit apart
+		static int spread(int v);
+		int blocks_x;
+};
+
+inline int tiled_layout::index(int x, int y) const
+{
+	int block = (y >> 3) * blocks_x + (x >> 3);
+	return (block << 6) | spread(x & 7) | (spread(y & 7) << 1);
+}
+
+inline int tiled_layout::spread(int v)
+{
+	return (v & 1) | ((v & 2) << 1) | ((v & 4) << 2);
+}
+
+template<typename F>
+void row_major_layout::for_rectangle(int x0, int y0, int x1, int y1, F& func) const
+{
+	for(int y = y0; y <= y1; y++) {
+		int i = index(x0, y);
+		for(int x = x0; x <= x1; x++)
+			func(x, y, i++);
+	}
+}
+
+template<typename F>
+void tiled_layout::for_rectangle(int x0, int y0, int x1, int y1, F& func) const
+{
+	for(int by = y0 & ~7; by <= y1; by += 8) {
+		int ys = std::max(y0, by);
+		int ye = std::min(y1, by + 7);
+		for(int bx = x0 & ~7; bx <= x1; bx += 8) {
+			int base = ((by >> 3) * blocks_x + (bx >> 3)) << 6;
+			int xs = std::max(x0, bx);
+			int xe = std::min(x1, bx + 7);
+			for(int y = ys; y <= ye; y++) {
+				int row = base | (spread(y & 7) << 1);
+				for(int x = xs; x <= xe; x++)
+					func(x, y, row | spread(x & 7));
+			}
+		}
+	}
+}
+
+// A 2D buffer in the given layout. Only the row major buffers are
+// serialized as they are; save_rows() and load_rows() save the others as
+// row major buffers, so that the saves don't depend on the layout.
+template<typename N, typename Layout = row_major_layout>
 class buf2d {
 	public:
 		buf2d(int x, int y, const N& def);
@@ -19,16 +100,27 @@ class buf2d {
 		const N* get(int x, int y) const;
 		N* get_mod(int x, int y);
 		void set(int x, int y, const N& val);
+		// Calls func(x, y, value) for the elements from (x0, y0) to
+		// (x1, y1), clipped to the buffer, in the order of the layout.
+		template<typename F>
+		void for_rectangle(int x0, int y0, int x1, int y1, F& func);
+		template<typename F>
+		void for_rectangle(int x0, int y0, int x1, int y1, F& func) const;
 		int size_x;
 		int size_y;
 	private:
 		int get_index(int x, int y) const;
+		int storage_size() const;
+		template<typename F>
+		void visit_rectangle(int x0, int y0, int x1, int y1, F& func) const;
+		Layout layout;
 		N* data;
 
 		friend class boost::serialization::access;
 		template<class Archive>
 		void save(Archive& ar, const unsigned int version) const
 		{
+			static_assert(Layout::row_major, "use save_rows()");
 			ar << size_x;
 			ar << size_y;
 			ar << boost::serialization::make_array(data, size_x * size_y);
@@ -36,8 +128,10 @@ class buf2d {
 		template<class Archive>
 		void load(Archive& ar, const unsigned int version)
 		{
+			static_assert(Layout::row_major, "use load_rows()");
 			ar >> size_x;
 			ar >> size_y;
+			layout = Layout(size_x, size_y);
 			delete[] data;
 			data = new N[size_x * size_y];
 			ar >> boost::serialization::make_array(data, size_x * size_y);
@@ -45,11 +139,12 @@ class buf2d {
 		BOOST_SERIALIZATION_SPLIT_MEMBER();
 };
 
-template<typename N>
-buf2d<N>::buf2d(int x, int y, const N& def)
+template<typename N, typename Layout>
+buf2d<N, Layout>::buf2d(int x, int y, const N& def)
 	: size_x(x),
 	size_y(y),
-	data(new N[x * y])
+	layout(x, y),
+	data(new N[storage_size()]())
 {
 	for(int i = 0; i < y; i++) {
 		for(int j = 0; j < x; j++) {
@@ -58,73 +153,151 @@ buf2d<N>::buf2d(int x, int y, const N& def)
 	}
 }
 
-template<typename N>
-buf2d<N>::buf2d()
-	: data(NULL)
+template<typename N, typename Layout>
+buf2d<N, Layout>::buf2d()
+	: size_x(0),
+	size_y(0),
+	data(NULL)
 {
 }
 
-template<typename N>
-buf2d<N>::~buf2d()
+template<typename N, typename Layout>
+buf2d<N, Layout>::~buf2d()
 {
 	delete[] this->data;
 }
 
-template<typename N>
-buf2d<N>::buf2d(const buf2d& buf)
+template<typename N, typename Layout>
+buf2d<N, Layout>::buf2d(const buf2d& buf)
 	: size_x(buf.size_x),
 	size_y(buf.size_y),
-	data(new N[buf.size_x * buf.size_y])
+	layout(buf.layout),
+	data(new N[buf.storage_size()])
 {
-	std::copy(buf.data, buf.data + buf.size_x * buf.size_y, data);
+	std::copy(buf.data, buf.data + buf.storage_size(), data);
 }
 
-template<typename N>
-buf2d<N>& buf2d<N>::operator=(const buf2d& buf)
+template<typename N, typename Layout>
+buf2d<N, Layout>& buf2d<N, Layout>::operator=(const buf2d& buf)
 {
 	if(this != &buf) {
-		N* nd = new N[buf.size_x * buf.size_y];
-		std::copy(buf.data, buf.data + buf.size_x * buf.size_y, nd);
+		N* nd = new N[buf.storage_size()];
+		std::copy(buf.data, buf.data + buf.storage_size(), nd);
 		delete[] this->data;
 		this->data = nd;
 		size_x = buf.size_x;
 		size_y = buf.size_y;
+		layout = buf.layout;
 	}
 	return *this;
 }
 
-template<typename N>
-inline int buf2d<N>::get_index(int x, int y) const
+template<typename N, typename Layout>
+inline int buf2d<N, Layout>::get_index(int x, int y) const
 {
-	return y * size_x + x;
+	return layout.index(x, y);
 }
 
-template<typename N>
-void buf2d<N>::set(int x, int y, const N& val)
+template<typename N, typename Layout>
+inline int buf2d<N, Layout>::storage_size() const
+{
+	return Layout::storage_size(size_x, size_y);
+}
+
+template<typename N, typename Layout>
+void buf2d<N, Layout>::set(int x, int y, const N& val)
 {
 	if(!in_bounds(0, x, size_x - 1) || !in_bounds(0, y, size_y - 1))
 		return;
 	data[get_index(x, y)] = val;
 }
 
-template<typename N>
-const N* buf2d<N>::get(int x, int y) const
+template<typename N, typename Layout>
+const N* buf2d<N, Layout>::get(int x, int y) const
 {
 	if(!in_bounds(0, x, size_x - 1) || !in_bounds(0, y, size_y - 1))
 		return NULL;
 	return &data[get_index(x, y)];
 }
 
-template<typename N>
-N* buf2d<N>::get_mod(int x, int y)
+template<typename N, typename Layout>
+N* buf2d<N, Layout>::get_mod(int x, int y)
 {
 	if(!in_bounds(0, x, size_x - 1) || !in_bounds(0, y, size_y - 1))
 		return NULL;
 	return &data[get_index(x, y)];
 }
 
-template<typename N, typename F>
-void mod_rectangle(buf2d<N>& buf, int center_x, int center_y, int radius, 
+template<typename N, typename Layout>
+template<typename F>
+void buf2d<N, Layout>::visit_rectangle(int x0, int y0, int x1, int y1, F& func) const
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, size_x - 1);
+	y1 = std::min(y1, size_y - 1);
+	if(x0 > x1 || y0 > y1)
+		return;
+	layout.for_rectangle(x0, y0, x1, y1, func);
+}
+
+template<typename N, typename Layout>
+template<typename F>
+void buf2d<N, Layout>::for_rectangle(int x0, int y0, int x1, int y1, F& func)
+{
+	N* d = data;
+	auto visit = [d, &func](int x, int y, int i) {
+		func(x, y, d[i]);
+	};
+	visit_rectangle(x0, y0, x1, y1, visit);
+}
+
+template<typename N, typename Layout>
+template<typename F>
+void buf2d<N, Layout>::for_rectangle(int x0, int y0, int x1, int y1, F& func) const
+{
+	const N* d = data;
+	auto visit = [d, &func](int x, int y, int i) {
+		func(x, y, d[i]);
+	};
+	visit_rectangle(x0, y0, x1, y1, visit);
+}
+
+template<class Archive, typename N>
+void save_rows(Archive& ar, const buf2d<N>& buf)
+{
+	ar & buf;
+}
+
+template<class Archive, typename N, typename Layout>
+void save_rows(Archive& ar, const buf2d<N, Layout>& buf)
+{
+	buf2d<N> rows(buf.size_x, buf.size_y, N());
+	for(int y = 0; y < buf.size_y; y++)
+		for(int x = 0; x < buf.size_x; x++)
+			rows.set(x, y, *buf.get(x, y));
+	ar & rows;
+}
+
+template<class Archive, typename N>
+void load_rows(Archive& ar, buf2d<N>& buf)
+{
+	ar & buf;
+}
+
+template<class Archive, typename N, typename Layout>
+void load_rows(Archive& ar, buf2d<N, Layout>& buf)
+{
+	buf2d<N> rows;
+	ar & rows;
+	buf = buf2d<N, Layout>(rows.size_x, rows.size_y, N());
+	for(int y = 0; y < rows.size_y; y++)
+		for(int x = 0; x < rows.size_x; x++)
+			buf.set(x, y, *rows.get(x, y));
+}
+
+template<typename N, typename Layout, typename F>
+void mod_rectangle(buf2d<N, Layout>& buf, int center_x, int center_y, int radius,
 		bool wrap_x, bool wrap_y, F& funcobj)
 {
 	for(int i = center_x - radius; i <= center_x + radius; i++) {
@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <stdio.h>
 #include "city.h"
+#include "object-pool.h"
+#include "ruleset.h"
 
 city::city(std::string name, int x, int y, unsigned int civid,
 		unsigned int cityid)
@@ -28,6 +30,16 @@ city::city()
 {
 }
 
+void* city::operator new(size_t sz)
+{
+	return object_pool<city>::allocate(sz);
+}
+
+void city::operator delete(void* p, size_t sz)
+{
+	object_pool<city>::deallocate(p, sz);
+}
+
 bool city::producing_something() const
 {
 	return production.current_production_id != -1;
@@ -51,33 +63,16 @@ void city::set_production(const city_production& c)
 	production.current_production_id = c.current_production_id;
 }
 
-bool city::has_barracks(const city_improv_map& cimap) const
+bool city::has_barracks(const ruleset& rules) const
 {
-	for(std::set<unsigned int>::const_iterator it = built_improvements.begin();
-			it != built_improvements.end();
-			++it) {
-		city_improv_map::const_iterator cit = cimap.find(*it);
-		if(cit != cimap.end()) {
-			if(cit->second.barracks)
-				return true;
-		}
-	}
-	return false;
+	return built_improvements.intersects(rules.get_barracks());
 }
 
-bool city::has_granary(const city_improv_map& cimap) const
+bool city::has_granary(const ruleset& rules) const
 {
-	for(std::set<unsigned int>::const_iterator it = built_improvements.begin();
-			it != built_improvements.end();
-			++it) {
-		city_improv_map::const_iterator cit = cimap.find(*it);
-		if(cit != cimap.end()) {
-			if(cit->second.granary)
-				return true;
-		}
-	}
-	return false;
+	return built_improvements.intersects(rules.get_granaries());
 }
+
 void city::decrement_city_size()
 {
 	if(city_size > 0) {
@@ -10,6 +10,9 @@
 #include "city_improvement.h"
 #include "resource.h"
 #include "coord.h"
+#include "id-set.h"
+
+class ruleset;
 
 struct city_production {
 	city_production(bool u = true, int i = -1) 
@@ -32,12 +35,15 @@ class city {
 				unsigned int civid, 
 				unsigned int cityid);
 		city(); // for serialization
+		// from a pool of cities
+		static void* operator new(size_t sz);
+		static void operator delete(void* p, size_t sz);
 		bool producing_something() const;
 		void set_unit_production(int uid);
 		void set_improv_production(int uid);
 		void set_production(const city_production& c);
-		bool has_barracks(const city_improv_map& cimap) const;
-		bool has_granary(const city_improv_map& cimap) const;
+		bool has_barracks(const ruleset& rules) const;
+		bool has_granary(const ruleset& rules) const;
 		void decrement_city_size();
 		void increment_city_size();
 		int get_city_size() const;
@@ -58,7 +64,7 @@ class city {
 		int stored_food;
 		int stored_prod;
 		city_production production;
-		std::set<unsigned int> built_improvements;
+		id_set built_improvements;
 		int accum_culture;
 		int culture_level;
 	private:
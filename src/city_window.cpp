@@ -24,7 +24,7 @@ city_window::city_window(SDL_Surface* screen_, gui_data& data_, gui_resources& r
 	int unit_x = unit_box.x;
 	int unit_y = unit_box.y;
 	rect unit_coord = rect(unit_x, unit_y, res.terrains.tile_w, res.terrains.tile_h);
-	for(std::map<unsigned int, unit*>::const_iterator uit = data.r.civs[c->civ_id]->units.begin();
+	for(slot_map<unit*>::const_iterator uit = data.r.civs[c->civ_id]->units.begin();
 			uit != data.r.civs[c->civ_id]->units.end();
 			++uit) {
 		unit* u = uit->second;
@@ -165,9 +165,8 @@ int city_window::draw_city_resources_screen(int xpos, int ypos)
 		int tile_xcoord = data.m.wrap_x(c->xpos + it->x);
 		int tile_ycoord = data.m.wrap_y(c->ypos + it->y);
 		int food, prod, comm;
-		data.m.get_resources_on_spot(tile_xcoord, tile_ycoord,
-				&food, &prod, &comm, &myciv->researched_advances,
-				myciv->gov->production_cap);
+		myciv->get_resources_on_spot(tile_xcoord, tile_ycoord,
+				&food, &prod, &comm);
 		for(int i = 0; i < food; i++)
 			draw_image(tile_x + i * res.terrains.tile_w / (food * 2),
 				   tile_y, res.food_icon, screen);
@@ -266,7 +265,7 @@ int city_window::draw_window()
 
 	// built city improvements
 	int improv_y = screen->w * 0.05 + 10;
-	for(std::set<unsigned int>::const_iterator it = c->built_improvements.begin();
+	for(id_set::const_iterator it = c->built_improvements.begin();
 			it != c->built_improvements.end();
 			++it) {
 		city_improv_map::const_iterator ciit = data.r.cimap.find(*it);
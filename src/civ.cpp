@@ -3,10 +3,20 @@
 #include <math.h>
 #include <stdio.h>
 #include "civ.h"
-#include "map-astar.h"
 
 #define SCIENCE_DISCOVERY_DURATION_COEFFICIENT 4
 
+map_knowledge::map_knowledge(const map* m)
+	: fog(m),
+	known_land_map(m ? m->size_x() : 0, m ? m->size_y() : 0, -1)
+{
+}
+
+map_knowledge::map_knowledge()
+	: known_land_map(0, 0, -1)
+{
+}
+
 civilization::civilization(std::string name, unsigned int civid, 
 		const color& c_, map* m_,
 		const std::vector<std::string>::iterator& names_start,
@@ -17,7 +27,6 @@ civilization::civilization(std::string name, unsigned int civid,
 	civ_id(civid),
 	col(c_),
 	m(m_),
-	fog(fog_of_war(m_)),
 	gold(0),
 	science(0),
 	alloc_gold(5),
@@ -25,15 +34,15 @@ civilization::civilization(std::string name, unsigned int civid,
 	research_goal_id(0),
 	gov(gov_),
 	relationships(civid + 1, relationship_unknown),
-	known_land_map(buf2d<int>(0, 0, -1)),
+	knowledge(new map_knowledge(m_)),
 	curr_city_name_index(0),
-	next_city_id(1),
-	next_unit_id(1),
 	points(0),
 	cross_oceans(false),
 	anarchy_period(0),
 	minor_civ(minor_civ_),
-	cimap(cimap_)
+	cimap(cimap_),
+	deferring_map_changes(false),
+	relationship_changes(0)
 {
 	for(std::vector<std::string>::const_iterator it = names_start;
 			it != names_end;
@@ -41,86 +50,121 @@ civilization::civilization(std::string name, unsigned int civid,
 		city_names.push_back(*it);
 	}
 	relationships[civid] = relationship_peace;
-	if(m) {
-		fog = fog_of_war(m);
-		known_land_map = buf2d<int>(m->size_x(),
-				m->size_y(), -1);
-	}
 }
 
 civilization::civilization()
 	: civ_id(1337),
-	m(NULL)
+	m(NULL),
+	deferring_map_changes(false),
+	relationship_changes(0)
 {
 }
 
 civilization::~civilization()
 {
-	for(std::map<unsigned int, unit*>::iterator it = units.begin();
+	for(slot_map<unit*>::iterator it = units.begin();
 			it != units.end();
 			++it) {
 		delete it->second;
 	}
-	for(std::map<unsigned int, city*>::iterator cit = cities.begin();
+	for(slot_map<city*>::iterator cit = cities.begin();
 			cit != cities.end();
 			++cit) {
 		delete cit->second;
 	}
 }
 
-void civilization::reveal_land(int x, int y, int r)
+void civilization::reveal_land(const tile_span& s)
 {
-	for(int i = x - r; i <= x + r; i++) {
-		for(int j = y - r; j <= y + r; j++) {
+	for(int i = s.x0; i <= s.x1; i++) {
+		for(int j = s.y0; j <= s.y1; j++) {
 			int di = m->wrap_x(i);
 			int dj = m->wrap_y(j);
-			known_land_map.set(di, dj, m->get_land_owner(di, dj));
+			knowledge->known_land_map.set(di, dj, m->get_land_owner(di, dj));
 		}
 	}
 }
 
+void civilization::add_sight(int x, int y, int radius)
+{
+	tile_span s = { x - radius, y - radius, x + radius, y + radius };
+	knowledge->fog.reveal(x, y, radius);
+	reveal_land(s);
+}
+
+void civilization::remove_sight(int x, int y, int radius)
+{
+	knowledge->fog.shade(x, y, radius);
+}
+
+void civilization::move_sight(int x, int y, int newx, int newy, int radius)
+{
+	tile_span entered[2];
+	int num = knowledge->fog.move_sight(x, y, newx, newy, radius, entered);
+	for(int i = 0; i < num; i++)
+		reveal_land(entered[i]);
+}
+
+void civilization::explore(int x, int y, int radius)
+{
+	tile_span s = { x - radius, y - radius, x + radius, y + radius };
+	knowledge->fog.explore(x, y, radius);
+	reveal_land(s);
+}
+
 unit* civilization::add_unit(int uid, int x, int y, 
 		const unit_configuration& uconf,
 		unsigned int road_moves)
 {
-	unit* u = new unit(next_unit_id, uid, x, y, civ_id, uconf, road_moves);
-	units.insert(std::make_pair(next_unit_id++, u));
+	unit* u = new unit(units.next_key(), uid, x, y, civ_id, uconf, road_moves);
+	units.insert(u);
 	built_units[uid]++;
-	m->add_unit(u);
-	fog.reveal(x, y, 1);
-	reveal_land(x, y, 1);
+	if(deferring_map_changes) {
+		map_change c = { map_change_add_unit, u, x, y, improv_none };
+		map_changes.push_back(c);
+	}
+	else {
+		m->add_unit(u);
+	}
+	add_sight(x, y, 1);
 	return u;
 }
 
 void civilization::remove_unit(unit* u)
 {
-	std::map<unsigned int, unit*>::iterator uit = units.find(u->unit_id);
+	slot_map<unit*>::iterator uit = units.find(u->unit_id);
 	if(uit != units.end()) {
 		if(u->carried()) {
 			u->unload();
 		}
 		else {
-			fog.shade(u->xpos, u->ypos, 1);
+			remove_sight(u->xpos, u->ypos, 1);
 		}
 		std::list<unit*>::iterator it = u->carried_units.begin();
 		while(it != u->carried_units.end()) {
 			remove_unit(*it);
 			it = u->carried_units.begin();
 		}
-		m->remove_unit(u);
 		lost_units[uit->second->uconf_id]++;
 		units.erase(uit);
-		delete u;
+		if(deferring_map_changes) {
+			map_change c = { map_change_remove_unit, u, u->xpos, u->ypos, improv_none };
+			map_changes.push_back(c);
+		}
+		else {
+			m->remove_unit(u);
+			delete u;
+		}
 	}
 }
 
 void civilization::eliminate()
 {
-	std::map<unsigned int, unit*>::iterator uit;
+	slot_map<unit*>::iterator uit;
 	while((uit = units.begin()) != units.end()) {
 		remove_unit(uit->second);
 	}
-	std::map<unsigned int, city*>::iterator cit;
+	slot_map<city*>::iterator cit;
 	while((cit = cities.begin()) != cities.end()) {
 		remove_city(cit->second, true);
 	}
@@ -137,17 +181,51 @@ bool civilization::eliminated() const
 
 void civilization::refill_moves(const unit_configuration_map& uconfmap)
 {
-	for(std::map<unsigned int, unit*>::iterator uit = units.begin();
+	for(slot_map<unit*>::iterator uit = units.begin();
 		uit != units.end();
 		++uit) {
 		improvement_type i = improv_none;
 		unit* u = uit->second;
 		u->new_round(i);
 		if(i != improv_none) {
-			m->try_improve_terrain(u->xpos,
-					u->ypos, civ_id, i);
+			if(deferring_map_changes) {
+				map_change c = { map_change_improve_terrain, u, u->xpos, u->ypos, i };
+				map_changes.push_back(c);
+			}
+			else {
+				m->try_improve_terrain(u->xpos,
+						u->ypos, civ_id, i);
+			}
+		}
+	}
+}
+
+void civilization::defer_map_changes()
+{
+	deferring_map_changes = true;
+}
+
+void civilization::apply_map_changes()
+{
+	deferring_map_changes = false;
+	for(std::vector<map_change>::const_iterator it = map_changes.begin();
+			it != map_changes.end();
+			++it) {
+		switch(it->type) {
+			case map_change_add_unit:
+				m->add_unit(it->u);
+				break;
+			case map_change_remove_unit:
+				m->remove_unit(it->u);
+				delete it->u;
+				break;
+			case map_change_improve_terrain:
+				m->try_improve_terrain(it->x, it->y,
+						civ_id, it->improv);
+				break;
 		}
 	}
+	map_changes.clear();
 }
 
 void civilization::add_message(const msg& m)
@@ -233,7 +311,7 @@ void civilization::update_military_expenses()
 {
 	military_expenses = 0;
 	int free_units_togo = gov->free_units + cities.size() * gov->city_units;
-	for(std::map<unsigned int, unit*>::const_iterator it = units.begin();
+	for(slot_map<unit*>::const_iterator it = units.begin();
 			it != units.end(); ++it) {
 		if(it->second->uconf->max_strength > 0) {
 			if(free_units_togo > 0)
@@ -248,7 +326,7 @@ void civilization::update_national_income_and_science()
 {
 	national_income = 0;
 	national_science = 0;
-	for(std::map<unsigned int, city*>::iterator cit = cities.begin();
+	for(slot_map<city*>::iterator cit = cities.begin();
 			cit != cities.end();
 			++cit) {
 		int add_gold, add_science;
@@ -267,16 +345,16 @@ void civilization::calculate_total_city_commerce(const city& c,
 	float alloc_science_f = alloc_science / 10.0f;
 	*add_gold = comm * alloc_gold_f;
 	*add_science = comm * alloc_science_f;
-	for(std::set<unsigned int>::const_iterator cit = c.built_improvements.begin();
+	for(id_set::const_iterator cit = c.built_improvements.begin();
 			cit != c.built_improvements.end();
 			++cit) {
-		city_improv_map::const_iterator ciit = cimap->find(*cit);
-		if(ciit != cimap->end()) {
-			if(ciit->second.comm_bonus && alloc_gold) {
-				*add_gold += (comm * alloc_gold_f) * (ciit->second.comm_bonus / 100.0f);
+		const city_improvement* ci = rules->get_city_improvement(*cit);
+		if(ci) {
+			if(ci->comm_bonus && alloc_gold) {
+				*add_gold += (comm * alloc_gold_f) * (ci->comm_bonus / 100.0f);
 			}
-			if(ciit->second.science_bonus && alloc_science) {
-				*add_science += (comm * alloc_science_f) * (ciit->second.science_bonus / 100.0f);
+			if(ci->science_bonus && alloc_science) {
+				*add_science += (comm * alloc_science_f) * (ci->science_bonus / 100.0f);
 			}
 		}
 	}
@@ -302,7 +380,7 @@ void civilization::increment_resources(const unit_configuration_map& uconfmap,
 		return;
 	}
 
-	for(std::map<unsigned int, city*>::iterator cit = cities.begin();
+	for(slot_map<city*>::iterator cit = cities.begin();
 			cit != cities.end();
 			++cit) {
 		int food, prod, comm;
@@ -312,48 +390,48 @@ void civilization::increment_resources(const unit_configuration_map& uconfmap,
 		this_city->stored_prod += prod;
 		if(this_city->production.current_production_id > -1) {
 			if(this_city->production.producing_unit) {
-				unit_configuration_map::const_iterator prod_unit = uconfmap.find(this_city->production.current_production_id);
-				if(prod_unit != uconfmap.end()) {
-					if((int)prod_unit->second.production_cost <= this_city->stored_prod) {
-						if((int)prod_unit->second.population_cost < this_city->get_city_size()) {
-							for(unsigned int i = 0; i < prod_unit->second.population_cost; i++)
+				const unit_configuration* prod_unit = rules->get_unit_configuration(this_city->production.current_production_id);
+				if(prod_unit) {
+					if((int)prod_unit->production_cost <= this_city->stored_prod) {
+						if((int)prod_unit->population_cost < this_city->get_city_size()) {
+							for(unsigned int i = 0; i < prod_unit->population_cost; i++)
 								this_city->decrement_city_size();
 							unit* u = add_unit(this_city->production.current_production_id, 
-									this_city->xpos, this_city->ypos, prod_unit->second,
+									this_city->xpos, this_city->ypos, *prod_unit,
 									road_moves);
-							if(this_city->has_barracks(*cimap))
+							if(this_city->has_barracks(*rules))
 								u->veteran = true;
-							this_city->stored_prod -= prod_unit->second.production_cost;
+							this_city->stored_prod -= prod_unit->production_cost;
 							add_message(new_unit_msg(u, this_city));
 						}
 					}
 				}
 			}
 			else {
-				city_improv_map::const_iterator prod_improv = cimap->find(this_city->production.current_production_id);
-				if(prod_improv != cimap->end()) {
-					if((int)prod_improv->second.cost <= this_city->stored_prod) {
-						if(this_city->built_improvements.find(prod_improv->first) ==
-								this_city->built_improvements.end()) {
-							this_city->built_improvements.insert(prod_improv->first);
-							this_city->stored_prod -= prod_improv->second.cost;
-							if(prod_improv->second.palace) {
+				unsigned int improv_id = this_city->production.current_production_id;
+				const city_improvement* prod_improv = rules->get_city_improvement(improv_id);
+				if(prod_improv) {
+					if((int)prod_improv->cost <= this_city->stored_prod) {
+						if(!this_city->built_improvements.count(improv_id)) {
+							this_city->built_improvements.insert(improv_id);
+							this_city->stored_prod -= prod_improv->cost;
+							if(prod_improv->palace) {
 								destroy_old_palace(this_city);
 							}
 						}
-						add_message(new_improv_msg(this_city, prod_improv->first));
+						add_message(new_improv_msg(this_city, improv_id));
 						this_city->production.current_production_id = -1;
 					}
 				}
 			}
 		}
 
-		for(std::set<unsigned int>::const_iterator ciit = this_city->built_improvements.begin();
+		for(id_set::const_iterator ciit = this_city->built_improvements.begin();
 				ciit != this_city->built_improvements.end();
 				++ciit) {
-			city_improv_map::const_iterator cnit = cimap->find(*ciit);
-			if(cnit != cimap->end())
-				this_city->accum_culture += cnit->second.culture;
+			const city_improvement* ci = rules->get_city_improvement(*ciit);
+			if(ci)
+				this_city->accum_culture += ci->culture;
 		}
 	}
 
@@ -362,7 +440,7 @@ void civilization::increment_resources(const unit_configuration_map& uconfmap,
 	gold += national_income - military_expenses;
 	{
 		while(gold < 0) {
-			std::map<unsigned int, unit*>::iterator uit = units.begin();
+			slot_map<unit*>::iterator uit = units.begin();
 			while(uit != units.end() && uit->second->uconf->max_strength <= 0)
 				uit++;
 			if(uit == units.end())
@@ -373,16 +451,16 @@ void civilization::increment_resources(const unit_configuration_map& uconfmap,
 		}
 	}
 	science += national_science;
-	advance_map::const_iterator adv = amap.find(research_goal_id);
-	if(adv == amap.end()) {
+	const advance* adv = rules->get_advance(research_goal_id);
+	if(!adv) {
 		if(researched_advances.empty()) {
 			add_message(new_advance_discovered(0));
 			update_ocean_crossing(uconfmap, amap, 0);
 		}
 		setup_default_research_goal(amap);
 	}
-	else if(adv->second.cost * SCIENCE_DISCOVERY_DURATION_COEFFICIENT <= science) {
-		science -= adv->second.cost;
+	else if(adv->cost * SCIENCE_DISCOVERY_DURATION_COEFFICIENT <= science) {
+		science -= adv->cost;
 		add_message(new_advance_discovered(research_goal_id));
 		researched_advances.insert(research_goal_id);
 		update_ocean_crossing(uconfmap, amap, research_goal_id);
@@ -392,20 +470,13 @@ void civilization::increment_resources(const unit_configuration_map& uconfmap,
 
 bool civilization::allowed_research_goal(const advance_map::const_iterator& it) const
 {
-	if(researched_advances.find(it->first) == researched_advances.end()) {
-		for(int i = 0; i < max_num_needed_advances; i++) {
-			if(it->second.needed_advances[i] == 0)
-				continue;
-			if(researched_advances.find(it->second.needed_advances[i]) ==
-					researched_advances.end()) {
-				return false;
-			}
-		}
-		return true;
-	}
-	else {
-		return false;
-	}
+	return allowed_research_goal(it->first);
+}
+
+bool civilization::allowed_research_goal(unsigned int adv_id) const
+{
+	return !researched_advances.count(adv_id) &&
+		researched_advances.includes(rules->get_needed_advances(adv_id));
 }
 
 void civilization::setup_default_research_goal(const advance_map& amap)
@@ -414,7 +485,7 @@ void civilization::setup_default_research_goal(const advance_map& amap)
 	for(advance_map::const_iterator it = amap.begin();
 			it != amap.end();
 			++it) {
-		if(allowed_research_goal(it)) {
+		if(allowed_research_goal(it->first)) {
 			research_goal_id = it->first;
 			return;
 		}
@@ -423,13 +494,16 @@ void civilization::setup_default_research_goal(const advance_map& amap)
 
 char civilization::fog_at(int x, int y) const
 {
-	return fog.get_value(m->wrap_x(x), m->wrap_y(y));
+	return knowledge->fog.get_value(m->wrap_x(x), m->wrap_y(y));
 }
 
 city* civilization::add_city(int x, int y)
 {
+	// the minor civs have no names for cities of their own
+	if(city_names.empty())
+		city_names.push_back(civname);
 	city* c = new city(city_names[curr_city_name_index++], x, y, civ_id,
-			next_city_id);
+			cities.next_key());
 	if(curr_city_name_index >= city_names.size()) {
 		for(unsigned int i = 0; i < city_names.size(); i++) {
 			city_names[i] = std::string("New ") + city_names[i];
@@ -451,20 +525,18 @@ void civilization::update_city_resource_workers(city* c)
 
 void civilization::add_city(city* c)
 {
-	fog.reveal(c->xpos, c->ypos, 2);
-	reveal_land(c->xpos, c->ypos, 2);
-	fog.shade(c->xpos, c->ypos, 2);
-	fog.reveal(c->xpos, c->ypos, 1);
-	c->set_city_id(next_city_id);
+	explore(c->xpos, c->ypos, 2);
+	add_sight(c->xpos, c->ypos, 1);
+	c->set_city_id(cities.next_key());
 	c->set_civ_id(civ_id);
-	cities.insert(std::make_pair(next_city_id++, c));
+	cities.insert(c);
 }
 
 void civilization::remove_city(city* c, bool del)
 {
-	std::map<unsigned int, city*>::iterator cit = cities.find(c->city_id);
+	slot_map<city*>::iterator cit = cities.find(c->city_id);
 	if(cit != cities.end()) {
-		fog.shade(c->xpos, c->ypos, 1);
+		remove_sight(c->xpos, c->ypos, 1);
 		cities.erase(cit);
 		if(del) {
 			m->remove_city(c);
@@ -489,11 +561,20 @@ void civilization::set_relationship_to_civ(unsigned int civid, relationship val)
 	if(relationships.size() <= civid) {
 		relationships.resize(civid + 1, relationship_unknown);
 	}
-	if(val != relationships[civid])
+	if(val != relationships[civid]) {
 		add_message(new_relationship(civid, val));
+		relationship_changes++;
+	}
+	if((val == relationship_war) != (relationships[civid] == relationship_war))
+		roads.invalidate_all();
 	relationships[civid] = val;
 }
 
+unsigned int civilization::get_relationship_changes() const
+{
+	return relationship_changes;
+}
+
 bool civilization::discover(unsigned int civid)
 {
 	if(civid != civ_id && get_relationship_to_civ(civid) == relationship_unknown) {
@@ -545,35 +626,33 @@ std::vector<unsigned int> civilization::check_discoveries(int x, int y, int radi
 
 bool civilization::improv_discovered(const city_improvement& uconf) const
 {
-	return researched_advances.find(uconf.needed_advance) != researched_advances.end() || 
+	return researched_advances.count(uconf.needed_advance) || 
 			uconf.needed_advance == 0;
 }
 
 bool civilization::unit_discovered(const unit_configuration& uconf) const
 {
-	return researched_advances.find(uconf.needed_advance) != researched_advances.end() || 
+	return researched_advances.count(uconf.needed_advance) || 
 			uconf.needed_advance == 0;
 }
 
 bool civilization::advance_discovered(unsigned int adv_id) const
 {
 	return adv_id == 0 ||
-		researched_advances.find(adv_id) != researched_advances.end();
+		researched_advances.count(adv_id);
 }
 
 void civilization::set_map(map* m_)
 {
 	if(m_ && !m) {
 		m = m_;
-		fog = fog_of_war(m);
-		known_land_map = buf2d<int>(m->size_x(),
-				m->size_y(), -1);
+		knowledge.reset(new map_knowledge(m));
 	}
 }
 
 bool civilization::move_acceptable_by_land_and_units(int x, int y) const
 {
-	const std::list<unit*>& units = m->units_on_spot(x, y);
+	unit_stack units = m->units_on_spot(x, y);
 	int land_owner = m->get_land_owner(x, y);
 	int unit_owner = -1;
 	if(!units.empty())
@@ -610,15 +689,23 @@ void civilization::move_unit(unit* u, int chx, int chy, bool fought)
 {
 	int newx = m->wrap_x(u->xpos + chx);
 	int newy = m->wrap_y(u->ypos + chy);
-	if(u->carried()) {
-		unload_unit(u);
+	int oldx = u->xpos;
+	int oldy = u->ypos;
+	bool carried = u->carried();
+	if(carried) {
+		// the carrier sees the tile already, so the sight is
+		// added at the new tile only
+		u->unload();
+	}
+	else {
+		m->remove_unit(u);
 	}
-	m->remove_unit(u);
-	fog.shade(u->xpos, u->ypos, 1);
 	u->move_to(newx, newy, 
 			!fought && m->road_between(u->xpos, u->ypos, newx, newy));
-	fog.reveal(u->xpos, u->ypos, 1);
-	reveal_land(u->xpos, u->ypos, 1);
+	if(carried)
+		add_sight(u->xpos, u->ypos, 1);
+	else
+		move_sight(oldx, oldy, u->xpos, u->ypos, 1);
 	m->add_unit(u);
 	for(std::list<unit*>::iterator it = u->carried_units.begin();
 			it != u->carried_units.end();
@@ -629,7 +716,7 @@ void civilization::move_unit(unit* u, int chx, int chy, bool fought)
 }
 int civilization::get_known_land_owner(int x, int y) const
 {
-	const int* v = known_land_map.get(m->wrap_x(x), m->wrap_y(y));
+	const int* v = knowledge->known_land_map.get(m->wrap_x(x), m->wrap_y(y));
 	if(!v)
 		return -1;
 	return *v;
@@ -656,24 +743,26 @@ void civilization::set_city_improvement_map(const city_improv_map* cimap_)
 	cimap = cimap_;
 }
 
+void civilization::set_ruleset(const std::shared_ptr<const ruleset>& r)
+{
+	rules = r;
+}
+
 void civilization::destroy_old_palace(const city* c)
 {
 	// go through all cities
-	for(std::map<unsigned int, city*>::iterator it = cities.begin();
+	for(slot_map<city*>::iterator it = cities.begin();
 			it != cities.end();
 			++it) {
 		if(it->second != c) {
 			// all improvements in the city
-			for(std::set<unsigned int>::iterator cit = it->second->built_improvements.begin();
+			for(id_set::iterator cit = it->second->built_improvements.begin();
 					cit != it->second->built_improvements.end();
 					++cit) {
 				// see if this improvement is the palace
-				city_improv_map::const_iterator ciit = cimap->find(*cit);
-				if(ciit != cimap->end()) {
-					if(ciit->second.palace) {
-						it->second->built_improvements.erase(cit);
-						return;
-					}
+				if(rules->get_palaces().count(*cit)) {
+					it->second->built_improvements.erase(*cit);
+					return;
 				}
 			}
 		}
@@ -688,10 +777,9 @@ bool civilization::can_build_unit(const unit_configuration& uc, const city& c) c
 		return false;
 	for(unsigned int i = 0; i < max_num_unit_needed_resources; i++) {
 		if(uc.needed_resources[i] != 0) {
-			resource_map::const_iterator it = m->rmap.find(uc.needed_resources[i]);
-			if(it != m->rmap.end()) {
-				if(researched_advances.find(it->second.needed_advance) ==
-						researched_advances.end())
+			const resource* r = rules->get_resource(uc.needed_resources[i]);
+			if(r) {
+				if(!researched_advances.count(r->needed_advance))
 					return false;
 				if(!has_access_to_resource(c, uc.needed_resources[i]))
 					return false;
@@ -704,34 +792,16 @@ bool civilization::can_build_unit(const unit_configuration& uc, const city& c) c
 	return true;
 }
 
-class check_resource {
-	public:
-		check_resource(const map& m_, unsigned int civ_id_, unsigned int res_id_)
-			: m(m_), civ_id(civ_id_), res_id(res_id_) { }
-		bool operator()(const coord& c)
-		{
-			return m.get_resource(c.x, c.y) == res_id &&
-				m.get_land_owner(c.x, c.y) == (int)civ_id;
-		}
-	private:
-		const map& m;
-		unsigned int civ_id;
-		unsigned int res_id;
-};
-
 bool civilization::has_access_to_resource(const city& c, unsigned int res_id) const
 {
-	check_resource cr(*m, civ_id, res_id);
-	std::list<coord> path_to_resource = map_along_roads(coord(c.xpos, c.ypos),
-			*this, true, true, cr);
-	return !path_to_resource.empty();
+	return roads.has_access(*this, c, res_id);
 }
 
 bool civilization::can_build_improvement(const city_improvement& ci, const city& c) const
 {
 	if(!improv_discovered(ci))
 		return false;
-	if(c.built_improvements.find(ci.improv_id) != c.built_improvements.end())
+	if(c.built_improvements.count(ci.improv_id))
 		return false;
 	return true;
 }
@@ -746,7 +816,7 @@ void civilization::load_unit(unit* loadee, unit* loader)
 	// NOTE: load_at must be the last call, because it may change the
 	// unit position. The unit must be removed at the map from the
 	// current position.
-	fog.shade(loadee->xpos, loadee->ypos, 1);
+	remove_sight(loadee->xpos, loadee->ypos, 1);
 	m->remove_unit(loadee);
 	loadee->load_at(loader);
 }
@@ -755,8 +825,7 @@ void civilization::unload_unit(unit* unloadee)
 {
 	unloadee->unload();
 	m->add_unit(unloadee);
-	fog.reveal(unloadee->xpos, unloadee->ypos, 1);
-	reveal_land(unloadee->xpos, unloadee->ypos, 1);
+	add_sight(unloadee->xpos, unloadee->ypos, 1);
 }
 
 const std::map<unsigned int, int>& civilization::get_built_units() const
@@ -810,14 +879,36 @@ void civilization::total_resources(const city& c,
 		int* food, int* prod, int* comm) const
 {
 	*food = 0; *prod = 0; *comm = 0;
+	yields.update(*this);
 	const std::list<coord>& resource_coords = c.get_resource_coords();
 	for(std::list<coord>::const_iterator it = resource_coords.begin();
 			it != resource_coords.end();
 			++it) {
 		int f, p, cm;
-		m->get_resources_on_spot(c.xpos + it->x,
-				c.ypos + it->y, &f, &p, &cm,
-				&researched_advances, gov->production_cap);
+		yields.get_yields(*this, c.xpos + it->x,
+				c.ypos + it->y, &f, &p, &cm);
+		*food += f;
+		*prod += p;
+		*comm += cm;
+	}
+}
+
+void civilization::get_resources_on_spot(int x, int y,
+		int* food, int* prod, int* comm) const
+{
+	yields.update(*this);
+	yields.get_yields(*this, x, y, food, prod, comm);
+}
+
+void civilization::get_total_city_resources(int x, int y,
+		int* food, int* prod, int* comm) const
+{
+	*food = 0; *prod = 0; *comm = 0;
+	yields.update(*this);
+	for(int k = 0; k < neighbourhood::num_city_tiles; k++) {
+		int f, p, cm;
+		yields.get_yields(*this, x + neighbourhood::city_offsets[k][0],
+				y + neighbourhood::city_offsets[k][1], &f, &p, &cm);
 		*food += f;
 		*prod += p;
 		*comm += cm;
@@ -833,37 +924,34 @@ coord civilization::next_good_resource_spot(const city* c) const
 	int opt_food = -1;
 	int opt_prod = -1;
 	int opt_comm = -1;
-	for(int i = -2; i <= 2; i++) {
-		for(int j = -2; j <= 2; j++) {
-			if(abs(i) == 2 && abs(j) == 2)
-				continue;
-			if(!i && !j)
-				continue;
-			if(std::find(c->get_resource_coords().begin(),
-					c->get_resource_coords().end(),
-					coord(i, j)) != c->get_resource_coords().end())
-				continue;
-			int terr = m->get_data(c->xpos + i, c->ypos + j);
-			if(terr == -1)
-				continue;
-			if(m->get_land_owner(c->xpos + i, c->ypos + j) != (int)c->civ_id)
-				continue;
-			if(!can_add_resource_worker(coord(c->xpos + i, c->ypos + j)))
-				continue;
-			int tf, tp, tc;
-			m->get_resources_on_spot(c->xpos + i, c->ypos + j, &tf, &tp, &tc,
-					&researched_advances, gov->production_cap);
-			if((tf >= opt_food && opt_food < req_food) || 
-				 (tf >= req_food &&
-				 (tp > opt_prod || 
-				  (tp == opt_prod && 
-				   (tc > opt_comm || tf > opt_food))))) {
-				ret.x = i;
-				ret.y = j;
-				opt_food = tf;
-				opt_prod = tp;
-				opt_comm = tc;
-			}
+	for(int k = 0; k < neighbourhood::num_city_tiles; k++) {
+		int i = neighbourhood::city_offsets[k][0];
+		int j = neighbourhood::city_offsets[k][1];
+		if(!i && !j)
+			continue;
+		if(std::find(c->get_resource_coords().begin(),
+				c->get_resource_coords().end(),
+				coord(i, j)) != c->get_resource_coords().end())
+			continue;
+		int terr = m->get_data(c->xpos + i, c->ypos + j);
+		if(terr == -1)
+			continue;
+		if(m->get_land_owner(c->xpos + i, c->ypos + j) != (int)c->civ_id)
+			continue;
+		if(!can_add_resource_worker(coord(c->xpos + i, c->ypos + j)))
+			continue;
+		int tf, tp, tc;
+		yields.get_yields(*this, c->xpos + i, c->ypos + j, &tf, &tp, &tc);
+		if((tf >= opt_food && opt_food < req_food) || 
+			 (tf >= req_food &&
+			 (tp > opt_prod || 
+			  (tp == opt_prod && 
+			   (tc > opt_comm || tf > opt_food))))) {
+			ret.x = i;
+			ret.y = j;
+			opt_food = tf;
+			opt_prod = tp;
+			opt_comm = tc;
 		}
 	}
 	return ret;
@@ -871,51 +959,27 @@ coord civilization::next_good_resource_spot(const city* c) const
 
 bool civilization::can_add_resource_worker(const coord& c) const
 {
-	return resource_workers_map.find(c) == resource_workers_map.end();
+	if(!workers.is_built()) {
+		std::vector<city*> conflicts;
+		workers.update(*this, conflicts);
+	}
+	return workers.is_free(c.x, c.y);
 }
 
 void civilization::update_resource_worker_map()
 {
-	resource_workers_map.clear();
 	std::vector<city*> updateable_cities;
-	do {
-		updateable_cities.clear();
-		for(std::map<unsigned int, city*>::const_iterator it = cities.begin();
-				it != cities.end();
-				++it) {
-			resource_workers_map.insert(std::make_pair(coord(it->second->xpos,
-							it->second->ypos),
-						it->first));
-		}
-
-		for(std::map<unsigned int, city*>::const_iterator it = cities.begin();
-				it != cities.end();
+	workers.update(*this, updateable_cities);
+	while(!updateable_cities.empty()) {
+		std::vector<city*> cs;
+		cs.swap(updateable_cities);
+		for(std::vector<city*>::iterator it = cs.begin();
+				it != cs.end();
 				++it) {
-			const std::list<coord>& coords = it->second->get_resource_coords();
-			for(std::list<coord>::const_iterator cit = coords.begin();
-					cit != coords.end();
-					++cit) {
-				coord cp = coord(cit->x + it->second->xpos,
-						cit->y + it->second->ypos);
-				std::pair<std::map<coord, unsigned int>::iterator, bool> res =
-					resource_workers_map.insert(std::make_pair(cp, it->first));
-				if(res.second == false && res.first->second != it->first) {
-					printf("Conflict %d <=> %d at (%d, %d)\n",
-							it->first, res.first->second, cp.x, cp.y);
-					updateable_cities.push_back(it->second);
-					break;
-				}
-			}
-		}
-
-		if(!updateable_cities.empty()) {
-			for(std::vector<city*>::iterator it = updateable_cities.begin();
-					it != updateable_cities.end();
-					++it) {
-				update_city_resource_workers(*it);
-			}
+			update_city_resource_workers(*it);
 		}
-	} while (!updateable_cities.empty());
+		workers.update(*this, updateable_cities);
+	}
 }
 
 void civilization::set_anarchy_period(unsigned int num)
@@ -933,6 +997,17 @@ bool civilization::is_minor_civ() const
 	return minor_civ;
 }
 
+void civilization::share_knowledge(const civilization& oth)
+{
+	knowledge = oth.knowledge;
+	roads.invalidate_all();
+}
+
+const fog_of_war& civilization::get_fog() const
+{
+	return knowledge->fog;
+}
+
 bool civilization::set_commerce_allocation(unsigned int a_gold, unsigned int a_science)
 {
 	if(a_gold + a_science > 10)
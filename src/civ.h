@@ -9,6 +9,10 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/map.hpp>
 #include <boost/serialization/set.hpp>
+#include <boost/serialization/shared_ptr.hpp>
+#include <boost/serialization/split_member.hpp>
+
+#include <memory>
 
 #include "coord.h"
 #include "color.h"
@@ -22,6 +26,12 @@
 #include "fog_of_war.h"
 #include "advance.h"
 #include "government.h"
+#include "ruleset.h"
+#include "road-network.h"
+#include "yield-cache.h"
+#include "worker-grid.h"
+#include "slot-map.h"
+#include "id-set.h"
 
 enum relationship {
 	relationship_unknown,
@@ -86,6 +96,30 @@ struct msg {
 	}
 };
 
+// What a civ knows of the map: the tiles known and visible, and the
+// land owners as they were last seen. The minor civs all share one so
+// that each barbarian tribe doesn't carry map sized layers of its own.
+struct map_knowledge {
+	map_knowledge(const map* m);
+	map_knowledge(); // for serialization
+	fog_of_war fog;
+	buf2d<int, map_layout> known_land_map;
+
+	template<class Archive>
+	void save(Archive& ar, const unsigned int version) const
+	{
+		ar & fog;
+		save_rows(ar, known_land_map);
+	}
+	template<class Archive>
+	void load(Archive& ar, const unsigned int version)
+	{
+		ar & fog;
+		load_rows(ar, known_land_map);
+	}
+	BOOST_SERIALIZATION_SPLIT_MEMBER();
+};
+
 class civilization {
 	public:
 		civilization(std::string name, unsigned int civid, const color& c_, map* m_,
@@ -107,6 +141,12 @@ class civilization {
 				const advance_map& amap,
 				unsigned int road_moves,
 				unsigned int food_eaten_per_citizen);
+		// From defer_map_changes() on, the units added and removed and
+		// the terrain improved are kept in order and put on the map by
+		// apply_map_changes(), so that the civs can be processed in
+		// parallel.
+		void defer_map_changes();
+		void apply_map_changes();
 		char fog_at(int x, int y) const;
 		city* add_city(int x, int y);
 		void add_city(city* c);
@@ -114,6 +154,8 @@ class civilization {
 		void add_message(const msg& m);
 		relationship get_relationship_to_civ(unsigned int civid) const;
 		void set_relationship_to_civ(unsigned int civid, relationship val);
+		// grows whenever a relationship changes
+		unsigned int get_relationship_changes() const;
 		bool discover(unsigned int civid);
 		void undiscover(unsigned int civid);
 		void set_war(unsigned int civid);
@@ -129,6 +171,7 @@ class civilization {
 		void set_map(map* m_);
 		void set_government(const government* g);
 		void set_city_improvement_map(const city_improv_map* cimap_);
+		void set_ruleset(const std::shared_ptr<const ruleset>& r);
 		int get_national_income() const;
 		int get_military_expenses() const;
 		int get_national_science() const;
@@ -144,32 +187,47 @@ class civilization {
 		int get_points() const;
 		bool can_cross_oceans() const;
 		bool allowed_research_goal(const advance_map::const_iterator& amap) const;
+		bool allowed_research_goal(unsigned int adv_id) const;
 		void unload_unit(unit* loadee);
 		void total_resources(const city& c, int* food, int* prod, int* comm) const;
+		// the yields of the tile and of a city on (x, y) for this civ
+		void get_resources_on_spot(int x, int y, int* food, int* prod, int* comm) const;
+		void get_total_city_resources(int x, int y, int* food, int* prod, int* comm) const;
 		coord next_good_resource_spot(const city* c) const;
 		bool can_add_resource_worker(const coord& c) const;
 		void update_resource_worker_map();
 		void set_anarchy_period(unsigned int num);
 		bool is_minor_civ() const;
+		// Makes the civ see the map as oth does from now on, for the
+		// minor civs before they have any units.
+		void share_knowledge(const civilization& oth);
+		const fog_of_war& get_fog() const;
 		bool set_commerce_allocation(unsigned int a_gold, unsigned int a_science);
 		void add_gold(int i);
 		std::string civname;
 		unsigned int civ_id;
 		color col;
-		std::map<unsigned int, unit*> units;
-		std::map<unsigned int, city*> cities;
+		// by unit and city ids
+		slot_map<unit*> units;
+		slot_map<city*> cities;
 		map* m;
-		fog_of_war fog;
 		int gold;
 		int science;
 		std::list<msg> messages;
 		int alloc_gold;
 		int alloc_science;
 		unsigned int research_goal_id;
-		std::set<unsigned int> researched_advances;
+		id_set researched_advances;
 		const government* gov;
 	private:
-		void reveal_land(int x, int y, int r);
+		// The fog and the known land owners follow the sights of the
+		// units and cities. A moving sight reveals only the tiles it
+		// enters, and the known land owners are updated for those.
+		void add_sight(int x, int y, int radius);
+		void remove_sight(int x, int y, int radius);
+		void move_sight(int x, int y, int newx, int newy, int radius);
+		void explore(int x, int y, int radius);
+		void reveal_land(const tile_span& s);
 		void update_military_expenses();
 		void setup_default_research_goal(const advance_map& amap);
 		void destroy_old_palace(const city* c);
@@ -179,12 +237,22 @@ class civilization {
 				int* add_gold, int* add_science) const;
 		bool has_access_to_resource(const city& c, unsigned int res_id) const;
 		void update_national_income_and_science();
+		enum map_change_type {
+			map_change_add_unit,
+			map_change_remove_unit,
+			map_change_improve_terrain,
+		};
+		struct map_change {
+			map_change_type type;
+			unit* u;
+			int x;
+			int y;
+			improvement_type improv;
+		};
 		std::vector<relationship> relationships;
-		buf2d<int> known_land_map;
+		std::shared_ptr<map_knowledge> knowledge;
 		std::vector<std::string> city_names;
 		unsigned int curr_city_name_index;
-		unsigned int next_city_id;
-		unsigned int next_unit_id;
 		int national_income;
 		int national_science;
 		int military_expenses;
@@ -192,14 +260,22 @@ class civilization {
 		std::map<unsigned int, int> lost_units;
 		unsigned int points;
 		bool cross_oceans;
-		std::map<coord, unsigned int> resource_workers_map;
 		unsigned int anarchy_period;
 		bool minor_civ;
 		const city_improv_map* cimap;
+		std::shared_ptr<const ruleset> rules; // not serialized
+		mutable road_network roads; // not serialized, rebuilt on demand
+		mutable yield_cache yields; // not serialized, filled on demand
+		mutable worker_grid workers; // not serialized, rebuilt on demand
+		bool deferring_map_changes; // not serialized
+		std::vector<map_change> map_changes; // not serialized
+		unsigned int relationship_changes; // not serialized
 
 		friend class boost::serialization::access;
+		// the knowledge of the map is saved once for all the civs
+		// sharing it
 		template<class Archive>
-		void serialize(Archive& ar, const unsigned int version)
+		void save(Archive& ar, const unsigned int version) const
 		{
 			ar & civname;
 			ar & civ_id;
@@ -207,7 +283,7 @@ class civilization {
 			ar & units;
 			ar & cities;
 			ar & m;
-			ar & fog;
+			ar & knowledge;
 			ar & gold;
 			ar & science;
 			ar & messages;
@@ -217,11 +293,8 @@ class civilization {
 			ar & researched_advances;
 			ar & const_cast<government*&>(gov);
 			ar & relationships;
-			ar & known_land_map;
 			ar & city_names;
 			ar & curr_city_name_index;
-			ar & next_city_id;
-			ar & next_unit_id;
 			ar & national_income;
 			ar & national_science;
 			ar & military_expenses;
@@ -229,12 +302,86 @@ class civilization {
 			ar & lost_units;
 			ar & points;
 			ar & cross_oceans;
-			ar & resource_workers_map;
 			ar & anarchy_period;
 			ar & minor_civ;
 			ar & cimap;
 		}
+		template<class Archive>
+		void load(Archive& ar, const unsigned int version)
+		{
+			ar & civname;
+			ar & civ_id;
+			ar & col;
+			if(version > 1) {
+				ar & units;
+				ar & cities;
+			}
+			else {
+				// the ids were handed out in order; the ids too
+				// large for a key get new ones
+				std::map<unsigned int, unit*> old_units;
+				std::map<unsigned int, city*> old_cities;
+				ar & old_units;
+				ar & old_cities;
+				for(std::map<unsigned int, unit*>::const_iterator it = old_units.begin();
+						it != old_units.end();
+						++it) {
+					if(!units.insert_at(it->first, it->second))
+						const_cast<int&>(it->second->unit_id) = units.insert(it->second);
+				}
+				for(std::map<unsigned int, city*>::const_iterator it = old_cities.begin();
+						it != old_cities.end();
+						++it) {
+					if(!cities.insert_at(it->first, it->second))
+						it->second->set_city_id(cities.insert(it->second));
+				}
+			}
+			ar & m;
+			if(version > 0) {
+				ar & knowledge;
+			}
+			else {
+				knowledge.reset(new map_knowledge());
+				ar & knowledge->fog;
+			}
+			ar & gold;
+			ar & science;
+			ar & messages;
+			ar & alloc_gold;
+			ar & alloc_science;
+			ar & research_goal_id;
+			ar & researched_advances;
+			ar & const_cast<government*&>(gov);
+			ar & relationships;
+			if(version == 0)
+				load_rows(ar, knowledge->known_land_map);
+			ar & city_names;
+			ar & curr_city_name_index;
+			if(version < 2) {
+				unsigned int next_city_id;
+				unsigned int next_unit_id;
+				ar & next_city_id;
+				ar & next_unit_id;
+			}
+			ar & national_income;
+			ar & national_science;
+			ar & military_expenses;
+			ar & built_units;
+			ar & lost_units;
+			ar & points;
+			ar & cross_oceans;
+			if(version < 3) {
+				std::map<coord, unsigned int> resource_workers_map;
+				ar & resource_workers_map;
+			}
+			ar & anarchy_period;
+			ar & minor_civ;
+			ar & cimap;
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER();
 };
 
+BOOST_CLASS_VERSION(civilization, 3)
+
 #endif
 
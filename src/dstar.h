@@ -0,0 +1,418 @@
+#ifndef DSTAR_H
+#define DSTAR_H
+
+#include <list>
+#include <vector>
+#include <utility>
+#include <limits.h>
+
+#include "astar.h"
+
+// D* Lite: searches backwards from the goal and keeps the search state so
+// that when the start moves or the graph changes, finding the path again
+// only repairs the part of the search that is affected.
+//
+// The nodes are kept in a flat array sized to the map, each stamped with
+// the generation of the search it belongs to, so that set_goal() starts
+// over without clearing the array. The open list is a binary heap that
+// knows the place of each node in it, ordered by the key and then by the
+// coordinates. The graph changes aren't looked for but told by the
+// caller with tile_changed() or all_changed().
+//
+// Graph: void operator()(const coord& a, neighbour_buffer& children)
+//        void predecessors(const coord& a, neighbour_buffer& parents)
+//            - may return more tiles than have a as a child
+//        int edge_state(const coord& a)
+//            - changes whenever the edges from or to a may have changed
+//        All the tiles must be on the map.
+// Cost:  int operator()(const coord& a, const coord& b)
+// Heur:  int operator()(const coord& a, const coord& b)
+//            - consistent lower bound of the cost between the two
+template<typename Graph, typename Cost, typename Heur>
+class dstar_t {
+	public:
+		dstar_t(const Graph& g_, const Cost& c_, const Heur& h_,
+				int size_x, int size_y, const coord& goal_);
+		// drops the search and starts a new one to the goal
+		void set_goal(const coord& goal_);
+		// The edges from or to the tile may have changed. Only the
+		// tiles whose edge state did are repaired by the next find().
+		void tile_changed(const coord& a);
+		// checks all the tiles searched so far on the next find()
+		void all_changed();
+		std::list<coord> find(const coord& start);
+		const coord& get_goal() const;
+		unsigned int get_expansions() const;
+	private:
+		typedef std::pair<int, int> key_t;
+		struct node {
+			unsigned int gen; // the rest is valid if equal to the search's
+			int g;
+			int rhs;
+			int state;
+			int heap_pos; // -1 if not open
+			key_t key;
+		};
+		int index(const coord& a) const;
+		coord tile(int i) const;
+		node& get_node(int i);
+		const node* find_node(int i) const;
+		key_t calculate_key(int i, const node& n) const;
+		bool open_less(int i, int j) const;
+		void heap_push(int i);
+		void heap_remove(int i);
+		void heap_set(int pos, int i);
+		void sift_up(int pos);
+		void sift_down(int pos);
+		void update_vertex(int i);
+		void update_changed();
+		void compute_shortest_path();
+		Graph g;
+		Cost c;
+		Heur h;
+		int sx;
+		int sy;
+		coord goal;
+		coord start;
+		int km;
+		unsigned int expansions;
+		unsigned int gen;
+		std::vector<node> nodes;
+		std::vector<int> searched; // tile indices of this generation
+		std::vector<int> changed;  // tile indices to check
+		bool check_all;
+		std::vector<int> open_nodes; // heap of tile indices
+};
+
+template<typename Graph, typename Cost, typename Heur>
+dstar_t<Graph, Cost, Heur>::dstar_t(const Graph& g_, const Cost& c_,
+		const Heur& h_, int size_x, int size_y, const coord& goal_)
+	: g(g_),
+	c(c_),
+	h(h_),
+	sx(size_x),
+	sy(size_y),
+	expansions(0),
+	gen(0)
+{
+	node n;
+	n.gen = 0;
+	nodes.assign(sx * sy, n);
+	set_goal(goal_);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::set_goal(const coord& goal_)
+{
+	gen++;
+	if(gen == 0) {
+		for(unsigned int i = 0; i < nodes.size(); i++)
+			nodes[i].gen = 0;
+		gen = 1;
+	}
+	searched.clear();
+	changed.clear();
+	check_all = false;
+	open_nodes.clear();
+	goal = goal_;
+	start = goal_;
+	km = 0;
+	int i = index(goal);
+	node& n = get_node(i);
+	n.rhs = 0;
+	n.key = calculate_key(i, n);
+	heap_push(i);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::tile_changed(const coord& a)
+{
+	int i = index(a);
+	if(find_node(i))
+		changed.push_back(i);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::all_changed()
+{
+	check_all = true;
+}
+
+template<typename Graph, typename Cost, typename Heur>
+const coord& dstar_t<Graph, Cost, Heur>::get_goal() const
+{
+	return goal;
+}
+
+template<typename Graph, typename Cost, typename Heur>
+unsigned int dstar_t<Graph, Cost, Heur>::get_expansions() const
+{
+	return expansions;
+}
+
+template<typename Graph, typename Cost, typename Heur>
+int dstar_t<Graph, Cost, Heur>::index(const coord& a) const
+{
+	return a.y * sx + a.x;
+}
+
+template<typename Graph, typename Cost, typename Heur>
+coord dstar_t<Graph, Cost, Heur>::tile(int i) const
+{
+	return coord(i % sx, i / sx);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+typename dstar_t<Graph, Cost, Heur>::node& dstar_t<Graph, Cost, Heur>::get_node(int i)
+{
+	node& n = nodes[i];
+	if(n.gen != gen) {
+		n.gen = gen;
+		n.g = INT_MAX;
+		n.rhs = INT_MAX;
+		n.state = g.edge_state(tile(i));
+		n.heap_pos = -1;
+		searched.push_back(i);
+	}
+	return n;
+}
+
+// NULL if not searched yet
+template<typename Graph, typename Cost, typename Heur>
+const typename dstar_t<Graph, Cost, Heur>::node* dstar_t<Graph, Cost, Heur>::find_node(int i) const
+{
+	const node& n = nodes[i];
+	return n.gen == gen ? &n : NULL;
+}
+
+template<typename Graph, typename Cost, typename Heur>
+typename dstar_t<Graph, Cost, Heur>::key_t dstar_t<Graph, Cost, Heur>::calculate_key(int i,
+		const node& n) const
+{
+	int m = std::min(n.g, n.rhs);
+	if(m == INT_MAX)
+		return key_t(INT_MAX, INT_MAX);
+	return key_t(m + h(start, tile(i)) + km, m);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+bool dstar_t<Graph, Cost, Heur>::open_less(int i, int j) const
+{
+	const key_t& ki = nodes[i].key;
+	const key_t& kj = nodes[j].key;
+	if(ki != kj)
+		return ki < kj;
+	return tile(i) < tile(j);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::heap_set(int pos, int i)
+{
+	open_nodes[pos] = i;
+	nodes[i].heap_pos = pos;
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::sift_up(int pos)
+{
+	int i = open_nodes[pos];
+	while(pos > 0) {
+		int parent = (pos - 1) / 2;
+		if(!open_less(i, open_nodes[parent]))
+			break;
+		heap_set(pos, open_nodes[parent]);
+		pos = parent;
+	}
+	heap_set(pos, i);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::sift_down(int pos)
+{
+	int i = open_nodes[pos];
+	int num = open_nodes.size();
+	while(2 * pos + 1 < num) {
+		int child = 2 * pos + 1;
+		if(child + 1 < num && open_less(open_nodes[child + 1], open_nodes[child]))
+			child++;
+		if(!open_less(open_nodes[child], i))
+			break;
+		heap_set(pos, open_nodes[child]);
+		pos = child;
+	}
+	heap_set(pos, i);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::heap_push(int i)
+{
+	open_nodes.push_back(i);
+	sift_up(open_nodes.size() - 1);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::heap_remove(int i)
+{
+	int pos = nodes[i].heap_pos;
+	nodes[i].heap_pos = -1;
+	int last = open_nodes.back();
+	open_nodes.pop_back();
+	if(last == i)
+		return;
+	heap_set(pos, last);
+	if(pos > 0 && open_less(last, open_nodes[(pos - 1) / 2]))
+		sift_up(pos);
+	else
+		sift_down(pos);
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::update_vertex(int i)
+{
+	node& n = get_node(i);
+	coord a = tile(i);
+	if(!(a == goal)) {
+		n.rhs = INT_MAX;
+		neighbour_buffer children;
+		g(a, children);
+		for(const coord* it = children.begin();
+				it != children.end();
+				++it) {
+			const node* cn = find_node(index(*it));
+			if(!cn || cn->g == INT_MAX)
+				continue;
+			int edge_cost = c(a, *it);
+			if(edge_cost < 0)
+				continue;
+			n.rhs = std::min(n.rhs, cn->g + edge_cost);
+		}
+	}
+	if(n.heap_pos != -1)
+		heap_remove(i);
+	if(n.g != n.rhs) {
+		n.key = calculate_key(i, n);
+		heap_push(i);
+	}
+}
+
+// Updates the tiles told of whose edges changed, e.g. because units moved,
+// and the tiles that may have edges to them.
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::update_changed()
+{
+	if(check_all) {
+		changed = searched;
+		check_all = false;
+	}
+	for(std::vector<int>::const_iterator it = changed.begin();
+			it != changed.end();
+			++it) {
+		node& n = nodes[*it];
+		coord a = tile(*it);
+		int state = g.edge_state(a);
+		if(state == n.state)
+			continue;
+		n.state = state;
+		update_vertex(*it);
+		neighbour_buffer parents;
+		g.predecessors(a, parents);
+		for(const coord* pit = parents.begin();
+				pit != parents.end();
+				++pit) {
+			update_vertex(index(*pit));
+		}
+	}
+	changed.clear();
+}
+
+template<typename Graph, typename Cost, typename Heur>
+void dstar_t<Graph, Cost, Heur>::compute_shortest_path()
+{
+	int si = index(start);
+	while(!open_nodes.empty()) {
+		node& s = get_node(si);
+		key_t start_key = calculate_key(si, s);
+		int top = open_nodes.front();
+		node& n = nodes[top];
+		// unlike in plain D* Lite, nodes with keys equal to the start's are
+		// expanded as well so that the g values are right along the whole
+		// path, not just for the first step
+		if(start_key < n.key && s.rhs == s.g)
+			break;
+		key_t new_key = calculate_key(top, n);
+		if(n.key < new_key) {
+			n.key = new_key;
+			sift_down(0);
+			continue;
+		}
+		heap_remove(top);
+		expansions++;
+		coord a = tile(top);
+		neighbour_buffer parents;
+		g.predecessors(a, parents);
+		if(n.g > n.rhs) {
+			n.g = n.rhs;
+		}
+		else {
+			n.g = INT_MAX;
+			update_vertex(top);
+		}
+		for(const coord* it = parents.begin();
+				it != parents.end();
+				++it) {
+			update_vertex(index(*it));
+		}
+	}
+}
+
+// Returns the path from start to goal, both included, or an empty list
+// if there's none.
+template<typename Graph, typename Cost, typename Heur>
+std::list<coord> dstar_t<Graph, Cost, Heur>::find(const coord& start_)
+{
+	km += h(start, start_);
+	start = start_;
+	update_changed();
+	compute_shortest_path();
+
+	std::list<coord> path;
+	coord current = start;
+	if(get_node(index(current)).g == INT_MAX)
+		return path;
+	path.push_back(current);
+	// the costs are positive so following the lowest cost never loops,
+	// but don't trust it for more steps than there are tiles searched
+	unsigned int steps = 0;
+	while(!(current == goal) && steps++ < searched.size()) {
+		neighbour_buffer children;
+		g(current, children);
+		int best = INT_MAX;
+		coord next = current;
+		for(const coord* it = children.begin();
+				it != children.end();
+				++it) {
+			const node* cn = find_node(index(*it));
+			if(!cn || cn->g == INT_MAX)
+				continue;
+			int edge_cost = c(current, *it);
+			if(edge_cost < 0)
+				continue;
+			if(cn->g + edge_cost < best) {
+				best = cn->g + edge_cost;
+				next = *it;
+			}
+		}
+		if(best == INT_MAX) {
+			path.clear();
+			return path;
+		}
+		current = next;
+		path.push_back(current);
+	}
+	if(!(current == goal))
+		path.clear();
+	return path;
+}
+
+#endif
+
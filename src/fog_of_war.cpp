@@ -1,79 +1,286 @@
+#include <algorithm>
+#include <stdlib.h>
+
 #include "fog_of_war.h"
 
 fog_of_war::fog_of_war(const map* m_)
-	: fog(buf2d<int>(m_ ? m_->size_x() : 0, m_ ? m_->size_y() : 0, 0)), m(m_)
+	: m(m_)
 {
+	init(m_ ? m_->size_x() : 0, m_ ? m_->size_y() : 0);
 }
 
 fog_of_war::fog_of_war()
 	: m(NULL)
 {
+	init(0, 0);
 }
 
-void fog_of_war::reveal(int x, int y, int radius)
+void fog_of_war::init(int x, int y)
+{
+	sx = x;
+	sy = y;
+	words_per_row = (x + 63) / 64;
+	known.assign(y * words_per_row, 0);
+	visible.assign(y * words_per_row, 0);
+	refcounts.assign(x * y, 0);
+	big_refcounts.clear();
+	newly_known.clear();
+}
+
+static tile_span square(int x, int y, int radius)
+{
+	tile_span s = { x - radius, y - radius, x + radius, y + radius };
+	return s;
+}
+
+// Calls func(y, x0, len) for each run of tiles of the span on a row,
+// wrapped. A tile is passed as many times as it is in the span, like
+// when the map is narrower than the span.
+template<typename F>
+void fog_of_war::for_each_segment(const tile_span& s, F& func)
 {
-	for(int i = x - radius; i <= x + radius; i++) {
-		for(int j = y - radius; j <= y + radius; j++) {
+	for(int j = s.y0; j <= s.y1; j++) {
+		int dj = m->wrap_y(j);
+		if(dj < 0 || dj >= sy)
+			continue;
+		if(!m->x_wrapped()) {
+			int x0 = std::max(0, s.x0);
+			int x1 = std::min(sx - 1, s.x1);
+			if(x0 <= x1)
+				func(dj, x0, x1 - x0 + 1);
+			continue;
+		}
+		int i = s.x0;
+		int remaining = s.x1 - s.x0 + 1;
+		while(remaining > 0) {
 			int di = m->wrap_x(i);
-			int dj = m->wrap_y(j);
-			up_refcount(di, dj);
-			set_value(di, dj, 2);
+			int len = std::min(remaining, sx - di);
+			func(dj, di, len);
+			i += len;
+			remaining -= len;
 		}
 	}
 }
 
+// bits from first up to first + num - 1
+static uint64_t bit_run(int first, int num)
+{
+	uint64_t bits = num == 64 ? ~uint64_t(0) : (uint64_t(1) << num) - 1;
+	return bits << first;
+}
+
+void fog_of_war::reveal(int x, int y, int radius)
+{
+	auto func = [this](int row, int x0, int len) {
+		reveal_segment(row, x0, len);
+	};
+	for_each_segment(square(x, y, radius), func);
+}
+
 void fog_of_war::shade(int x, int y, int radius)
 {
-	for(int i = x - radius; i <= x + radius; i++) {
-		for(int j = y - radius; j <= y + radius; j++) {
-			int di = m->wrap_x(i);
-			int dj = m->wrap_y(j);
-			down_refcount(di, dj);
-			if(get_refcount(di, dj) == 0)
-				set_value(di, dj, 1);
-		}
+	auto func = [this](int row, int x0, int len) {
+		shade_segment(row, x0, len);
+	};
+	for_each_segment(square(x, y, radius), func);
+}
+
+void fog_of_war::explore(int x, int y, int radius)
+{
+	auto func = [this](int row, int x0, int len) {
+		explore_segment(row, x0, len);
+	};
+	for_each_segment(square(x, y, radius), func);
+}
+
+// The move along a wrapped axis as the shorter way round.
+static int step_across(int d, int size, bool wrapped)
+{
+	if(!wrapped || size <= 0)
+		return d;
+	d = ((d % size) + size) % size;
+	return d > size / 2 ? d - size : d;
+}
+
+int fog_of_war::move_sight(int x, int y, int newx, int newy, int radius,
+		tile_span* entered)
+{
+	int dx = step_across(newx - x, sx, m->x_wrapped());
+	int dy = step_across(newy - y, sy, m->y_wrapped());
+	tile_span from = square(x, y, radius);
+	tile_span to = square(x + dx, y + dy, radius);
+	auto shade_func = [this](int row, int x0, int len) {
+		shade_segment(row, x0, len);
+	};
+	auto reveal_func = [this](int row, int x0, int len) {
+		reveal_segment(row, x0, len);
+	};
+
+	// if the squares reach round the map, a tile may be in both
+	// squares under different coordinates
+	bool overlaid = (m->x_wrapped() && 2 * radius + 1 + abs(dx) > sx) ||
+		(m->y_wrapped() && 2 * radius + 1 + abs(dy) > sy);
+	if(overlaid || abs(dx) > 2 * radius || abs(dy) > 2 * radius) {
+		for_each_segment(from, shade_func);
+		for_each_segment(to, reveal_func);
+		entered[0] = to;
+		return 1;
 	}
+
+	tile_span left[2];
+	int num_left = sight_difference(from, to, left);
+	for(int i = 0; i < num_left; i++)
+		for_each_segment(left[i], shade_func);
+	int num_entered = sight_difference(to, from, entered);
+	for(int i = 0; i < num_entered; i++)
+		for_each_segment(entered[i], reveal_func);
+	return num_entered;
 }
 
-char fog_of_war::get_value(int x, int y) const
+// The tiles of the square a not in the square b of the same size, as
+// the rows above or below b and the columns left or right of it.
+int fog_of_war::sight_difference(const tile_span& a, const tile_span& b,
+		tile_span* diff) const
 {
-	return get_raw(x, y) & 3;
+	int num = 0;
+	if(a.y0 < b.y0) {
+		tile_span s = { a.x0, a.y0, a.x1, b.y0 - 1 };
+		diff[num++] = s;
+	}
+	if(a.y1 > b.y1) {
+		tile_span s = { a.x0, b.y1 + 1, a.x1, a.y1 };
+		diff[num++] = s;
+	}
+	int y0 = std::max(a.y0, b.y0);
+	int y1 = std::min(a.y1, b.y1);
+	if(a.x0 < b.x0) {
+		tile_span s = { a.x0, y0, b.x0 - 1, y1 };
+		diff[num++] = s;
+	}
+	if(a.x1 > b.x1) {
+		tile_span s = { b.x1 + 1, y0, a.x1, y1 };
+		diff[num++] = s;
+	}
+	return num;
 }
 
-int fog_of_war::get_refcount(int x, int y) const
+void fog_of_war::reveal_segment(int y, int x0, int len)
 {
-	return get_raw(x, y) >> 2;
+	int first = y * sx + x0;
+	uint8_t* rc = &refcounts[first];
+	bool saturated = false;
+	for(int k = 0; k < len; k++)
+		saturated |= rc[k] == 255;
+	if(!saturated) {
+		for(int k = 0; k < len; k++)
+			rc[k]++;
+	}
+	else {
+		for(int k = 0; k < len; k++) {
+			if(rc[k] == 255)
+				big_refcounts[first + k]++;
+			else
+				rc[k]++;
+		}
+	}
+
+	int end = x0 + len;
+	for(int a = x0; a < end; ) {
+		int w = a >> 6;
+		int b = std::min(end, (w + 1) << 6);
+		uint64_t mask = bit_run(a & 63, b - a);
+		uint64_t& kn = known[y * words_per_row + w];
+		uint64_t fresh = mask & ~kn;
+		while(fresh) {
+			newly_known.push_back(coord((w << 6) + __builtin_ctzll(fresh), y));
+			fresh &= fresh - 1;
+		}
+		kn |= mask;
+		visible[y * words_per_row + w] |= mask;
+		a = b;
+	}
 }
 
-int fog_of_war::get_raw(int x, int y) const
+void fog_of_war::explore_segment(int y, int x0, int len)
 {
-	const int* i = fog.get(x, y);
-	if(!i)
-		return 0;
-	return *i;
+	int end = x0 + len;
+	for(int a = x0; a < end; ) {
+		int w = a >> 6;
+		int b = std::min(end, (w + 1) << 6);
+		uint64_t& kn = known[y * words_per_row + w];
+		uint64_t fresh = bit_run(a & 63, b - a) & ~kn;
+		kn |= fresh;
+		while(fresh) {
+			newly_known.push_back(coord((w << 6) + __builtin_ctzll(fresh), y));
+			fresh &= fresh - 1;
+		}
+		a = b;
+	}
 }
 
-void fog_of_war::up_refcount(int x, int y)
+// Tiles seen no more are left known, even if they never were seen.
+void fog_of_war::shade_segment(int y, int x0, int len)
 {
-	int i = get_refcount(x, y);
-	int v = get_value(x, y);
-	fog.set(x, y, ((i + 1) << 2) | v);
+	int first = y * sx + x0;
+	uint8_t* rc = &refcounts[first];
+	for(int k = 0; k < len; k++) {
+		if(rc[k] == 255) {
+			std::map<int, int>::iterator it = big_refcounts.find(first + k);
+			if(it != big_refcounts.end()) {
+				if(--it->second == 0)
+					big_refcounts.erase(it);
+				continue;
+			}
+		}
+		if(rc[k])
+			rc[k]--;
+	}
+
+	int end = x0 + len;
+	for(int a = x0; a < end; ) {
+		int w = a >> 6;
+		int b = std::min(end, (w + 1) << 6);
+		uint64_t unseen = 0;
+		for(int k = a; k < b; k++) {
+			if(refcounts[y * sx + k] == 0)
+				unseen |= uint64_t(1) << (k & 63);
+		}
+		visible[y * words_per_row + w] &= ~unseen;
+		known[y * words_per_row + w] |= unseen;
+		a = b;
+	}
 }
 
-void fog_of_war::down_refcount(int x, int y)
+char fog_of_war::get_value(int x, int y) const
 {
-	int i = get_refcount(x, y);
-	if(i == 0)
-		return;
-	int v = get_value(x, y);
-	fog.set(x, y, ((i - 1) << 2) | v);
+	if(x < 0 || y < 0 || x >= sx || y >= sy)
+		return 0;
+	int w = y * words_per_row + (x >> 6);
+	uint64_t bit = uint64_t(1) << (x & 63);
+	if(visible[w] & bit)
+		return 2;
+	return (known[w] & bit) ? 1 : 0;
 }
 
-void fog_of_war::set_value(int x, int y, int val)
+bool fog_of_war::get_newly_known(unsigned int& pos, std::vector<coord>& tiles) const
 {
-	int i = get_raw(x, y);
-	i &= ~3;
-	fog.set(x, y, i | val); 
+	if(pos > newly_known.size()) {
+		pos = newly_known.size();
+		return false;
+	}
+	tiles.insert(tiles.end(), newly_known.begin() + pos, newly_known.end());
+	pos = newly_known.size();
+	return true;
 }
 
+int fog_of_war::get_refcount(int i) const
+{
+	int rc = refcounts[i];
+	if(rc == 255) {
+		std::map<int, int>::const_iterator it = big_refcounts.find(i);
+		if(it != big_refcounts.end())
+			rc += it->second;
+	}
+	return rc;
+}
 
@@ -3,33 +3,110 @@
 
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/split_member.hpp>
+
+#include <vector>
+#include <map>
+#include <stdint.h>
 
 #include "map.h"
 #include "buf2d.h"
 
+// The tiles from (x0, y0) to (x1, y1), ends included, in unwrapped
+// coordinates.
+struct tile_span {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+};
+
+// The known and currently visible tiles of a civ, each in a bitplane of
+// 64 tiles per word so that reveal() and shade() work a row of the
+// square at a time, and the number of times each visible tile is seen in
+// a byte. The few counts from 255 on are kept aside.
 class fog_of_war {
 	public:
 		fog_of_war(const map* m_);
 		fog_of_war(); // for serialization
 		void reveal(int x, int y, int radius);
 		void shade(int x, int y, int radius);
+		// Moves the sight of the radius from around (x, y) to around
+		// (newx, newy), shading only the tiles it leaves and revealing
+		// only the tiles it enters. The tiles entered are stored in
+		// entered, at most two spans, and their number returned.
+		int move_sight(int x, int y, int newx, int newy, int radius,
+				tile_span* entered);
+		// Makes the tiles known without them being seen.
+		void explore(int x, int y, int radius);
+		// 0 = unknown, 1 = known, 2 = visible
 		char get_value(int x, int y) const;
+		// Appends the tiles that became known since pos, each tile at
+		// most once, and moves pos past them. Returns false if pos is
+		// from before the fog was loaded or reset.
+		bool get_newly_known(unsigned int& pos, std::vector<coord>& tiles) const;
 	private:
-		int get_refcount(int x, int y) const;
-		int get_raw(int x, int y) const;
-		void set_value(int x, int y, int val);
-		void up_refcount(int x, int y);
-		void down_refcount(int x, int y);
-		buf2d<int> fog;
+		template<typename F>
+		void for_each_segment(const tile_span& s, F& func);
+		int sight_difference(const tile_span& a, const tile_span& b,
+				tile_span* diff) const;
+		void explore_segment(int y, int x0, int len);
+		void reveal_segment(int y, int x0, int len);
+		void shade_segment(int y, int x0, int len);
+		int get_refcount(int i) const;
+		void init(int x, int y);
+		int sx;
+		int sy;
+		int words_per_row;
+		std::vector<uint64_t> known;
+		std::vector<uint64_t> visible;
+		std::vector<uint8_t> refcounts;
+		std::map<int, int> big_refcounts; // past 255, by tile index
 		const map* m;
+		std::vector<coord> newly_known; // not serialized
 
 		friend class boost::serialization::access;
+		// saved as a refcount shifted left by two ORed with the value
+		// per tile
+		template<class Archive>
+		void save(Archive& ar, const unsigned int version) const
+		{
+			buf2d<int> fog(sx, sy, 0);
+			for(int y = 0; y < sy; y++) {
+				for(int x = 0; x < sx; x++)
+					fog.set(x, y, (get_refcount(y * sx + x) << 2) | get_value(x, y));
+			}
+			ar & fog;
+			ar & const_cast<map*&>(m);
+		}
 		template<class Archive>
-		void serialize(Archive& ar, const unsigned int version)
+		void load(Archive& ar, const unsigned int version)
 		{
+			buf2d<int> fog;
 			ar & fog;
 			ar & const_cast<map*&>(m);
+			init(fog.size_x, fog.size_y);
+			for(int y = 0; y < sy; y++) {
+				for(int x = 0; x < sx; x++) {
+					int v = *fog.get(x, y);
+					int i = y * sx + x;
+					uint64_t bit = uint64_t(1) << (x & 63);
+					if(v & 3)
+						known[y * words_per_row + (x >> 6)] |= bit;
+					if((v & 3) == 2)
+						visible[y * words_per_row + (x >> 6)] |= bit;
+					int refcount = v >> 2;
+					if(refcount >= 255) {
+						refcounts[i] = 255;
+						big_refcounts[i] = refcount - 255;
+					}
+					else {
+						refcounts[i] = refcount;
+					}
+				}
+			}
 		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER();
 };
 
 #endif
@@ -59,7 +59,7 @@ bool game_window::city_info_available(const city& c) const
 	return internal_ai != NULL || c.civ_id == myciv->civ_id;
 }
 
-const std::set<unsigned int>* game_window::discovered_advances() const
+const id_set* game_window::discovered_advances() const
 {
 	return internal_ai != NULL ? NULL : &myciv->researched_advances;
 }
@@ -256,7 +256,7 @@ void game_window::get_next_free_unit()
 	clear_action_buttons();
 	if(myciv->units.empty())
 		return;
-	std::map<unsigned int, unit*>::const_iterator uit = current_unit;
+	slot_map<unit*>::const_iterator uit = current_unit;
 	for(++current_unit;
 			current_unit != myciv->units.end();
 			++current_unit) {
@@ -398,15 +398,15 @@ void game_window::display_tile_info() const
 	if(fog == 1)
 		return;
 	int written_lines = 1;
-	const std::list<unit*>& units = data.m.units_on_spot(sidebar_info_display.x,
+	unit_stack units = data.m.units_on_spot(sidebar_info_display.x,
 			sidebar_info_display.y);
-	for(std::list<unit*>::const_iterator it = units.begin();
+	for(unit_stack::const_iterator it = units.begin();
 			it != units.end(); ++it) {
 		if(write_unit_info(*it, &written_lines))
 			break;
 	}
 	if(!units.empty()) {
-		std::list<unit*>::const_iterator it = units.begin();
+		unit_stack::const_iterator it = units.begin();
 		if(current_unit != myciv->units.end() &&
 				(*it)->civ_id != (int)myciv->civ_id) {
 			unsigned int u1chance, u2chance;
@@ -588,7 +588,7 @@ void game_window::update_action_buttons()
 
 int game_window::unit_wait()
 {
-	std::map<unsigned int, unit*>::const_iterator old_it = current_unit;
+	slot_map<unit*>::const_iterator old_it = current_unit;
 	get_next_free_unit();
 	if(current_unit == myciv->units.end()) {
 		current_unit = old_it;
@@ -826,7 +826,8 @@ action game_window::observer_action(const SDL_Event& ev)
 	return action_none;
 }
 
-void game_window::handle_successful_action(const action& a, city** c)
+void game_window::handle_successful_action(const action& a, city** c,
+		const coord& unit_pos)
 {
 	switch(a.type) {
 		case action_eot:
@@ -846,7 +847,7 @@ void game_window::handle_successful_action(const action& a, city** c)
 				case action_found_city:
 					current_unit = myciv->units.end();
 					if(c)
-						*c = myciv->cities.rbegin()->second;
+						*c = data.m.city_on_spot(unit_pos.x, unit_pos.y);
 					// fall through
 				case action_improvement:
 				case action_skip:
@@ -872,6 +873,11 @@ void game_window::update_view()
 int game_window::try_perform_action(const action& a, city** c)
 {
 	if(a.type != action_none) {
+		// the position of the unit, which the action may destroy
+		coord unit_pos(-1, -1);
+		if(a.type == action_unit_action)
+			unit_pos = coord(a.data.unit_data.u->xpos,
+					a.data.unit_data.u->ypos);
 		// save the iterator - performing an action may destroy
 		// the current unit
 		bool already_begin = current_unit == myciv->units.begin();
@@ -886,7 +892,7 @@ int game_window::try_perform_action(const action& a, city** c)
 			current_unit = myciv->units.begin();
 		}
 		if(success) {
-			handle_successful_action(a, c);
+			handle_successful_action(a, c, unit_pos);
 			path_to_draw.clear();
 			update_action_buttons();
 		}
@@ -987,7 +993,7 @@ int game_window::handle_civ_messages(std::list<msg>* messages)
 						s << "New improvement '" << it->second.improv_name << "' built.";
 						add_gui_msg(s.str());
 					}
-					std::map<unsigned int, city*>::const_iterator c =
+					slot_map<city*>::const_iterator c =
 						myciv->cities.find(m.msg_data.city_prod_data.building_city_id);
 					if(c != myciv->cities.end()) {
 						if(try_center_camera_at(c->second->xpos, c->second->ypos)) {
@@ -1223,7 +1229,7 @@ int game_window::try_choose_with_mouse(city** c)
 
 	// if no city chosen, choose unit
 	if(!*c && !internal_ai) {
-		for(std::map<unsigned int, unit*>::iterator it = myciv->units.begin();
+		for(slot_map<unit*>::iterator it = myciv->units.begin();
 				it != myciv->units.end();
 				++it) {
 			unit* u = it->second;
@@ -1269,7 +1275,7 @@ void game_window::init_turn()
 			current_unit = myciv->units.end();
 			get_next_free_unit();
 			if(current_unit == myciv->units.end()) {
-				std::map<unsigned int, city*>::const_iterator c = myciv->cities.begin();
+				slot_map<city*>::const_iterator c = myciv->cities.begin();
 				if(c != myciv->cities.end())
 					try_center_camera_at(c->second->xpos, c->second->ypos);
 			}
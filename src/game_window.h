@@ -20,7 +20,7 @@ class game_window : public main_window {
 		char fog_on_tile(int x, int y) const;
 		bool city_info_available(const city& c) const;
 		bool can_draw_unit(const unit* u) const;
-		const std::set<unsigned int>* discovered_advances() const;
+		const id_set* discovered_advances() const;
 		void post_draw();
 		void draw_sidebar();
 
@@ -37,7 +37,8 @@ class game_window : public main_window {
 		action input_to_action(const SDL_Event& ev);
 		action observer_action(const SDL_Event& ev);
 		void handle_input_gui_mod(const SDL_Event& ev, city** c);
-		void handle_successful_action(const action& a, city** c);
+		void handle_successful_action(const action& a, city** c,
+				const coord& unit_pos);
 		int handle_mouse_down(const SDL_Event& ev, city** c);
 		void update_view();
 		int check_line_drawing(int x, int y);
@@ -82,7 +83,7 @@ class game_window : public main_window {
 		void add_give_up_confirm_window(bool retire = false);
 
 		rect action_button_dim(int num) const;
-		std::map<unsigned int, unit*>::const_iterator current_unit;
+		slot_map<unit*>::const_iterator current_unit;
 		std::map<unsigned int, std::list<coord> > unit_movement_orders;
 		std::map<unsigned int, orders*> automated_workers;
 		bool blink_unit;
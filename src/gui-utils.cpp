@@ -303,7 +303,7 @@ int draw_terrain_tile(int x, int y, int xpos, int ypos, bool shade,
 		const std::map<unsigned int, SDL_Surface*>& resource_images,
 		bool draw_improvements,
 		bool draw_resources,
-		const std::set<unsigned int>* researched_advances,
+		const id_set* researched_advances,
 		SDL_Surface* screen)
 {
 	SDL_Rect dest;
@@ -360,8 +360,7 @@ int draw_terrain_tile(int x, int y, int xpos, int ypos, bool shade,
 					resource_map::const_iterator it = m.rmap.find(res);
 					if(it != m.rmap.end()) {
 						if(it->second.needed_advance == 0 ||
-						researched_advances->find(it->second.needed_advance) !=
-						researched_advances->end()) {
+						researched_advances->count(it->second.needed_advance)) {
 							draw = true;
 						}
 					}
@@ -306,7 +306,7 @@ int draw_terrain_tile(int x, int y, int xpos, int ypos, bool shade,
 		const std::map<unsigned int, SDL_Surface*>& resource_images,
 		bool draw_improvements,
 		bool draw_resources,
-		const std::set<unsigned int>* researched_advances,
+		const id_set* researched_advances,
 		SDL_Surface* screen);
 SDL_Surface* make_label(const char* text, const TTF_Font* font, int w, int h, const color& bg_col, const color& text_col);
 int check_button_click(const std::list<button*>& buttons,
@@ -0,0 +1,83 @@
+#include <algorithm>
+
+#include "id-set.h"
+
+id_set::id_set()
+	: num_ids(0)
+{
+}
+
+void id_set::insert(unsigned int id)
+{
+	unsigned int w = id >> 6;
+	if(w >= bits.size())
+		bits.resize(w + 1, 0);
+	uint64_t bit = uint64_t(1) << (id & 63);
+	if(!(bits[w] & bit)) {
+		bits[w] |= bit;
+		num_ids++;
+	}
+}
+
+void id_set::erase(unsigned int id)
+{
+	if(count(id)) {
+		bits[id >> 6] &= ~(uint64_t(1) << (id & 63));
+		num_ids--;
+	}
+}
+
+bool id_set::empty() const
+{
+	return num_ids == 0;
+}
+
+unsigned int id_set::size() const
+{
+	return num_ids;
+}
+
+bool id_set::includes(const id_set& oth) const
+{
+	for(unsigned int i = 0; i < oth.bits.size(); i++) {
+		uint64_t mine = i < bits.size() ? bits[i] : 0;
+		if(oth.bits[i] & ~mine)
+			return false;
+	}
+	return true;
+}
+
+bool id_set::intersects(const id_set& oth) const
+{
+	unsigned int n = std::min(bits.size(), oth.bits.size());
+	for(unsigned int i = 0; i < n; i++) {
+		if(bits[i] & oth.bits[i])
+			return true;
+	}
+	return false;
+}
+
+id_set::const_iterator id_set::begin() const
+{
+	return const_iterator(this, next_id(0));
+}
+
+id_set::const_iterator id_set::end() const
+{
+	return const_iterator(this, end_id);
+}
+
+unsigned int id_set::next_id(unsigned int id) const
+{
+	unsigned int w = id >> 6;
+	if(w >= bits.size())
+		return end_id;
+	uint64_t rest = bits[w] & (~uint64_t(0) << (id & 63));
+	while(!rest) {
+		if(++w >= bits.size())
+			return end_id;
+		rest = bits[w];
+	}
+	return (w << 6) + __builtin_ctzll(rest);
+}
+
@@ -0,0 +1,108 @@
+#ifndef ID_SET_H
+#define ID_SET_H
+
+#include <vector>
+#include <set>
+#include <iterator>
+#include <cstddef>
+#include <stdint.h>
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/set.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/level.hpp>
+#include <boost/serialization/tracking.hpp>
+
+// A set of the ids of a ruleset, e.g. the advances or the city
+// improvements, as a bit for each id up to the largest one added. The
+// ids are iterated over in order. Saved as the std::set<unsigned int> it
+// once was, with no class information of its own, so that the saves are
+// the same as before.
+class id_set {
+	public:
+		class const_iterator {
+			public:
+				typedef std::forward_iterator_tag iterator_category;
+				typedef unsigned int value_type;
+				typedef std::ptrdiff_t difference_type;
+				typedef const unsigned int* pointer;
+				typedef unsigned int reference;
+				unsigned int operator*() const { return id; }
+				const_iterator& operator++();
+				const_iterator operator++(int);
+				bool operator==(const const_iterator& oth) const { return id == oth.id; }
+				bool operator!=(const const_iterator& oth) const { return id != oth.id; }
+			private:
+				const_iterator(const id_set* s_, unsigned int id_) : s(s_), id(id_) { }
+				const id_set* s;
+				unsigned int id;
+				friend class id_set;
+		};
+		typedef const_iterator iterator;
+		id_set();
+		void insert(unsigned int id);
+		void erase(unsigned int id);
+		unsigned int count(unsigned int id) const;
+		bool empty() const;
+		unsigned int size() const;
+		// whether all the ids of oth are in the set
+		bool includes(const id_set& oth) const;
+		// whether any id of oth is in the set
+		bool intersects(const id_set& oth) const;
+		const_iterator begin() const;
+		const_iterator end() const;
+	private:
+		// the first id from id on, or end
+		unsigned int next_id(unsigned int id) const;
+		static const unsigned int end_id = (unsigned int)-1;
+		std::vector<uint64_t> bits;
+		unsigned int num_ids;
+
+		friend class boost::serialization::access;
+		template<class Archive>
+		void save(Archive& ar, const unsigned int version) const
+		{
+			const std::set<unsigned int> ids(begin(), end());
+			ar << ids;
+		}
+		template<class Archive>
+		void load(Archive& ar, const unsigned int version)
+		{
+			std::set<unsigned int> ids;
+			ar >> ids;
+			bits.clear();
+			num_ids = 0;
+			for(std::set<unsigned int>::const_iterator it = ids.begin();
+					it != ids.end();
+					++it) {
+				insert(*it);
+			}
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER();
+};
+
+BOOST_CLASS_IMPLEMENTATION(id_set, boost::serialization::object_serializable)
+BOOST_CLASS_TRACKING(id_set, boost::serialization::track_never)
+
+inline unsigned int id_set::count(unsigned int id) const
+{
+	unsigned int w = id >> 6;
+	return w < bits.size() ? (bits[w] >> (id & 63)) & 1 : 0;
+}
+
+inline id_set::const_iterator& id_set::const_iterator::operator++()
+{
+	id = s->next_id(id + 1);
+	return *this;
+}
+
+inline id_set::const_iterator id_set::const_iterator::operator++(int)
+{
+	const_iterator old(*this);
+	++(*this);
+	return old;
+}
+
+#endif
+
@@ -54,6 +54,7 @@
 
 #include "gui-resources.h"
 #include "paths.h"
+#include "rng.h"
 
 static bool signal_received = false;
 
@@ -63,6 +64,10 @@ static bool ai_debug = false;
 static int skip_rounds = 0;
 
 static int given_seed = 0;
+// the seeds of the maps and the games
+static rng seeds;
+static int map_threads = -1; // -1 = don't create maps in parallel
+static int round_threads = -1; // -1 = don't process the civs in parallel
 
 static SDL_Surface* screen = NULL;
 static TTF_Font* font = NULL;
@@ -441,6 +446,8 @@ void play_game(pompelmous& r, std::map<unsigned int, ai*>& ais,
 int run_game(pompelmous& r, unsigned int own_civ_id)
 {
 	std::map<unsigned int, ai*> ais;
+	if(round_threads >= 0)
+		r.set_round_threads(round_threads);
 	if(observer && ai_debug) {
 			set_ai_debug_civ(own_civ_id);
 	}
@@ -799,7 +806,8 @@ int run_with_map(map& m, std::vector<civilization*>& civs, int own_civ_id)
 	get_configuration(ruleset_name, NULL, &uconfmap, &amap, &cimap, NULL, &govmap, NULL);
 
 	pompelmous r(uconfmap, amap, cimap, govmap, &m, road_moves,
-			food_eaten_per_citizen, anarchy_period, num_turns);
+			food_eaten_per_citizen, anarchy_period, num_turns,
+			seeds.next());
 
 	for(unsigned int i = 0; i < civs.size(); i++) {
 		civs[i]->set_map(&m);
@@ -864,12 +872,8 @@ int run_with_map(map& m, std::vector<civilization*>& civs, int own_civ_id)
 		assigned_civ_id++;
 	}
 
+	// the barbarians found no cities, and they all see the map as one
 	std::vector<std::string> barbarian_names;
-	for(int i = 0; i < 20; i++) {
-		std::stringstream s;
-		s << "Barbarian Dwelling " << (i + 1);
-		barbarian_names.push_back(s.str());
-	}
 	std::vector<civilization*> barbarians;
 	{
 		std::vector<coord> barbarian_spots = m.random_starting_places(num_barbarians,
@@ -897,6 +901,8 @@ int run_with_map(map& m, std::vector<civilization*>& civs, int own_civ_id)
 						barbarian_names.end(),
 						&r.cimap,
 						&govmap.begin()->second, true);
+				if(!barbarians.empty())
+					barb->share_knowledge(*barbarians.front());
 				barbarians.push_back(barb);
 				// warrior
 				barb->add_unit(WARRIOR_UNIT_CONFIGURATION_ID, it->x, it->y, 
@@ -937,6 +943,14 @@ int run_with_map(map& m, std::vector<civilization*>& civs, int own_civ_id)
 	return ret;
 }
 
+void create_new_map(map& m)
+{
+	if(map_threads >= 0)
+		m.create_parallel(seeds.next(), map_threads);
+	else
+		m.create(seeds.next());
+}
+
 int enter_game_configuration_window(map* m, std::vector<civilization*>& civs)
 {
 	bool create_map = m == NULL;
@@ -951,7 +965,7 @@ int enter_game_configuration_window(map* m, std::vector<civilization*>& civs)
 		map_x = w.get_map_size() * 20 + 60;
 		map_y = map_x - 20;
 		m = new map(map_x, map_y, resconf, rmap);
-		m->create();
+		create_new_map(*m);
 	}
 	int own_civ_id = 0;
 	for(unsigned int i = 0; i < civs.size(); i++) {
@@ -975,7 +989,7 @@ int run_gamedata(std::vector<civilization*>& civs)
 	resource_map rmap;
 	get_configuration(ruleset_name, NULL, NULL, NULL, NULL, &resconf, NULL, &rmap);
 	map m(map_x, map_y, resconf, rmap);
-	m.create();
+	create_new_map(m);
 	return run_with_map(m, civs, -1);
 }
 
@@ -1009,13 +1023,13 @@ int run_loaded_gamedata(bool want_map, std::vector<civilization*>& civs)
 void setup_seed()
 {
 	if(given_seed) {
-		srand(given_seed);
+		seeds = rng(given_seed);
 		printf("Seed (given): %d\n", given_seed);
 	}
 	else {
 		int seed = time(NULL);
 		printf("Seed: %d\n", seed);
-		srand(seed);
+		seeds = rng(seed);
 	}
 }
 
@@ -1110,6 +1124,8 @@ void usage(const char* pn)
 	fprintf(stderr, "\t-o:               observer mode\n");
 	fprintf(stderr, "\t-x:               disable GUI\n");
 	fprintf(stderr, "\t-s seed:          set random seed\n");
+	fprintf(stderr, "\t-j threads:       create maps in parallel (0 = one thread per core)\n");
+	fprintf(stderr, "\t-J threads:       end rounds in parallel (0 = one thread per core)\n");
 	fprintf(stderr, "\t-r ruleset:       use custom ruleset\n");
 	fprintf(stderr, "\t-f:               run fullscreen [default]\n");
 	fprintf(stderr, "\t-w:               run windowed\n");
@@ -1134,7 +1150,7 @@ int main(int argc, char **argv)
 		}
 	}
 
-	while((c = getopt(argc, argv, "adoxS:s:r:hwfR:")) != -1) {
+	while((c = getopt(argc, argv, "adoxS:s:j:J:r:hwfR:")) != -1) {
 		switch(c) {
 			case 'S':
 				skip_rounds = atoi(optarg);
@@ -1151,6 +1167,12 @@ int main(int argc, char **argv)
 			case 's':
 				given_seed = atoi(optarg);
 				break;
+			case 'j':
+				map_threads = atoi(optarg);
+				break;
+			case 'J':
+				round_threads = atoi(optarg);
+				break;
 			case 'r':
 				ruleset_name = std::string(optarg);
 				break;
@@ -263,8 +263,8 @@ int main_window::draw_complete_tile(int x, int y, int shx, int shy, bool terrain
 		if(test_draw_border(x, y, shx, shy))
 			return 1;
 	}
-	const std::list<unit*>& units = data.m.units_on_spot(x, y);
-	std::list<unit*>::const_iterator it = units.begin();
+	unit_stack units = data.m.units_on_spot(x, y);
+	unit_stack::const_iterator it = units.begin();
 	if(it != units.end()) {
 		if((fog == 2) && unit_predicate(*it)) {
 			if(draw_unit(*it))
@@ -321,7 +321,7 @@ int main_window::draw_main_map()
 	return 0;
 }
 
-const std::set<unsigned int>* main_window::discovered_advances() const
+const id_set* main_window::discovered_advances() const
 {
 	return NULL;
 }
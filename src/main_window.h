@@ -28,7 +28,7 @@ class main_window : public kingdoms_window {
 		virtual char fog_on_tile(int x, int y) const;
 		virtual bool city_info_available(const city& c) const;
 		virtual bool can_draw_unit(const unit* u) const;
-		virtual const std::set<unsigned int>* discovered_advances() const;
+		virtual const id_set* discovered_advances() const;
 		virtual void post_draw();
 		virtual void draw_sidebar();
 		void handle_input_gui_mod(const SDL_Event& ev);
@@ -1,137 +1,232 @@
-#include <boost/bind.hpp>
-#include <boost/lambda/lambda.hpp>
-
 #include "astar.h"
+#include "dstar.h"
 #include "map-astar.h"
+#include "map-graph.h"
 
 #include <stdio.h>
 
-bool terrain_allowed(const map& m, const unit& u, int x, int y)
+template<typename Graph>
+std::list<coord> map_astar_on(const Graph& g, const civilization& civ,
+		const unit& u, const coord& start, const coord& goal,
+		bool coastal)
 {
-	return m.terrain_allowed(u, x, y);
+	return make_astar(g, map_cost_t(*civ.m, u, coastal),
+			manhattan_heur(goal), coord_goal(goal)).find(
+				civ.m->size_x(), civ.m->size_y(), start);
 }
 
-void check_insert(std::set<coord>& s, const civilization& civ,
-		const unit& u, bool ignore_enemy, bool only_roads,
-		int x, int y)
+// shorter searches aren't worth going through the map hierarchy
+static const int hierarchy_min_distance = 2 * map_hierarchy::cluster_size;
+
+// Follows the abstract route one pair of entrances at a time, each
+// search limited to the clusters of the two entrances.
+template<typename Graph>
+std::list<coord> map_refine_route(const Graph& g, const civilization& civ,
+		const unit& u, const std::vector<coord>& route)
 {
-	x = civ.m->wrap_x(x);
-	y = civ.m->wrap_y(y);
-	if(x >= 0 && y >= 0 && x < civ.m->size_x() && y < civ.m->size_y()) {
-		if(terrain_allowed(*civ.m, u, x, y)) {
-			int fogval = civ.fog.get_value(x, y);
-			if(fogval) { // known terrain
-				if((!civ.blocked_by_land(x, y) && 
-					(fogval == 1 || civ.move_acceptable_by_land_and_units(x, y))) || ignore_enemy) { 
-					// terrain visible and no enemy on it
-					if(!only_roads || (civ.m->get_improvements_on(x, y) & improv_road)) {
-						s.insert(coord(x, y));
-					}
-				}
-			}
-		}
+	const map& m = *civ.m;
+	std::list<coord> path;
+	std::vector<char> clusters;
+	std::vector<coord> ends(2);
+	for(unsigned int i = 1; i < route.size(); i++) {
+		ends[0] = route[i - 1];
+		ends[1] = route[i];
+		m.get_hierarchy().mark_clusters(ends, 0, clusters);
+		std::list<coord> segment = make_astar(corridor_graph<Graph>(g,
+					m.get_hierarchy(), clusters),
+				map_cost_t(m, u, false), manhattan_heur(route[i]),
+				coord_goal(route[i])).find(m.size_x(), m.size_y(), route[i - 1]);
+		if(segment.empty())
+			return segment;
+		if(!path.empty())
+			segment.pop_front();
+		path.splice(path.end(), segment);
 	}
+	return path;
 }
 
-std::set<coord> map_graph(const civilization& civ, const unit& u, 
-		boost::function<bool(const coord& a)> filterfunc,
-		bool ignore_enemy, bool only_roads,
-		const coord& a, const coord* coastal_goal)
-{
-	std::set<coord> ret;
-	for(int i = -1; i <= 1; i++) {
-		for(int j = -1; j <= 1; j++) {
-			if(i || j) {
-				int ax = a.x + i;
-				int ay = a.y + j;
-				if(coastal_goal && coastal_goal->x == ax &&
-					coastal_goal->y == ay) {
-					ret.insert(coord(ax, ay));
-				}
-				else {
-					if(filterfunc(a))
-						check_insert(ret, civ, u, ignore_enemy,
-								only_roads,
-								ax, ay);
-				}
-			}
+// Units or unknown terrain may block the entrances, so if the route can't
+// be followed, search around it and finally on the whole map.
+template<typename Graph>
+std::list<coord> map_hierarchical_astar_on(const Graph& g, movement_class mc,
+		const civilization& civ, const unit& u,
+		const coord& start, const coord& goal)
+{
+	const map& m = *civ.m;
+	if(m.manhattan_distance(start.x, start.y, goal.x, goal.y) >= hierarchy_min_distance) {
+		std::vector<coord> route;
+		if(!m.get_hierarchy().find_route(m, mc, start, goal, route))
+			return std::list<coord>();
+		if(!route.empty()) {
+			std::list<coord> path = map_refine_route(g, civ, u, route);
+			if(!path.empty())
+				return path;
+			std::vector<char> corridor;
+			m.get_hierarchy().mark_clusters(route, 1, corridor);
+			path = map_astar_on(corridor_graph<Graph>(g, m.get_hierarchy(),
+						corridor),
+					civ, u, start, goal, false);
+			if(!path.empty())
+				return path;
 		}
 	}
-	return ret;
+	return map_astar_on(g, civ, u, start, goal, false);
 }
 
-std::set<coord> map_graph(const civilization& civ, const unit& u, 
-		bool ignore_enemy, bool only_roads,
-		const coord& a, const coord* coastal_goal)
+// Tells the search of the tiles that may have changed since the last
+// find(): the tiles changed on the map, the newly known ones and the ones
+// next to where units were put on or taken off the map, as the sights of
+// the units reach a tile around them. A new city explores two tiles
+// around it. If a journal has dropped changes, the relationships have
+// changed or the civ knows the map by another fog, all the tiles searched
+// are checked.
+template<typename Graph>
+class map_dstar_t : public map_replanner {
+	public:
+		map_dstar_t(const civilization& civ_, const unit& u,
+				bool ignore_enemy, const coord& goal_, bool coastal)
+			: civ(civ_),
+			goal(goal_),
+			search(Graph(civ_, u, ignore_enemy, coastal ? &goal : NULL),
+					map_cost_t(*civ_.m, u, coastal),
+					step_heur(*civ_.m), civ_.m->size_x(),
+					civ_.m->size_y(), goal_),
+			fog(&civ_.get_fog()),
+			fog_pos(0),
+			tile_pos(0),
+			unit_pos(0),
+			relationship_changes(civ_.get_relationship_changes())
+		{
+			fog->get_newly_known(fog_pos, changes);
+			civ.m->get_tile_changes(tile_pos, changes);
+			civ.m->get_unit_changes(unit_pos, changes);
+			changes.clear();
+		}
+		std::list<coord> find(const coord& start)
+		{
+			check_changes();
+			return search.find(start);
+		}
+		void set_goal(const coord& goal_)
+		{
+			goal = goal_;
+			search.set_goal(goal);
+		}
+		const coord& get_goal() const
+		{
+			return goal;
+		}
+		unsigned int get_expansions() const
+		{
+			return search.get_expansions();
+		}
+	private:
+		void check_changes();
+		void tiles_around(int radius);
+		const civilization& civ;
+		coord goal; // the graph points to it
+		dstar_t<Graph, map_cost_t, step_heur> search;
+		const fog_of_war* fog;
+		unsigned int fog_pos;
+		unsigned int tile_pos;
+		unsigned int unit_pos;
+		unsigned int relationship_changes;
+		std::vector<coord> changes;
+};
+
+template<typename Graph>
+void map_dstar_t<Graph>::check_changes()
 {
-	return map_graph(civ, u, 
-			boost::lambda::constant(true),
-			ignore_enemy, only_roads,
-			a, coastal_goal);
+	bool all = fog != &civ.get_fog() ||
+		relationship_changes != civ.get_relationship_changes();
+	fog = &civ.get_fog();
+	relationship_changes = civ.get_relationship_changes();
+	all |= !fog->get_newly_known(fog_pos, changes);
+	tiles_around(0);
+	all |= !civ.m->get_tile_changes(tile_pos, changes);
+	tiles_around(2);
+	all |= !civ.m->get_unit_changes(unit_pos, changes);
+	tiles_around(1);
+	if(all)
+		search.all_changed();
 }
 
-std::set<coord> map_bird_graph(const coord& a)
+// tells the search of the tiles around the changes and clears them
+template<typename Graph>
+void map_dstar_t<Graph>::tiles_around(int radius)
 {
-	std::set<coord> ret;
-	for(int i = -1; i <= 1; i++) {
-		for(int j = -1; j <= 1; j++) {
-			if(i || j) {
-				ret.insert(coord(a.x + i, a.y + j));
+	const map& m = *civ.m;
+	for(std::vector<coord>::const_iterator it = changes.begin();
+			it != changes.end();
+			++it) {
+		for(int j = -radius; j <= radius; j++) {
+			int y = m.wrap_y(it->y + j);
+			if(y < 0 || y >= m.size_y())
+				continue;
+			for(int i = -radius; i <= radius; i++) {
+				int x = m.wrap_x(it->x + i);
+				if(x >= 0 && x < m.size_x())
+					search.tile_changed(coord(x, y));
 			}
 		}
 	}
-	return ret;
+	changes.clear();
 }
 
-std::set<coord> graph_along_roads(const civilization& civ,
-		bool no_enemy_territory, bool known_territory,
-		const coord& a)
-{
-	std::set<coord> ret;
-	for(int i = -1; i <= 1; i++) {
-		for(int j = -1; j <= 1; j++) {
-			if(i || j) {
-				int x = a.x + i;
-				int y = a.y + j;
-				if(civ.m->get_improvements_on(x, y) & improv_road) {
-					if(known_territory && civ.fog_at(x, y) == 0)
-						continue;
-					if(no_enemy_territory) {
-						int civid = civ.m->get_land_owner(x, y);
-						if(civid != -1 &&
-							civid != (int)civ.civ_id &&
-							civ.get_relationship_to_civ(civid) == relationship_war) {
-							continue;
-						}
-					}
-					ret.insert(coord(x, y));
-				}
-			}
-		}
-	}
-	return ret;
+map_replanner* map_dstar(const civilization& civ,
+		const unit& u, bool ignore_enemy,
+		const coord& goal, bool coastal)
+{
+	if(u.is_land_unit())
+		return new map_dstar_t<land_graph>(civ, u, ignore_enemy, goal, coastal);
+	else if(u.uconf->ocean_unit)
+		return new map_dstar_t<ocean_graph>(civ, u, ignore_enemy, goal, coastal);
+	else
+		return new map_dstar_t<sea_graph>(civ, u, ignore_enemy, goal, coastal);
 }
 
-int map_cost(const map& m, const unit& u, bool coastal, const coord& a, const coord& b)
+static movement_class get_movement_class(const unit& u, bool only_roads)
 {
-	bool road;
-	int cost = m.get_move_cost(u, a.x, a.y, b.x, b.y, &road);
-	if(cost < 0 && coastal)
-		cost = 1;
-	if(!road)
-		return cost * 10;
+	if(u.is_land_unit())
+		return only_roads ? movement_class::road : movement_class::land;
+	else if(u.uconf->ocean_unit)
+		return movement_class::ocean;
 	else
-		return 4; // TODO: make this dependent of road_moves in pompelmous
+		return movement_class::sea;
 }
 
-int map_heur(const coord& b, const coord& a)
+bool map_connected(const map& m, const unit& u,
+		const coord& start, const coord& goal)
 {
-	return abs(b.x - a.x) + abs(b.y - a.y);
+	return m.get_hierarchy().connected(m, get_movement_class(u, false),
+			start, goal);
 }
 
-bool map_goaltest(const coord& b, const coord& a)
+template<bool OnlyRoads, typename Filter>
+std::list<coord> map_astar_dispatch(const civilization& civ,
+		const unit& u, bool ignore_enemy,
+		const coord& start, const coord& goal,
+		bool coastal, const Filter& filter)
 {
-	return b == a;
+	if(!coastal && !civ.m->get_hierarchy().connected(*civ.m,
+				get_movement_class(u, OnlyRoads), start, goal))
+		return std::list<coord>();
+	const coord* coastal_goal = coastal ? &goal : NULL;
+	if(u.is_land_unit()) {
+		return map_astar_on(map_graph_t<land_movement, OnlyRoads, Filter>(civ,
+					u, ignore_enemy, coastal_goal, filter),
+				civ, u, start, goal, coastal);
+	}
+	else if(u.uconf->ocean_unit) {
+		return map_astar_on(map_graph_t<ocean_movement, OnlyRoads, Filter>(civ,
+					u, ignore_enemy, coastal_goal, filter),
+				civ, u, start, goal, coastal);
+	}
+	else {
+		return map_astar_on(map_graph_t<sea_movement, OnlyRoads, Filter>(civ,
+					u, ignore_enemy, coastal_goal, filter),
+				civ, u, start, goal, coastal);
+	}
 }
 
 std::list<coord> map_astar(const civilization& civ,
@@ -139,9 +234,12 @@ std::list<coord> map_astar(const civilization& civ,
 		const coord& start, const coord& goal,
 		bool coastal, bool only_roads)
 {
-	return map_astar(civ, u, ignore_enemy, start, goal,
-			coastal, only_roads, 
-			boost::lambda::constant(true));
+	if(only_roads)
+		return map_astar_dispatch<true>(civ, u, ignore_enemy, start, goal,
+				coastal, no_filter());
+	else
+		return map_astar_dispatch<false>(civ, u, ignore_enemy, start, goal,
+				coastal, no_filter());
 }
 
 std::list<coord> map_astar(const civilization& civ,
@@ -150,52 +248,69 @@ std::list<coord> map_astar(const civilization& civ,
 		bool coastal, bool only_roads,
 		boost::function<bool(const coord& a)> filterfunc)
 {
-	using boost::bind;
-	using boost::lambda::_1;
-	using boost::lambda::_2;
-	using boost::ref;
-	const coord* coastal_goal = coastal ? &goal : NULL;
-	return astar(bind(map_graph, ref(civ), ref(u), filterfunc, ignore_enemy,
-				only_roads, _1, 
-				coastal_goal),
-			bind(map_cost, ref(*civ.m), ref(u), coastal, _1, _2),
-			bind(map_heur, ref(goal), _1),
-			bind(map_goaltest, ref(goal), _1), start);
+	if(only_roads)
+		return map_astar_dispatch<true>(civ, u, ignore_enemy, start, goal,
+				coastal, filterfunc);
+	else
+		return map_astar_dispatch<false>(civ, u, ignore_enemy, start, goal,
+				coastal, filterfunc);
+}
+
+std::list<coord> map_hierarchical_astar(const civilization& civ,
+		const unit& u, bool ignore_enemy,
+		const coord& start, const coord& goal)
+{
+	if(!civ.m->get_hierarchy().connected(*civ.m,
+				get_movement_class(u, false), start, goal))
+		return std::list<coord>();
+	if(u.is_land_unit()) {
+		return map_hierarchical_astar_on(land_graph(civ, u, ignore_enemy, NULL),
+				movement_class::land, civ, u, start, goal);
+	}
+	else if(u.uconf->ocean_unit) {
+		return map_hierarchical_astar_on(ocean_graph(civ, u, ignore_enemy, NULL),
+				movement_class::ocean, civ, u, start, goal);
+	}
+	else {
+		return map_hierarchical_astar_on(sea_graph(civ, u, ignore_enemy, NULL),
+				movement_class::sea, civ, u, start, goal);
+	}
+}
+
+template<typename Graph>
+std::list<coord> map_bfs_on(const Graph& g, const map& m, const coord& start,
+		boost::function<bool(const coord& a)> goaltestfunc)
+{
+	return make_astar(g, unit_cost(), zero_heur(), goaltestfunc).find(
+			m.size_x(), m.size_y(), start);
 }
 
 std::list<coord> map_path_to_nearest(const civilization& civ,
 		const unit& u, bool ignore_enemy,
-		const coord& start, 
+		const coord& start,
 		boost::function<bool(const coord& a)> goaltestfunc)
 {
-	using boost::bind;
-	using boost::lambda::_1;
-	using boost::lambda::_2;
-	using boost::ref;
-	const coord* coastal_goal = NULL;
-	return astar(bind(map_graph, ref(civ), ref(u), ignore_enemy, 
-				false, _1, coastal_goal),
-			boost::lambda::constant(1),
-			boost::lambda::constant(0),
-			goaltestfunc, start);
+	if(u.is_land_unit())
+		return map_bfs_on(land_graph(civ, u, ignore_enemy, NULL),
+				*civ.m, start, goaltestfunc);
+	else if(u.uconf->ocean_unit)
+		return map_bfs_on(ocean_graph(civ, u, ignore_enemy, NULL),
+				*civ.m, start, goaltestfunc);
+	else
+		return map_bfs_on(sea_graph(civ, u, ignore_enemy, NULL),
+				*civ.m, start, goaltestfunc);
 }
 
-std::list<coord> map_birds_path_to_nearest(const coord& start,
+std::list<coord> map_birds_path_to_nearest(const map& m, const coord& start,
 		boost::function<bool(const coord& a)> goaltestfunc)
 {
-	using boost::bind;
-	using boost::lambda::_1;
-	using boost::lambda::_2;
-	using boost::ref;
-	return astar(bind(map_bird_graph, _1),
-			boost::lambda::constant(1),
-			boost::lambda::constant(0),
-			goaltestfunc, start);
+	return map_bfs_on(bird_graph(), m, start, goaltestfunc);
 }
 
-std::list<coord> map_birds_path_to_nearest(const coord& start, const coord& goal)
+std::list<coord> map_birds_path_to_nearest(const map& m, const coord& start,
+		const coord& goal)
 {
-	return map_birds_path_to_nearest(start,
+	return map_birds_path_to_nearest(m, start,
 			[&](const coord& a) -> bool { return a == goal; });
 }
 
@@ -204,17 +319,9 @@ std::list<coord> map_along_roads(const coord& start,
 		bool no_enemy_territory, bool known_territory,
 		boost::function<bool(const coord& a)> goaltestfunc)
 {
-	using boost::bind;
-	using boost::lambda::_1;
-	using boost::lambda::_2;
-	using boost::ref;
-	return astar(bind(graph_along_roads, ref(civ),
-				no_enemy_territory,
-				known_territory,
-				_1),
-			boost::lambda::constant(1),
-			boost::lambda::constant(0),
-			goaltestfunc, start);
+	return map_bfs_on(road_network_graph(civ, no_enemy_territory,
+				known_territory),
+			*civ.m, start, goaltestfunc);
 }
 
 std::list<coord> map_along_roads(const coord& start,
@@ -225,5 +332,3 @@ std::list<coord> map_along_roads(const coord& start,
 	return map_along_roads(start, civ, no_enemy_territory, known_territory,
 			[&](const coord& a) -> bool { return a == goal; });
 }
-
-
@@ -5,6 +5,7 @@
 #include <boost/function.hpp>
 #include "civ.h"
 
+// A cheapest path from start to goal, both included, or empty.
 // "coastal": set to true if the unit is a transporter ship
 // looking to unload the transportees at goal
 std::list<coord> map_astar(const civilization& civ,
@@ -18,15 +19,53 @@ std::list<coord> map_astar(const civilization& civ,
 		bool coastal, bool only_roads,
 		boost::function<bool(const coord& a)> filterfunc);
 
+// Faster than map_astar() over long distances, but the path isn't
+// necessarily a cheapest one: from two clusters of the map hierarchy
+// away on it goes through the cluster entrances, each leg being a
+// cheapest path within two clusters, and may cost a few percent more
+// than the path of map_astar(). Closer goals are searched as by
+// map_astar(). For units heading far, whose paths are replanned on the
+// way anyway.
+std::list<coord> map_hierarchical_astar(const civilization& civ,
+		const unit& u, bool ignore_enemy,
+		const coord& start, const coord& goal);
+
+// Incremental version of map_astar() for a fixed goal: the search is
+// kept between calls to find() and only repaired where the unit has
+// moved or tiles on the way have changed, e.g. units were moved. The
+// changes are followed in the journals of the map and the fog.
+class map_replanner {
+	public:
+		virtual ~map_replanner() { }
+		// path from start to the goal, both included, or empty
+		virtual std::list<coord> find(const coord& start) = 0;
+		// starts over for another goal, reusing the memory
+		virtual void set_goal(const coord& goal) = 0;
+		virtual const coord& get_goal() const = 0;
+		// tiles expanded by all the searches so far
+		virtual unsigned int get_expansions() const = 0;
+};
+
+// to be deleted by the caller
+map_replanner* map_dstar(const civilization& civ,
+		const unit& u, bool ignore_enemy,
+		const coord& goal, bool coastal = false);
+
+// false if the unit certainly can't get from start to goal, e.g. because
+// they're on different continents; constant time
+bool map_connected(const map& m, const unit& u,
+		const coord& start, const coord& goal);
+
 // simple BFS, but respecting whether the terrain is allowed for the unit
 std::list<coord> map_path_to_nearest(const civilization& civ, 
 		const unit& u, bool ignore_enemy, const coord& start, 
 		boost::function<bool(const coord& a)> goaltestfunc);
 
 // BFS, as the crow flies
-std::list<coord> map_birds_path_to_nearest(const coord& start,
+std::list<coord> map_birds_path_to_nearest(const map& m, const coord& start,
 		boost::function<bool(const coord& a)> goaltestfunc);
-std::list<coord> map_birds_path_to_nearest(const coord& start, const coord& goal);
+std::list<coord> map_birds_path_to_nearest(const map& m, const coord& start,
+		const coord& goal);
 
 // BFS
 std::list<coord> map_along_roads(const coord& start,
@@ -0,0 +1,355 @@
+#ifndef MAP_GRAPH_H
+#define MAP_GRAPH_H
+
+#include <stdlib.h>
+
+#include <boost/function.hpp>
+
+#include "civ.h"
+#include "astar.h"
+
+// Terrain policies for map_graph_t. Each one is the unit type branch
+// of map::terrain_allowed().
+struct land_movement {
+	static bool terrain_ok(const resource_configuration& rc, int t)
+	{
+		return !rc.is_water_tile(t);
+	}
+};
+
+struct sea_movement {
+	static bool terrain_ok(const resource_configuration& rc, int t)
+	{
+		return rc.is_sea_tile(t);
+	}
+};
+
+struct ocean_movement {
+	static bool terrain_ok(const resource_configuration& rc, int t)
+	{
+		return rc.is_water_tile(t);
+	}
+};
+
+struct no_filter {
+	bool operator()(const coord& a) const
+	{
+		return true;
+	}
+};
+
+// Tiles a unit of the civ may path through: allowed and known terrain,
+// not blocked by a neighbour at peace and, unless ignore_enemy is set,
+// not occupied by a foreign unit. The coastal goal is always a neighbour
+// so that transporters can path next to it.
+template<typename Movement, bool OnlyRoads, typename Filter = no_filter>
+class map_graph_t {
+	public:
+		map_graph_t(const civilization& civ_, const unit& u_,
+				bool ignore_enemy_, const coord* coastal_goal_,
+				const Filter& filter_ = Filter());
+		void operator()(const coord& a, neighbour_buffer& ret) const;
+		// whether a neighbour may step on the tile, filter aside
+		bool passable(int x, int y) const;
+		// for dstar_t
+		void predecessors(const coord& a, neighbour_buffer& ret) const;
+		int edge_state(const coord& a) const;
+	private:
+		bool terrain_allowed(int x, int y) const;
+		void check_insert(neighbour_buffer& s, int x, int y) const;
+		const civilization& civ;
+		const map& m;
+		const unit& u;
+		bool ignore_enemy;
+		const coord* coastal_goal;
+		Filter filter;
+};
+
+typedef map_graph_t<land_movement, false> land_graph;
+typedef map_graph_t<sea_movement, false> sea_graph;
+typedef map_graph_t<ocean_movement, false> ocean_graph;
+typedef map_graph_t<land_movement, true> road_graph;
+
+template<typename Movement, bool OnlyRoads, typename Filter>
+map_graph_t<Movement, OnlyRoads, Filter>::map_graph_t(const civilization& civ_,
+		const unit& u_, bool ignore_enemy_, const coord* coastal_goal_,
+		const Filter& filter_)
+	: civ(civ_),
+	m(*civ_.m),
+	u(u_),
+	ignore_enemy(ignore_enemy_),
+	coastal_goal(coastal_goal_),
+	filter(filter_)
+{
+}
+
+template<typename Movement, bool OnlyRoads, typename Filter>
+inline bool map_graph_t<Movement, OnlyRoads, Filter>::terrain_allowed(int x, int y) const
+{
+	int t = m.get_data(x, y);
+	if(t == -1)
+		return false;
+	const city* c = m.city_on_spot(x, y);
+	if(c && c->civ_id == (unsigned int)u.civ_id)
+		return true;
+	return Movement::terrain_ok(m.resconf, t);
+}
+
+template<typename Movement, bool OnlyRoads, typename Filter>
+inline bool map_graph_t<Movement, OnlyRoads, Filter>::passable(int x, int y) const
+{
+	if(x >= 0 && y >= 0 && x < m.size_x() && y < m.size_y()) {
+		if(terrain_allowed(x, y)) {
+			int fogval = civ.get_fog().get_value(x, y);
+			if(fogval) { // known terrain
+				if((!civ.blocked_by_land(x, y) &&
+					(fogval == 1 || civ.move_acceptable_by_land_and_units(x, y))) || ignore_enemy) {
+					// terrain visible and no enemy on it
+					if(!OnlyRoads || (m.get_improvements_on(x, y) & improv_road)) {
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+template<typename Movement, bool OnlyRoads, typename Filter>
+inline void map_graph_t<Movement, OnlyRoads, Filter>::check_insert(neighbour_buffer& s,
+		int x, int y) const
+{
+	if(passable(x, y))
+		s.insert(coord(x, y));
+}
+
+template<typename Movement, bool OnlyRoads, typename Filter>
+void map_graph_t<Movement, OnlyRoads, Filter>::operator()(const coord& a,
+		neighbour_buffer& ret) const
+{
+	// The neighbourhood of a tile on the map tells which neighbours are
+	// off the map, and the others are at most one tile over an edge, so
+	// they wrap without a division. A tile off the map (only ever the
+	// start) is wrapped the slow way.
+	int sx = m.size_x();
+	int sy = m.size_y();
+	const int* neighbours = NULL;
+	if(a.x >= 0 && a.y >= 0 && a.x < sx && a.y < sy)
+		neighbours = m.get_neighbourhood().get_neighbours(a.x, a.y);
+	int filter_ok = -1;
+	for(int k = 0; k < neighbourhood::num_neighbours; k++) {
+		int ax = a.x + neighbourhood::neighbour_offsets[k][0];
+		int ay = a.y + neighbourhood::neighbour_offsets[k][1];
+		if(coastal_goal && coastal_goal->x == ax &&
+			coastal_goal->y == ay) {
+			ret.insert(coord(ax, ay));
+			continue;
+		}
+		if(filter_ok == -1)
+			filter_ok = filter(a) ? 1 : 0;
+		if(!filter_ok)
+			continue;
+		if(neighbours) {
+			if(neighbours[k] == neighbourhood::off_map)
+				continue;
+			if(ax < 0)
+				ax += sx;
+			else if(ax >= sx)
+				ax -= sx;
+			if(ay < 0)
+				ay += sy;
+			else if(ay >= sy)
+				ay -= sy;
+		}
+		else {
+			ax = m.wrap_x(ax);
+			ay = m.wrap_y(ay);
+		}
+		check_insert(ret, ax, ay);
+	}
+}
+
+// the tiles around, any of which may have a as a child
+template<typename Movement, bool OnlyRoads, typename Filter>
+void map_graph_t<Movement, OnlyRoads, Filter>::predecessors(const coord& a,
+		neighbour_buffer& ret) const
+{
+	for(int i = -1; i <= 1; i++) {
+		for(int j = -1; j <= 1; j++) {
+			if(i || j) {
+				int x = m.wrap_x(a.x + i);
+				int y = m.wrap_y(a.y + j);
+				if(x >= 0 && y >= 0 && x < m.size_x() && y < m.size_y())
+					ret.insert(coord(x, y));
+			}
+		}
+	}
+}
+
+// everything the edges from and to the tile and their costs depend on
+template<typename Movement, bool OnlyRoads, typename Filter>
+int map_graph_t<Movement, OnlyRoads, Filter>::edge_state(const coord& a) const
+{
+	int x = m.wrap_x(a.x);
+	int y = m.wrap_y(a.y);
+	return (passable(x, y) ? 1 : 0) |
+		((m.get_improvements_on(x, y) & improv_road) ? 2 : 0) |
+		(filter(a) ? 4 : 0);
+}
+
+// as the crow flies; doesn't wrap nor stop at the map borders
+struct bird_graph {
+	void operator()(const coord& a, neighbour_buffer& ret) const
+	{
+		for(int i = -1; i <= 1; i++) {
+			for(int j = -1; j <= 1; j++) {
+				if(i || j) {
+					ret.insert(coord(a.x + i, a.y + j));
+				}
+			}
+		}
+	}
+};
+
+// a graph limited to the clusters marked in a corridor
+template<typename Graph>
+class corridor_graph {
+	public:
+		corridor_graph(const Graph& g_, const map_hierarchy& h_,
+				const std::vector<char>& corridor_)
+			: g(g_), h(h_), corridor(corridor_) { }
+		void operator()(const coord& a, neighbour_buffer& ret) const
+		{
+			neighbour_buffer children;
+			g(a, children);
+			for(const coord* it = children.begin();
+					it != children.end();
+					++it) {
+				if(corridor[h.cluster_of(it->x, it->y)])
+					ret.insert(*it);
+			}
+		}
+	private:
+		Graph g;
+		const map_hierarchy& h;
+		const std::vector<char>& corridor;
+};
+
+// road tiles, optionally only known ones and ones not owned by an enemy
+class road_network_graph {
+	public:
+		road_network_graph(const civilization& civ_,
+				bool no_enemy_territory_, bool known_territory_)
+			: civ(civ_),
+			no_enemy_territory(no_enemy_territory_),
+			known_territory(known_territory_) { }
+		void operator()(const coord& a, neighbour_buffer& ret) const
+		{
+			for(int i = -1; i <= 1; i++) {
+				for(int j = -1; j <= 1; j++) {
+					if(i || j) {
+						int x = a.x + i;
+						int y = a.y + j;
+						if(civ.m->get_improvements_on(x, y) & improv_road) {
+							if(known_territory && civ.fog_at(x, y) == 0)
+								continue;
+							if(no_enemy_territory) {
+								int civid = civ.m->get_land_owner(x, y);
+								if(civid != -1 &&
+									civid != (int)civ.civ_id &&
+									civ.get_relationship_to_civ(civid) == relationship_war) {
+									continue;
+								}
+							}
+							ret.insert(coord(x, y));
+						}
+					}
+				}
+			}
+		}
+	private:
+		const civilization& civ;
+		bool no_enemy_territory;
+		bool known_territory;
+};
+
+// 10 per step, 4 along a road
+class map_cost_t {
+	public:
+		map_cost_t(const map& m_, const unit& u_, bool coastal_)
+			: m(m_), u(u_), coastal(coastal_) { }
+		int operator()(const coord& a, const coord& b) const
+		{
+			bool road;
+			int cost = m.get_move_cost(u, a.x, a.y, b.x, b.y, &road);
+			if(cost < 0 && coastal)
+				cost = 1;
+			if(!road)
+				return cost * 10;
+			else
+				return 4; // TODO: make this dependent of road_moves in pompelmous
+		}
+	private:
+		const map& m;
+		const unit& u;
+		bool coastal;
+};
+
+class manhattan_heur {
+	public:
+		manhattan_heur(const coord& goal_) : goal(goal_) { }
+		int operator()(const coord& a) const
+		{
+			return abs(goal.x - a.x) + abs(goal.y - a.y);
+		}
+	private:
+		coord goal;
+};
+
+// map_cost_t is at least 4 per step, also along diagonals. Consistent,
+// unlike map::manhattan_distance() which only wraps near the borders.
+class step_heur {
+	public:
+		step_heur(const map& m_) : m(m_) { }
+		int operator()(const coord& a, const coord& b) const
+		{
+			return 4 * std::max(distance(a.x, b.x, m.size_x(), m.x_wrapped()),
+					distance(a.y, b.y, m.size_y(), m.y_wrapped()));
+		}
+	private:
+		static int distance(int p, int q, int size, bool wrapped)
+		{
+			int d = abs(p - q);
+			if(wrapped)
+				d = std::min(d % size, size - d % size);
+			return d;
+		}
+		const map& m;
+};
+
+class coord_goal {
+	public:
+		coord_goal(const coord& goal_) : goal(goal_) { }
+		bool operator()(const coord& a) const
+		{
+			return a == goal;
+		}
+	private:
+		coord goal;
+};
+
+struct unit_cost {
+	int operator()(const coord& a, const coord& b) const
+	{
+		return 1;
+	}
+};
+
+struct zero_heur {
+	int operator()(const coord& a) const
+	{
+		return 0;
+	}
+};
+
+#endif
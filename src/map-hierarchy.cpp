@@ -0,0 +1,566 @@
+#include <queue>
+#include <map>
+#include <algorithm>
+#include <limits.h>
+#include <stdlib.h>
+
+#include "map-hierarchy.h"
+#include "map.h"
+#include "astar.h"
+
+namespace {
+
+// any city counts as passable as the abstract graph is shared by all civs
+bool tile_passable(const map& m, movement_class mc, int x, int y)
+{
+	int t = m.get_data(x, y);
+	if(t == -1)
+		return false;
+	bool city = m.city_on_spot(x, y) != NULL;
+	switch(mc) {
+		case movement_class::land:
+			return city || !m.resconf.is_water_tile(t);
+		case movement_class::sea:
+			return city || m.resconf.is_sea_tile(t);
+		case movement_class::ocean:
+			return city || m.resconf.is_water_tile(t);
+		case movement_class::road:
+			return (city || !m.resconf.is_water_tile(t)) &&
+				(m.get_improvements_on(x, y) & improv_road);
+		default:
+			return false;
+	}
+}
+
+// as in map_cost_t
+int step_cost(const map& m, int x1, int y1, int x2, int y2)
+{
+	return m.road_between(x1, y1, x2, y2) ? 4 : 10;
+}
+
+}
+
+map_hierarchy::map_hierarchy()
+	: sx(0),
+	sy(0),
+	cx(0),
+	cy(0),
+	xw(false),
+	yw(false)
+{
+	invalidate_all();
+}
+
+void map_hierarchy::invalidate_all()
+{
+	for(int i = 0; i < (int)movement_class::max_movement_class; i++) {
+		levels[i].built = false;
+		levels[i].stale = true;
+		levels[i].costs_stale = true;
+		levels[i].passable.clear();
+		levels[i].region.clear();
+		levels[i].node_index.clear();
+		levels[i].clusters.clear();
+		levels[i].components.clear();
+	}
+}
+
+void map_hierarchy::invalidate_tile(int x, int y)
+{
+	mark_around(x, y, 0);
+}
+
+void map_hierarchy::invalidate_road(int x, int y)
+{
+	mark_around(x, y, (int)movement_class::road);
+}
+
+// Marks the cluster of the tile and its neighbours, as their entrances
+// depend on it. Levels from first_structural on need new entrances, the
+// ones before only new costs.
+void map_hierarchy::mark_around(int x, int y, int first_structural)
+{
+	if(x < 0 || y < 0 || x >= sx || y >= sy)
+		return;
+	int gx = x / cluster_size;
+	int gy = y / cluster_size;
+	for(int i = -1; i <= 1; i++) {
+		for(int j = -1; j <= 1; j++) {
+			int nx = gx + i;
+			int ny = gy + j;
+			if(xw)
+				nx = (nx + cx) % cx;
+			if(yw)
+				ny = (ny + cy) % cy;
+			if(nx < 0 || ny < 0 || nx >= cx || ny >= cy)
+				continue;
+			for(int k = 0; k < (int)movement_class::max_movement_class; k++) {
+				if(!levels[k].built)
+					continue;
+				if(k >= first_structural) {
+					levels[k].clusters[ny * cx + nx].dirty = true;
+					levels[k].stale = true;
+				}
+				levels[k].clusters[ny * cx + nx].costs_dirty = true;
+				levels[k].costs_stale = true;
+			}
+		}
+	}
+}
+
+int map_hierarchy::cluster_of(int x, int y) const
+{
+	return (y / cluster_size) * cx + x / cluster_size;
+}
+
+int map_hierarchy::local_index(int x, int y) const
+{
+	return (y % cluster_size) * cluster_size + x % cluster_size;
+}
+
+bool map_hierarchy::neighbour(const map& m, int x, int y, int i, int j,
+		int* nx, int* ny) const
+{
+	*nx = m.wrap_x(x + i);
+	*ny = m.wrap_y(y + j);
+	return *nx >= 0 && *ny >= 0 && *nx < sx && *ny < sy;
+}
+
+int map_hierarchy::heuristic(const map& m, const coord& a, const coord& b) const
+{
+	int dx = abs(a.x - b.x);
+	int dy = abs(a.y - b.y);
+	if(xw)
+		dx = std::min(dx, sx - dx);
+	if(yw)
+		dy = std::min(dy, sy - dy);
+	return 4 * std::max(dx, dy);
+}
+
+void map_hierarchy::check_size(const map& m)
+{
+	if(m.size_x() == sx && m.size_y() == sy &&
+			m.x_wrapped() == xw && m.y_wrapped() == yw)
+		return;
+	sx = m.size_x();
+	sy = m.size_y();
+	cx = (sx + cluster_size - 1) / cluster_size;
+	cy = (sy + cluster_size - 1) / cluster_size;
+	xw = m.x_wrapped();
+	yw = m.y_wrapped();
+	invalidate_all();
+}
+
+void map_hierarchy::update_level(const map& m, movement_class mc)
+{
+	level& l = levels[(int)mc];
+	if(l.built && !l.stale)
+		return;
+	if(!l.built) {
+		l.passable.assign(sx * sy, 0);
+		l.region.assign(sx * sy, -1);
+		l.node_index.assign(sx * sy, -1);
+		l.clusters.assign(cx * cy, cluster());
+		for(int i = 0; i < cx * cy; i++) {
+			l.clusters[i].dirty = true;
+			l.clusters[i].costs_dirty = true;
+		}
+		l.built = true;
+	}
+	std::vector<int> dirty;
+	for(int i = 0; i < cx * cy; i++) {
+		if(l.clusters[i].dirty)
+			dirty.push_back(i);
+	}
+	// entrances depend on the regions on both sides of the border
+	for(unsigned int i = 0; i < dirty.size(); i++)
+		label_cluster(m, mc, dirty[i]);
+	for(unsigned int i = 0; i < dirty.size(); i++)
+		connect_cluster(m, l, dirty[i]);
+	join_components(l);
+	l.stale = false;
+}
+
+void map_hierarchy::update_costs(const map& m, movement_class mc)
+{
+	update_level(m, mc);
+	level& l = levels[(int)mc];
+	if(!l.costs_stale)
+		return;
+	for(int i = 0; i < cx * cy; i++) {
+		if(l.clusters[i].costs_dirty)
+			cost_cluster(m, l, i);
+	}
+	l.costs_stale = false;
+}
+
+namespace {
+
+int find_root(std::vector<int>& parents, int i)
+{
+	while(parents[i] != i) {
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+}
+
+// union of the regions over the entrances between clusters
+void map_hierarchy::join_components(level& l)
+{
+	int num = 0;
+	for(int i = 0; i < cx * cy; i++) {
+		l.clusters[i].first_region = num;
+		num += l.clusters[i].num_regions;
+	}
+	l.components.resize(num);
+	for(int i = 0; i < num; i++)
+		l.components[i] = i;
+	for(int i = 0; i < cx * cy; i++) {
+		const cluster& c = l.clusters[i];
+		for(unsigned int j = 0; j < c.nodes.size(); j++) {
+			int a = find_root(l.components, c.first_region +
+					l.region[c.nodes[j].y * sx + c.nodes[j].x]);
+			for(unsigned int k = 0; k < c.exits[j].size(); k++) {
+				const coord& to = c.exits[j][k].to;
+				const cluster& oc = l.clusters[cluster_of(to.x, to.y)];
+				int b = find_root(l.components, oc.first_region +
+						l.region[to.y * sx + to.x]);
+				if(a != b) {
+					l.components[std::max(a, b)] = std::min(a, b);
+					a = std::min(a, b);
+				}
+			}
+		}
+	}
+	for(int i = 0; i < num; i++)
+		l.components[i] = find_root(l.components, i);
+}
+
+int map_hierarchy::component_at(const level& l, int x, int y) const
+{
+	int r = l.region[y * sx + x];
+	if(r == -1)
+		return -1;
+	return l.components[l.clusters[cluster_of(x, y)].first_region + r];
+}
+
+bool map_hierarchy::connected(const map& m, movement_class mc,
+		const coord& a, const coord& b)
+{
+	check_size(m);
+	if(a.x < 0 || a.y < 0 || a.x >= sx || a.y >= sy ||
+			b.x < 0 || b.y < 0 || b.x >= sx || b.y >= sy)
+		return true;
+	update_level(m, mc);
+	const level& l = levels[(int)mc];
+	int cb = component_at(l, b.x, b.y);
+	if(cb == -1)
+		return false;
+	int ca = component_at(l, a.x, a.y);
+	if(ca != -1)
+		return ca == cb;
+	for(int i = -1; i <= 1; i++) {
+		for(int j = -1; j <= 1; j++) {
+			int nx, ny;
+			if(neighbour(m, a.x, a.y, i, j, &nx, &ny) &&
+					component_at(l, nx, ny) == cb)
+				return true;
+		}
+	}
+	return false;
+}
+
+void map_hierarchy::label_cluster(const map& m, movement_class mc, int cl)
+{
+	level& l = levels[(int)mc];
+	int x0 = (cl % cx) * cluster_size;
+	int y0 = (cl / cx) * cluster_size;
+	int x1 = std::min(x0 + cluster_size, sx);
+	int y1 = std::min(y0 + cluster_size, sy);
+	for(int y = y0; y < y1; y++) {
+		for(int x = x0; x < x1; x++) {
+			l.passable[y * sx + x] = tile_passable(m, mc, x, y);
+			l.region[y * sx + x] = -1;
+		}
+	}
+	int num_regions = 0;
+	std::vector<coord> stack;
+	for(int y = y0; y < y1; y++) {
+		for(int x = x0; x < x1; x++) {
+			if(!l.passable[y * sx + x] || l.region[y * sx + x] != -1)
+				continue;
+			l.region[y * sx + x] = num_regions;
+			stack.push_back(coord(x, y));
+			while(!stack.empty()) {
+				coord c = stack.back();
+				stack.pop_back();
+				for(int i = -1; i <= 1; i++) {
+					for(int j = -1; j <= 1; j++) {
+						int nx, ny;
+						if(!neighbour(m, c.x, c.y, i, j, &nx, &ny))
+							continue;
+						int idx = ny * sx + nx;
+						if(cluster_of(nx, ny) != cl || !l.passable[idx] ||
+								l.region[idx] != -1)
+							continue;
+						l.region[idx] = num_regions;
+						stack.push_back(coord(nx, ny));
+					}
+				}
+			}
+			num_regions++;
+		}
+	}
+	l.clusters[cl].num_regions = num_regions;
+}
+
+void map_hierarchy::connect_cluster(const map& m, level& l, int cl)
+{
+	cluster& c = l.clusters[cl];
+	for(unsigned int i = 0; i < c.nodes.size(); i++)
+		l.node_index[c.nodes[i].y * sx + c.nodes[i].x] = -1;
+	c.nodes.clear();
+	c.exits.clear();
+	c.paths.clear();
+
+	// all crossings to other clusters, keyed by the cluster and the
+	// regions on both sides. Crossings are stored with the smaller
+	// coordinate first so that both clusters pick the same one.
+	typedef std::pair<int, std::pair<int, int> > crossing_key;
+	typedef std::vector<std::pair<coord, coord> > crossing_list;
+	std::map<crossing_key, crossing_list> crossings;
+	int x0 = (cl % cx) * cluster_size;
+	int y0 = (cl / cx) * cluster_size;
+	int x1 = std::min(x0 + cluster_size, sx);
+	int y1 = std::min(y0 + cluster_size, sy);
+	for(int y = y0; y < y1; y++) {
+		for(int x = x0; x < x1; x++) {
+			if(!l.passable[y * sx + x])
+				continue;
+			for(int i = -1; i <= 1; i++) {
+				for(int j = -1; j <= 1; j++) {
+					int nx, ny;
+					if(!neighbour(m, x, y, i, j, &nx, &ny))
+						continue;
+					int n = cluster_of(nx, ny);
+					if(n == cl || !l.passable[ny * sx + nx])
+						continue;
+					coord a(x, y);
+					coord b(nx, ny);
+					crossings[crossing_key(n, std::make_pair(l.region[y * sx + x],
+								l.region[ny * sx + nx]))].push_back(a < b ?
+							std::make_pair(a, b) : std::make_pair(b, a));
+				}
+			}
+		}
+	}
+
+	// one entrance per region pair, in the middle of the crossings
+	for(std::map<crossing_key, crossing_list>::iterator it = crossings.begin();
+			it != crossings.end();
+			++it) {
+		std::sort(it->second.begin(), it->second.end());
+		const std::pair<coord, coord>& p = it->second[it->second.size() / 2];
+		bool first_own = cluster_of(p.first.x, p.first.y) == cl;
+		const coord& own = first_own ? p.first : p.second;
+		const coord& other = first_own ? p.second : p.first;
+		int& ni = l.node_index[own.y * sx + own.x];
+		if(ni == -1) {
+			ni = c.nodes.size();
+			c.nodes.push_back(own);
+			c.exits.push_back(std::vector<edge>());
+		}
+		edge e = { other, 0 };
+		c.exits[ni].push_back(e);
+	}
+	c.paths.resize(c.nodes.size());
+	c.dirty = false;
+	c.costs_dirty = true;
+	l.costs_stale = true;
+}
+
+void map_hierarchy::cost_cluster(const map& m, level& l, int cl)
+{
+	cluster& c = l.clusters[cl];
+	std::vector<int> costs;
+	for(unsigned int i = 0; i < c.nodes.size(); i++) {
+		for(unsigned int j = 0; j < c.exits[i].size(); j++) {
+			const coord& to = c.exits[i][j].to;
+			c.exits[i][j].cost = step_cost(m, c.nodes[i].x, c.nodes[i].y,
+					to.x, to.y);
+		}
+		c.paths[i].clear();
+		cluster_costs(m, l, c.nodes[i], costs);
+		for(unsigned int j = 0; j < c.nodes.size(); j++) {
+			if(i == j)
+				continue;
+			int cost = costs[local_index(c.nodes[j].x, c.nodes[j].y)];
+			if(cost != INT_MAX) {
+				edge e = { c.nodes[j], cost };
+				c.paths[i].push_back(e);
+			}
+		}
+	}
+	c.costs_dirty = false;
+}
+
+void map_hierarchy::cluster_costs(const map& m, const level& l, const coord& src,
+		std::vector<int>& costs) const
+{
+	typedef std::pair<int, int> open_tile; // cost, local index
+	costs.assign(cluster_size * cluster_size, INT_MAX);
+	int cl = cluster_of(src.x, src.y);
+	int x0 = (cl % cx) * cluster_size;
+	int y0 = (cl / cx) * cluster_size;
+	std::priority_queue<open_tile, std::vector<open_tile>,
+		std::greater<open_tile> > open;
+	costs[local_index(src.x, src.y)] = 0;
+	open.push(open_tile(0, local_index(src.x, src.y)));
+	while(!open.empty()) {
+		open_tile cur = open.top();
+		open.pop();
+		if(cur.first > costs[cur.second])
+			continue;
+		int x = x0 + cur.second % cluster_size;
+		int y = y0 + cur.second / cluster_size;
+		for(int i = -1; i <= 1; i++) {
+			for(int j = -1; j <= 1; j++) {
+				int nx, ny;
+				if(!neighbour(m, x, y, i, j, &nx, &ny))
+					continue;
+				if(cluster_of(nx, ny) != cl || !l.passable[ny * sx + nx])
+					continue;
+				int li = local_index(nx, ny);
+				int cost = cur.first + step_cost(m, x, y, nx, ny);
+				if(cost < costs[li]) {
+					costs[li] = cost;
+					open.push(open_tile(cost, li));
+				}
+			}
+		}
+	}
+}
+
+bool map_hierarchy::find_route(const map& m, movement_class mc,
+		const coord& start, const coord& goal,
+		std::vector<coord>& route)
+{
+	route.clear();
+	check_size(m);
+	if(start.x < 0 || start.y < 0 || start.x >= sx || start.y >= sy ||
+			goal.x < 0 || goal.y < 0 || goal.x >= sx || goal.y >= sy)
+		return true;
+	update_costs(m, mc);
+	const level& l = levels[(int)mc];
+	if(!l.passable[goal.y * sx + goal.x])
+		return false;
+
+	std::vector<int> from_start;
+	std::vector<int> to_goal;
+	cluster_costs(m, l, start, from_start);
+	cluster_costs(m, l, goal, to_goal);
+	int goal_cluster = cluster_of(goal.x, goal.y);
+
+	// A* over the entrances, with start and goal connected to the
+	// entrances of their clusters
+	astar_context_lease lease(sx, sy);
+	astar_context& ctx = lease.get();
+	ctx.new_search();
+	const unsigned int gen = ctx.generation();
+	astar_open_node_comp comp;
+	std::vector<std::pair<int, coord> >& open_nodes = ctx.open_nodes;
+	astar_node* start_node = ctx.get_node(start);
+	start_node->open_gen = gen;
+	start_node->cost = 0;
+	open_nodes.push_back(std::make_pair(0, start));
+	std::vector<edge> children;
+	bool found = false;
+	while(!open_nodes.empty()) {
+		coord current(open_nodes.front().second);
+		std::pop_heap(open_nodes.begin(), open_nodes.end(), comp);
+		open_nodes.pop_back();
+		astar_node* current_node = ctx.get_node(current);
+		if(current_node->closed_gen == gen)
+			continue;
+		current_node->closed_gen = gen;
+		if(current == goal) {
+			found = true;
+			break;
+		}
+
+		children.clear();
+		const cluster& cc = l.clusters[cluster_of(current.x, current.y)];
+		if(current == start) {
+			for(unsigned int i = 0; i < cc.nodes.size(); i++) {
+				int cost = from_start[local_index(cc.nodes[i].x, cc.nodes[i].y)];
+				if(cost != INT_MAX) {
+					edge e = { cc.nodes[i], cost };
+					children.push_back(e);
+				}
+			}
+		}
+		if(cluster_of(current.x, current.y) == goal_cluster &&
+				to_goal[local_index(current.x, current.y)] != INT_MAX) {
+			edge e = { goal, to_goal[local_index(current.x, current.y)] };
+			children.push_back(e);
+		}
+		int ni = l.node_index[current.y * sx + current.x];
+		if(ni != -1) {
+			children.insert(children.end(), cc.exits[ni].begin(), cc.exits[ni].end());
+			children.insert(children.end(), cc.paths[ni].begin(), cc.paths[ni].end());
+		}
+
+		for(unsigned int i = 0; i < children.size(); i++) {
+			astar_node* child_node = ctx.get_node(children[i].to);
+			if(child_node->closed_gen == gen)
+				continue;
+			int cost = current_node->cost + children[i].cost;
+			if(child_node->open_gen == gen && child_node->cost <= cost)
+				continue;
+			child_node->open_gen = gen;
+			child_node->cost = cost;
+			child_node->parent = current;
+			open_nodes.push_back(std::make_pair(cost +
+						heuristic(m, children[i].to, goal), children[i].to));
+			std::push_heap(open_nodes.begin(), open_nodes.end(), comp);
+		}
+	}
+	if(!found)
+		return false;
+
+	coord c = goal;
+	while(1) {
+		route.push_back(c);
+		if(c == start)
+			break;
+		c = ctx.get_node(c)->parent;
+	}
+	std::reverse(route.begin(), route.end());
+	return true;
+}
+
+void map_hierarchy::mark_clusters(const std::vector<coord>& tiles, int radius,
+		std::vector<char>& clusters) const
+{
+	clusters.assign(cx * cy, 0);
+	for(unsigned int k = 0; k < tiles.size(); k++) {
+		int gx = tiles[k].x / cluster_size;
+		int gy = tiles[k].y / cluster_size;
+		for(int i = -radius; i <= radius; i++) {
+			for(int j = -radius; j <= radius; j++) {
+				int nx = gx + i;
+				int ny = gy + j;
+				if(xw)
+					nx = (nx + cx) % cx;
+				if(yw)
+					ny = (ny + cy) % cy;
+				if(nx >= 0 && ny >= 0 && nx < cx && ny < cy)
+					clusters[ny * cx + nx] = 1;
+			}
+		}
+	}
+}
+
@@ -0,0 +1,98 @@
+#ifndef MAP_HIERARCHY_H
+#define MAP_HIERARCHY_H
+
+#include <vector>
+
+#include "coord.h"
+
+class map;
+
+enum class movement_class {
+	land,
+	sea,
+	ocean,
+	road,
+	max_movement_class // must be last
+};
+
+// Abstract graph for hierarchical path finding. The map is split into
+// square clusters. For each movement class there is one entrance per
+// pair of connected regions of neighbouring clusters, with the costs
+// between the entrances of a cluster precomputed. Only terrain, roads and
+// cities are taken into account, and any city is passable, so the
+// abstract graph never misses a path the civ could take; it is built
+// lazily and rebuilt cluster by cluster after invalidate_tile().
+// The regions are also joined into connected components (continents for
+// land, water bodies for sea and ocean) to reject unreachable goals.
+class map_hierarchy {
+	public:
+		map_hierarchy();
+		void invalidate_tile(int x, int y);
+		void invalidate_road(int x, int y);
+		void invalidate_all();
+		// Returns false if there's certainly no path from start to goal.
+		// Otherwise route holds start, the entrances along the abstract
+		// route and goal, or is left empty if the hierarchy can't help.
+		bool find_route(const map& m, movement_class mc,
+				const coord& start, const coord& goal,
+				std::vector<coord>& route);
+		// false if a unit of the movement class certainly can't get from
+		// a to b; a may be off the class' terrain, like a land unit on a
+		// ship
+		bool connected(const map& m, movement_class mc,
+				const coord& a, const coord& b);
+		// marks the clusters of the tiles and the ones within radius
+		void mark_clusters(const std::vector<coord>& tiles, int radius,
+				std::vector<char>& clusters) const;
+		int cluster_of(int x, int y) const;
+		static const int cluster_size = 10;
+	private:
+		struct edge {
+			coord to;
+			int cost;
+		};
+		struct cluster {
+			bool dirty;       // regions and entrances
+			bool costs_dirty; // edge costs
+			int num_regions;
+			int first_region; // index into level::components
+			std::vector<coord> nodes;
+			std::vector<std::vector<edge> > exits; // to other clusters
+			std::vector<std::vector<edge> > paths; // within the cluster
+		};
+		struct level {
+			bool built;
+			bool stale;       // some cluster is dirty
+			bool costs_stale; // some cluster has dirty costs
+			std::vector<char> passable;
+			std::vector<int> region;
+			std::vector<int> node_index;
+			std::vector<cluster> clusters;
+			std::vector<int> components; // per region of all clusters
+		};
+		void check_size(const map& m);
+		void update_level(const map& m, movement_class mc);
+		void label_cluster(const map& m, movement_class mc, int cl);
+		void update_costs(const map& m, movement_class mc);
+		void mark_around(int x, int y, int first_structural);
+		void connect_cluster(const map& m, level& l, int cl);
+		void cost_cluster(const map& m, level& l, int cl);
+		void join_components(level& l);
+		int component_at(const level& l, int x, int y) const;
+		void cluster_costs(const map& m, const level& l, const coord& src,
+				std::vector<int>& costs) const;
+		bool neighbour(const map& m, int x, int y, int i, int j,
+				int* nx, int* ny) const;
+		int local_index(int x, int y) const;
+		int heuristic(const map& m, const coord& a, const coord& b) const;
+		int sx;
+		int sy;
+		int cx;
+		int cy;
+		bool xw;
+		bool yw;
+		level levels[(int)movement_class::max_movement_class];
+};
+
+#endif
+
@@ -3,49 +3,54 @@
 #include <algorithm>
 #include "map.h"
 #include "map-astar.h"
+#include "thread-pool.h"
+#include "rng.h"
 #include <stdio.h>
 
-const std::list<unit*> map::empty_unit_spot = std::list<unit*>();
 
 map::map(int x, int y, const resource_configuration& resconf_,
 		const resource_map& rmap_)
-	: data(buf2d<int>(x, y, 0)),
-	unit_map(buf2d<std::list<unit*> >(x, y, std::list<unit*>())),
-	city_map(buf2d<city*>(x, y, NULL)),
-	land_map(buf2d<int>(x, y, -1)),
-	improv_map(buf2d<int>(x, y, 0)),
-	res_map(buf2d<int>(x, y, 0)),
-	river_map(buf2d<bool>(x, y, false)),
-	village_map(buf2d<int>(x, y, 0)),
+	: tiles(x, y, 0),
+	unit_map(buf2d<unit*, map_layout>(x, y, NULL)),
+	city_map(buf2d<city*, map_layout>(x, y, NULL)),
 	resconf(resconf_),
 	rmap(rmap_),
 	x_wrap(true),
-	y_wrap(false)
+	y_wrap(false),
+	rules(new ruleset(resconf, rmap)),
+	dropped_tile_changes(0),
+	dropped_unit_changes(0)
 {
+	tiles.enable_yield_tiles();
+	update_neighbourhood();
 	init_to_water();
+	index_land_owners();
 }
 
 map::map()
+	: dropped_tile_changes(0),
+	dropped_unit_changes(0)
 {
 }
 
 void map::init_to_water()
 {
-	int x = data.size_x;
-	int y = data.size_y;
+	int x = tiles.size_x();
+	int y = tiles.size_y();
 	int ocean_tile = resconf.get_ocean_tile();
 	// init to water
 	for(int i = 0; i < y; i++) {
 		for(int j = 0; j < x; j++) {
-			data.set(j, i, ocean_tile);
+			tiles.set_terrain(tiles.index(j, i), ocean_tile);
 		}
 	}
 }
 
-void map::create()
+void map::create(unsigned int seed)
 {
-	int x = data.size_x;
-	int y = data.size_y;
+	int x = tiles.size_x();
+	int y = tiles.size_y();
+	random_gen = rng(seed);
 	init_to_water();
 
 	int sea_tile = resconf.get_sea_tile();
@@ -55,23 +60,23 @@ void map::create()
 	int num_continents = x * y / 800;
 	int max_continent_size = x * y / 10; // in tiles
 	for(int i = 0; i < num_continents; i++) {
-		int cont_x = rand() % x;
-		int cont_y = 10 + rand() % (y - 20);
-		data.set(cont_x, cont_y, grass_tile);
+		int cont_x = random_gen(x);
+		int cont_y = 10 + random_gen(y - 20);
+		tiles.set_terrain(tiles.index(cont_x, cont_y), grass_tile);
 		sea_around_land(cont_x, cont_y, sea_tile);
 
 		std::vector<coord> candidates;
 		candidates.push_back(coord(cont_x, cont_y));
-		int cont_size = rand() % max_continent_size + 1;
+		int cont_size = random_gen(max_continent_size) + 1;
 		std::set<coord> already_taken;
 		for(int j = 0; j < cont_size && !candidates.empty(); j++) {
-			int cand = rand() % candidates.size();
+			int cand = random_gen(candidates.size());
 			coord c = candidates[cand];
 			if(already_taken.find(c) != already_taken.end())
 				continue;
 			already_taken.insert(c);
 			candidates.erase(candidates.begin() + cand);
-			data.set(c.x, c.y, grass_tile);
+			tiles.set_terrain(tiles.index(c.x, c.y), grass_tile);
 			sea_around_land(c.x, c.y, sea_tile);
 			int dx1 = wrap_x(c.x - 1);
 			int dx2 = wrap_x(c.x + 1);
@@ -90,137 +95,459 @@ void map::create()
 	int max_ridge_length = 20;
 	int num_ridges = x * y / (max_ridge_length * 4);
 	for(int i = 0; i < num_ridges; i++) {
-		int xpos = rand() % x;
-		int ypos = rand() % y;
-		int dir = rand() % 8;
+		int xpos = random_gen(x);
+		int ypos = random_gen(y);
+		int dir = random_gen(8);
 		int ridge_width = 3;
-		int ridge_size = rand() % max_ridge_length + 4;
+		int ridge_size = random_gen(max_ridge_length) + 4;
 		for(int j = 0; j < ridge_size; j++) {
 			int realdir = dir % 8;
 			if(!resconf.is_water_tile(get_data(xpos, ypos))) {
 				create_mountains(xpos, ypos, ridge_width);
 			}
-			ridge_width += rand() % 3 - 1;
+			ridge_width += (int)random_gen(3) - 1;
 			ridge_width = clamp(2, ridge_width, 5);
 			int dx = realdir > 4 ? 1 : realdir < 3 ? -1 : 0;
 			int dy = realdir == 0 || realdir == 3 || realdir == 5 ? -1 :
 				realdir == 1 || realdir == 6 ? 0 : -1;
 			xpos = clamp(0, wrap_x(xpos + dx), x - 1);
 			ypos = clamp(0, wrap_y(ypos + dy), y - 1);
-			dir += rand() % 3 - 1;
+			dir += (int)random_gen(3) - 1;
 		}
 	}
 
-	// create terrain types
+	// create terrain types; from here on only land tiles change to other
+	// land, so the distances to the sea stay valid
+	sea_distances sd;
+	get_sea_distances(sd);
 	for(int j = 0; j < y; j++) {
 		for(int i = 0; i < x; i++) {
-			int this_data = get_data(i, j);
-			if(resconf.is_water_tile(this_data) ||
-			   resconf.is_mountain_tile(this_data))
-				continue;
-			int temp = get_temperature(i, j);
-			std::vector<int> types = get_types_by_temperature(temp);
-			if(resconf.is_hill_tile(this_data) &&
-			   temp > 3 && temp < 7)
-				continue;
-			int humidity = get_humidity_at(i, j);
-			std::vector<int> candidates = get_terrain_candidates(types, humidity);
-			int chosen_type_index = rand() % candidates.size();
-			data.set(i, j, candidates[chosen_type_index]);
+			int terr = random_terrain(i, j, sd, random_gen);
+			if(terr != -1)
+				tiles.set_terrain(tiles.index(i, j), terr);
 		}
 	}
 
 	// create rivers
 	int num_rivers = x * y / 20;
 	for(int i = 0; i < num_rivers; i++) {
-		int river_x = rand() % x;
-		int river_y = rand() % y;
+		int river_x = random_gen(x);
+		int river_y = random_gen(y);
 		int terr = get_data(river_x, river_y);
 		if(!resconf.is_water_tile(terr)) {
-			int gendir = rand() % 4;
 			std::vector<coord> river_path;
-			river_path.push_back(coord(river_x, river_y));
-			bool success = false;
-			while(1) {
-				if(data.get(river_x, river_y) == NULL) {
-					// map border
-					break;
+			if(random_river(river_x, river_y, sd, random_gen, river_path)) {
+				for(unsigned int ind = 0; ind < river_path.size(); ind++) {
+					set_river(river_path[ind].x, river_path[ind].y, true);
+				}
+			}
+		}
+	}
+
+	// create resources
+	add_random_resources();
+	hierarchy.invalidate_all();
+}
+
+// The chunks of the parallel mode: about gen_chunk_size tiles square, and
+// no narrower than the gen_chunk_spill tiles that a chunk's continents
+// and ridges may reach into its neighbours, so that they stay within them.
+static const int gen_chunk_size = 64;
+static const int gen_chunk_spill = gen_chunk_size / 2;
+
+// temperature_at() and humidity_at() are the same for all distances to the
+// sea from 11 on, so the chunks needn't search for the sea further away
+static const int gen_sea_radius = 12;
+
+class chunk_grid {
+	public:
+		chunk_grid(int sx_, int sy_, bool x_wrap_, bool y_wrap_)
+			: sx(sx_), sy(sy_),
+			nx((sx_ + gen_chunk_size - 1) / gen_chunk_size),
+			ny((sy_ + gen_chunk_size - 1) / gen_chunk_size),
+			x_wrap(x_wrap_), y_wrap(y_wrap_) { }
+		int size() const { return nx * ny; }
+		int x0(int k) const { return (k % nx) * sx / nx; }
+		int x1(int k) const { return (k % nx + 1) * sx / nx; }
+		int y0(int k) const { return (k / nx) * sy / ny; }
+		int y1(int k) const { return (k / nx + 1) * sy / ny; }
+		int area(int k) const { return (x1(k) - x0(k)) * (y1(k) - y0(k)); }
+		bool contains(int k, int x, int y) const {
+			return x >= x0(k) && x < x1(k) && y >= y0(k) && y < y1(k);
+		}
+		// the chunk and the ones around it, in ascending order
+		std::vector<int> neighbourhood(int k) const {
+			std::set<int> ret;
+			for(int j = -1; j <= 1; j++) {
+				for(int i = -1; i <= 1; i++) {
+					int cx = k % nx + i;
+					int cy = k / nx + j;
+					if(x_wrap)
+						cx = (cx + nx) % nx;
+					if(y_wrap)
+						cy = (cy + ny) % ny;
+					if(cx >= 0 && cx < nx && cy >= 0 && cy < ny)
+						ret.insert(cy * nx + cx);
 				}
+			}
+			return std::vector<int>(ret.begin(), ret.end());
+		}
+	private:
+		int sx;
+		int sy;
+		int nx;
+		int ny;
+		bool x_wrap;
+		bool y_wrap;
+};
+
+// area / per, with the remainder rounded up at random
+static int random_count(rng& r, int area, int per)
+{
+	int num = area / per;
+	if((int)r(per) < area % per)
+		num++;
+	return num;
+}
+
+struct ridge_stamp {
+	int x;
+	int y;
+	int width;
+};
+
+// The stages of create() with the same densities per area, but the
+// continents are only as large as on a map of a chunk's size and each
+// chunk creates its own. Where the chunks' results overlap, each chunk
+// sets its own tiles, applying the results of the chunks around it in the
+// same order, so that no two threads write the same tile.
+void map::create_parallel(unsigned int seed, unsigned int num_threads)
+{
+	int x = tiles.size_x();
+	int y = tiles.size_y();
+	thread_pool pool(num_threads);
+	chunk_grid grid(x, y, x_wrap, y_wrap);
+	rng root(seed);
+	int num_chunks = grid.size();
+
+	int sea_tile = resconf.get_sea_tile();
+	int grass_tile = resconf.get_grass_tile();
+	int ocean_tile = resconf.get_ocean_tile();
 
-				terr = get_data(river_x, river_y);
-				if(get_humidity_at(river_x, river_y) < 3) {
-					// too dry
-					break;
+	// create continents
+	const int max_continent_size = gen_chunk_size * gen_chunk_size / 10;
+	std::vector<std::vector<coord> > land_tiles(num_chunks);
+	rng cont_rng = root.split(0);
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		rng r = cont_rng.split(k);
+		int x0 = grid.x0(k) - gen_chunk_spill;
+		int x1 = grid.x1(k) + gen_chunk_spill;
+		int y0 = grid.y0(k) - gen_chunk_spill;
+		int y1 = grid.y1(k) + gen_chunk_spill;
+		int num_continents = random_count(r, grid.area(k), 800);
+		std::vector<char> already_taken((x1 - x0) * (y1 - y0));
+		for(int i = 0; i < num_continents; i++) {
+			int cont_x = grid.x0(k) + r(grid.x1(k) - grid.x0(k));
+			int cont_y = grid.y0(k) + r(grid.y1(k) - grid.y0(k));
+			int cont_size = r(max_continent_size) + 1;
+			if(cont_y < 10 || cont_y >= y - 10)
+				continue;
+			// not wrapped, so that the spill is easy to check
+			std::vector<coord> candidates;
+			candidates.push_back(coord(cont_x, cont_y));
+			std::fill(already_taken.begin(), already_taken.end(), 0);
+			for(int j = 0; j < cont_size && !candidates.empty(); j++) {
+				int cand = r(candidates.size());
+				coord c = candidates[cand];
+				candidates[cand] = candidates.back();
+				candidates.pop_back();
+				char& taken = already_taken[(c.y - y0) * (x1 - x0) + c.x - x0];
+				if(taken)
+					continue;
+				taken = 1;
+				land_tiles[k].push_back(coord(wrap_x(c.x), wrap_y(c.y)));
+				const int dx[] = { -1, 1, 0, 0 };
+				const int dy[] = { 0, 0, -1, 1 };
+				for(int d = 0; d < 4; d++) {
+					coord n(c.x + dx[d], c.y + dy[d]);
+					if(n.x < x0 || n.x >= x1 || n.y < y0 || n.y >= y1)
+						continue;
+					if((!x_wrap && (n.x < 0 || n.x >= x)) ||
+							(!y_wrap && (n.y < 0 || n.y >= y)))
+						continue;
+					if(!already_taken[(n.y - y0) * (x1 - x0) + n.x - x0])
+						candidates.push_back(n);
 				}
-				bool go_right = rand() % 2 == 0;
-				bool on_hill = resconf.is_hill_tile(terr);
-				bool on_flatland = !on_hill && !resconf.is_mountain_tile(terr);
-
-				if((gendir == 0 && !go_right) || (gendir == 2 && go_right))
-					river_x--;
-				else if((gendir == 1 && go_right) || (gendir == 3 && !go_right))
-					river_x++;
-				else if((gendir == 0 && go_right) || (gendir == 1 && !go_right))
-					river_y--;
-				else // if(gendir == 2 && !go_right || gendir == 3 && go_right)
-					river_y++;
-
-				river_x = wrap_x(river_x);
-				river_y = wrap_y(river_y);
-				int new_terr = get_data(river_x, river_y);
-				if(resconf.is_water_tile(new_terr)) {
-					success = true;
-					break;
+			}
+		}
+	});
+	std::vector<char> land(x * y, 0);
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		std::vector<int> nb = grid.neighbourhood(k);
+		for(unsigned int n = 0; n < nb.size(); n++) {
+			const std::vector<coord>& tiles = land_tiles[nb[n]];
+			for(unsigned int i = 0; i < tiles.size(); i++) {
+				if(grid.contains(k, tiles[i].x, tiles[i].y))
+					land[tiles[i].y * x + tiles[i].x] = 1;
+			}
+		}
+	});
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		for(int j = grid.y0(k); j < grid.y1(k); j++) {
+			for(int i = grid.x0(k); i < grid.x1(k); i++) {
+				int terr = ocean_tile;
+				if(land[j * x + i]) {
+					terr = grass_tile;
 				}
-				bool new_on_mountain = resconf.is_mountain_tile(new_terr);
-				if(on_hill && new_on_mountain) {
-					break;
+				else {
+					for(int l = -1; l <= 1 && terr == ocean_tile; l++) {
+						for(int m = -1; m <= 1; m++) {
+							int nx = wrap_x(i + m);
+							int ny = wrap_y(j + l);
+							if(nx >= 0 && nx < x && ny >= 0 && ny < y &&
+									land[ny * x + nx]) {
+								terr = sea_tile;
+								break;
+							}
+						}
+					}
 				}
-				bool new_on_hill = resconf.is_hill_tile(new_terr);
-				if(on_flatland && (new_on_hill || new_on_mountain)) {
-					break;
+				tiles.set_terrain(tiles.index(i, j), terr);
+			}
+		}
+	});
+	land_tiles.clear();
+
+	// create ridges
+	const int max_ridge_length = 20;
+	const int dir_x[] = { -1, 0, 1, 1, 1, 0, -1, -1 };
+	const int dir_y[] = { -1, -1, -1, 0, 1, 1, 1, 0 };
+	std::vector<std::vector<ridge_stamp> > ridges(num_chunks);
+	rng ridge_rng = root.split(1);
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		rng r = ridge_rng.split(k);
+		int num_ridges = random_count(r, grid.area(k), max_ridge_length * 4);
+		for(int i = 0; i < num_ridges; i++) {
+			int xpos = grid.x0(k) + r(grid.x1(k) - grid.x0(k));
+			int ypos = grid.y0(k) + r(grid.y1(k) - grid.y0(k));
+			int dir = r(8);
+			int ridge_width = 3;
+			int ridge_size = r(max_ridge_length) + 4;
+			for(int j = 0; j < ridge_size; j++) {
+				if(!resconf.is_water_tile(get_data(xpos, ypos))) {
+					ridge_stamp st = { xpos, ypos, ridge_width };
+					ridges[k].push_back(st);
 				}
-				river_path.push_back(coord(river_x, river_y));
+				ridge_width += (int)r(3) - 1;
+				ridge_width = clamp(2, ridge_width, 5);
+				xpos = clamp(0, wrap_x(xpos + dir_x[dir]), x - 1);
+				ypos = clamp(0, wrap_y(ypos + dir_y[dir]), y - 1);
+				dir = (dir + r(3) + 7) % 8;
 			}
-			if(success) {
-				for(unsigned int ind = 0; ind < river_path.size(); ind++) {
-					river_map.set(river_path[ind].x, river_path[ind].y, true);
+		}
+	});
+	int hill_tile = resconf.get_hill_tile();
+	int mountain_tile = resconf.get_mountain_tile();
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		std::vector<int> nb = grid.neighbourhood(k);
+		for(unsigned int n = 0; n < nb.size(); n++) {
+			const std::vector<ridge_stamp>& stamps = ridges[nb[n]];
+			for(unsigned int s = 0; s < stamps.size(); s++) {
+				// as create_mountains()
+				int rad = stamps[s].width / 2;
+				int skip = stamps[s].width % 2;
+				for(int i = -rad; i < rad + skip; i++) {
+					for(int j = -rad; j < rad + skip; j++) {
+						int tx = wrap_x(stamps[s].x + i);
+						int ty = wrap_y(stamps[s].y + j);
+						if(!grid.contains(k, tx, ty))
+							continue;
+						int ind = tiles.index(tx, ty);
+						if(resconf.is_water_tile(tiles.get_terrain(ind)))
+							continue;
+						int manh = abs(i) + abs(j);
+						if(manh == rad)
+							tiles.set_terrain(ind, hill_tile);
+						else if(manh < rad)
+							tiles.set_terrain(ind, mountain_tile);
+					}
 				}
 			}
 		}
+	});
+	ridges.clear();
+
+	// create terrain types; the distances to the sea are searched for on
+	// the map as it was, so the new types are set only once all are chosen
+	sea_distances sd;
+	sd.min = buf2d<int, map_layout>(x, y, -1);
+	sd.max = buf2d<int, map_layout>(x, y, -1);
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		get_sea_distances(sd, grid.x0(k), grid.y0(k), grid.x1(k), grid.y1(k),
+				gen_sea_radius);
+	});
+	std::vector<int> terrain(x * y, -1);
+	rng terrain_rng = root.split(2);
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		rng r = terrain_rng.split(k);
+		for(int j = grid.y0(k); j < grid.y1(k); j++)
+			for(int i = grid.x0(k); i < grid.x1(k); i++)
+				terrain[j * x + i] = random_terrain(i, j, sd, r);
+	});
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		for(int j = grid.y0(k); j < grid.y1(k); j++) {
+			for(int i = grid.x0(k); i < grid.x1(k); i++) {
+				if(terrain[j * x + i] != -1)
+					tiles.set_terrain(tiles.index(i, j), terrain[j * x + i]);
+			}
+		}
+	});
+	terrain.clear();
+
+	// create rivers
+	std::vector<std::vector<coord> > rivers(num_chunks);
+	rng river_rng = root.split(3);
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		rng r = river_rng.split(k);
+		int num_rivers = random_count(r, grid.area(k), 20);
+		std::vector<coord> river_path;
+		for(int i = 0; i < num_rivers; i++) {
+			int river_x = grid.x0(k) + r(grid.x1(k) - grid.x0(k));
+			int river_y = grid.y0(k) + r(grid.y1(k) - grid.y0(k));
+			if(resconf.is_water_tile(get_data(river_x, river_y)))
+				continue;
+			river_path.clear();
+			if(random_river(river_x, river_y, sd, r, river_path))
+				rivers[k].insert(rivers[k].end(), river_path.begin(),
+						river_path.end());
+		}
+	});
+	for(int k = 0; k < num_chunks; k++) {
+		for(unsigned int i = 0; i < rivers[k].size(); i++)
+			set_river(rivers[k][i].x, rivers[k][i].y, true);
 	}
+	rivers.clear();
 
 	// create resources
-	add_random_resources();
+	rng res_rng = root.split(4);
+	pool.parallel_for(num_chunks, [&](unsigned int k) {
+		rng r = res_rng.split(k);
+		for(int j = grid.y0(k); j < grid.y1(k); j++) {
+			for(int i = grid.x0(k); i < grid.x1(k); i++) {
+				unsigned int res;
+				if(random_resource(i, j, r, &res))
+					tiles.set_resource(tiles.index(i, j), res);
+			}
+		}
+	});
+	random_gen = root.split(5);
+	hierarchy.invalidate_all();
 }
 
 void map::add_random_resources()
 {
-	for(int j = 0; j < data.size_y; j++) {
-		for(int i = 0; i < data.size_x; i++) {
-			std::vector<unsigned int> selected_resources;
-			int this_data = get_data(i, j);
-			for(resource_map::const_iterator it = rmap.begin();
-					it != rmap.end();
-					++it) {
-				for(unsigned int k = 0; k < max_num_resource_terrains; k++) {
-					if(it->second.terrain[k] &&
-						it->second.terrain[k] - 1 == (unsigned int)this_data &&
-						it->second.terrain_abundance[k]) {
-						if(rand() % it->second.terrain_abundance[k] == 0)
-							selected_resources.push_back(it->first);
-					}
-				}
-			}
-			if(selected_resources.size() == 1) {
-				res_map.set(i, j, selected_resources[0]);
-			}
-			else if(selected_resources.size() > 1) {
-				unsigned int ind = rand() % selected_resources.size();
-				res_map.set(i, j, selected_resources[ind]);
-			}
+	for(int j = 0; j < tiles.size_y(); j++) {
+		for(int i = 0; i < tiles.size_x(); i++) {
+			unsigned int res;
+			if(random_resource(i, j, random_gen, &res))
+				tiles.set_resource(tiles.index(i, j), res);
+		}
+	}
+}
+
+// Returns the terrain type for the land tile or -1 if it stays as it is.
+template<typename Random>
+int map::random_terrain(int x, int y, const sea_distances& sd,
+		Random& rnd) const
+{
+	int this_data = get_data(x, y);
+	if(resconf.is_water_tile(this_data) ||
+	   resconf.is_mountain_tile(this_data))
+		return -1;
+	int temp = get_temperature(x, y, sd);
+	std::vector<int> types = get_types_by_temperature(temp);
+	if(resconf.is_hill_tile(this_data) &&
+	   temp > 3 && temp < 7)
+		return -1;
+	int humidity = get_humidity_at(x, y, sd);
+	std::vector<int> candidates = get_terrain_candidates(types, humidity);
+	int chosen_type_index = rnd(candidates.size());
+	return candidates[chosen_type_index];
+}
+
+// Runs a river from the land tile until it reaches water, which it
+// returns true for, or until it can't go on. The tiles are added to path.
+template<typename Random>
+bool map::random_river(int river_x, int river_y, const sea_distances& sd,
+		Random& rnd, std::vector<coord>& river_path) const
+{
+	int gendir = rnd(4);
+	river_path.push_back(coord(river_x, river_y));
+	while(1) {
+		if(!tiles.in_bounds(river_x, river_y)) {
+			// map border
+			return false;
 		}
+
+		int terr = get_data(river_x, river_y);
+		if(get_humidity_at(river_x, river_y, sd) < 3) {
+			// too dry
+			return false;
+		}
+		bool go_right = rnd(2) == 0;
+		bool on_hill = resconf.is_hill_tile(terr);
+		bool on_flatland = !on_hill && !resconf.is_mountain_tile(terr);
+
+		if((gendir == 0 && !go_right) || (gendir == 2 && go_right))
+			river_x--;
+		else if((gendir == 1 && go_right) || (gendir == 3 && !go_right))
+			river_x++;
+		else if((gendir == 0 && go_right) || (gendir == 1 && !go_right))
+			river_y--;
+		else // if(gendir == 2 && !go_right || gendir == 3 && go_right)
+			river_y++;
+
+		river_x = wrap_x(river_x);
+		river_y = wrap_y(river_y);
+		int new_terr = get_data(river_x, river_y);
+		if(resconf.is_water_tile(new_terr)) {
+			return true;
+		}
+		bool new_on_mountain = resconf.is_mountain_tile(new_terr);
+		if(on_hill && new_on_mountain) {
+			return false;
+		}
+		bool new_on_hill = resconf.is_hill_tile(new_terr);
+		if(on_flatland && (new_on_hill || new_on_mountain)) {
+			return false;
+		}
+		river_path.push_back(coord(river_x, river_y));
+	}
+}
+
+template<typename Random>
+bool map::random_resource(int x, int y, Random& rnd,
+		unsigned int* res) const
+{
+	std::vector<unsigned int> selected_resources;
+	const std::vector<std::pair<int, unsigned int> >& candidates =
+		rules->get_terrain_resources(get_data(x, y));
+	for(std::vector<std::pair<int, unsigned int> >::const_iterator it = candidates.begin();
+			it != candidates.end();
+			++it) {
+		if(rnd(it->second) == 0)
+			selected_resources.push_back(it->first);
+	}
+	if(selected_resources.size() == 1) {
+		*res = selected_resources[0];
+		return true;
+	}
+	else if(selected_resources.size() > 1) {
+		unsigned int ind = rnd(selected_resources.size());
+		*res = selected_resources[ind];
+		return true;
 	}
+	return false;
 }
 
 void map::sea_around_land(int x, int y, int sea_tile)
@@ -230,16 +557,30 @@ void map::sea_around_land(int x, int y, int sea_tile)
 			if(!j && !k)
 				continue;
 			if(resconf.is_ocean_tile(get_data(x + j, y + k))) {
-				data.set(wrap_x(x + j), wrap_y(y + k), sea_tile);
+				tiles.set_terrain(tiles.index(wrap_x(x + j), wrap_y(y + k)),
+						sea_tile);
 			}
 		}
 	}
 }
 
-int map::get_temperature(int x, int y) const
+// The distance to the sea is only searched for if the result depends on
+// which of the possible distances the search would find.
+int map::get_temperature(int x, int y, const sea_distances& sd) const
+{
+	int min_dist = *sd.min.get(x, y);
+	int max_dist = *sd.max.get(x, y);
+	int t = temperature_at(y, min_dist);
+	for(int d = min_dist + 2; d <= max_dist; d += 2) {
+		if(temperature_at(y, d) != t)
+			return temperature_at(y, dist_to_sea_incl_mountains(x, y));
+	}
+	return t;
+}
+
+int map::temperature_at(int y, int dist_to_sea) const
 {
 	float dist_to_eq = fabsf(get_latitude(y));
-	int dist_to_sea = dist_to_sea_incl_mountains(x, y);
 	int t1 = 10 - clamp(1, (int)(dist_to_eq * 10.0f), 9);
 	if(dist_to_sea <= 2) {
 		if(t1 <= 3)
@@ -311,19 +652,29 @@ class sea_picker {
 		}
 };
 
-int map::get_humidity_at(int x, int y) const
+int map::get_humidity_at(int x, int y, const sea_distances& sd) const
+{
+	int min_dist = *sd.min.get(x, y);
+	int max_dist = *sd.max.get(x, y);
+	int h = humidity_at(y, min_dist);
+	for(int d = min_dist + 2; d <= max_dist; d += 2) {
+		if(humidity_at(y, d) != h)
+			return humidity_at(y, dist_to_sea_incl_mountains(x, y));
+	}
+	return h;
+}
+
+int map::humidity_at(int y, int dist_to_sea) const
 {
 	float lat = fabsf(get_latitude(y));
 	int lat_bonus = lat < 0.10f ? 3 : 0;
 	int dist_coeff = lat > 0.40f ? 3 : lat > 0.25f ? 2 : 1;
-
-	int dist_to_sea = dist_to_sea_incl_mountains(x, y);
 	return clamp(1, lat_bonus + dist_to_sea * dist_coeff - 2, 9);
 }
 
 int map::dist_to_sea_incl_mountains(int x, int y) const
 {
-	std::list<coord> path_to_sea = map_birds_path_to_nearest(coord(x, y),
+	std::list<coord> path_to_sea = map_birds_path_to_nearest(*this, coord(x, y),
 			sea_picker(*this));
 	int dist_to_sea = path_to_sea.size();
 	for(std::list<coord>::const_iterator it = path_to_sea.begin();
@@ -335,6 +686,129 @@ int map::dist_to_sea_incl_mountains(int x, int y) const
 	return dist_to_sea;
 }
 
+// Breadth first search from all water tiles at once. The search in
+// dist_to_sea_incl_mountains() counts the tiles on a shortest bird's path
+// to the sea plus two for each mountain on it, but any shortest path may
+// be taken, so the smallest and largest numbers of mountains are kept.
+void map::get_sea_distances(sea_distances& sd) const
+{
+	int sx = size_x();
+	int sy = size_y();
+	sd.min = buf2d<int, map_layout>(sx, sy, -1);
+	sd.max = buf2d<int, map_layout>(sx, sy, -1);
+	get_sea_distances(sd, 0, 0, sx, sy, std::max(sx, sy));
+}
+
+// As above for the tiles from x0, y0 up to x1, y1 only, searching the
+// tiles up to radius steps around them. The paths to the sea within the
+// radius are all found, and the tiles further away are only known to be
+// at least radius + 2 from the sea.
+void map::get_sea_distances(sea_distances& sd, int x0, int y0,
+		int x1, int y1, int radius) const
+{
+	int sx = size_x();
+	int sy = size_y();
+	// the window searched, not wrapped unless it spans the whole map
+	int wx0 = x0 - radius;
+	int wx1 = x1 + radius;
+	int wy0 = y0 - radius;
+	int wy1 = y1 + radius;
+	bool whole_x = !x_wrap || wx1 - wx0 >= sx;
+	bool whole_y = !y_wrap || wy1 - wy0 >= sy;
+	if(whole_x) {
+		wx0 = std::max(0, wx0);
+		wx1 = std::min(sx, wx1);
+		if(x_wrap) {
+			wx0 = 0;
+			wx1 = sx;
+		}
+	}
+	if(whole_y) {
+		wy0 = std::max(0, wy0);
+		wy1 = std::min(sy, wy1);
+		if(y_wrap) {
+			wy0 = 0;
+			wy1 = sy;
+		}
+	}
+	int w = wx1 - wx0;
+	int h = wy1 - wy0;
+	std::vector<int> steps(w * h, -1);
+	std::vector<int> min_mountains(w * h, 0);
+	std::vector<int> max_mountains(w * h, 0);
+	std::vector<int> queue;
+	queue.reserve(w * h);
+	for(int j = 0; j < h; j++) {
+		for(int i = 0; i < w; i++) {
+			if(resconf.is_water_tile(get_data(wx0 + i, wy0 + j))) {
+				steps[j * w + i] = 0;
+				queue.push_back(j * w + i);
+			}
+		}
+	}
+	// the tiles one step closer to the sea are all reached by the time
+	// a tile is taken from the queue
+	for(unsigned int head = 0; head < queue.size(); head++) {
+		int ind = queue[head];
+		int x = ind % w;
+		int y = ind / w;
+		bool first = true;
+		for(int k = -1; k <= 1; k++) {
+			for(int l = -1; l <= 1; l++) {
+				int nx = x + k;
+				int ny = y + l;
+				if(whole_x)
+					nx = wrap_x(nx);
+				if(whole_y)
+					ny = wrap_y(ny);
+				if((!k && !l) || nx < 0 || ny < 0 || nx >= w || ny >= h)
+					continue;
+				int nind = ny * w + nx;
+				if(steps[nind] == -1) {
+					if(steps[ind] < radius) {
+						steps[nind] = steps[ind] + 1;
+						queue.push_back(nind);
+					}
+				}
+				else if(steps[nind] == steps[ind] - 1) {
+					if(first || min_mountains[nind] < min_mountains[ind])
+						min_mountains[ind] = min_mountains[nind];
+					if(first || max_mountains[nind] > max_mountains[ind])
+						max_mountains[ind] = max_mountains[nind];
+					first = false;
+				}
+			}
+		}
+		if(resconf.is_mountain_tile(get_data(wx0 + x, wy0 + y))) {
+			min_mountains[ind]++;
+			max_mountains[ind]++;
+		}
+	}
+	for(int j = y0; j < y1; j++) {
+		for(int i = x0; i < x1; i++) {
+			int ind = (j - wy0) * w + (i - wx0);
+			int s = steps[ind];
+			if(s == -1) {
+				sd.min.set(i, j, radius + 2);
+				sd.max.set(i, j, radius + 2);
+				continue;
+			}
+			int mountain = resconf.is_mountain_tile(get_data(i, j)) ? 1 : 0;
+			if((!x_wrap && (i + 2 <= s || sx + 1 - i <= s)) ||
+					(!y_wrap && (j + 2 <= s || sy + 1 - j <= s))) {
+				// the search may go around through the tiles off the
+				// map, which have no mountains
+				sd.min.set(i, j, s + 1 + 2 * mountain);
+				sd.max.set(i, j, s + 1 + 2 * s);
+			}
+			else {
+				sd.min.set(i, j, s + 1 + 2 * min_mountains[ind]);
+				sd.max.set(i, j, s + 1 + 2 * max_mountains[ind]);
+			}
+		}
+	}
+}
+
 void map::create_mountains(int x, int y, int width)
 {
 	int rad = width / 2;
@@ -344,10 +818,13 @@ void map::create_mountains(int x, int y, int width)
 			int manh = abs(i) + abs(j);
 			if(resconf.is_water_tile(get_data(x + i, y + j)))
 				continue;
+			// the tiles across the wrap are looked at but not set
+			if(!tiles.in_bounds(x + i, y + j))
+				continue;
 			if(manh == rad)
-				data.set(x + i, y + j, resconf.get_hill_tile());
+				tiles.set_terrain(tiles.index(x + i, y + j), resconf.get_hill_tile());
 			else if(manh < rad)
-				data.set(x + i, y + j, resconf.get_mountain_tile());
+				tiles.set_terrain(tiles.index(x + i, y + j), resconf.get_mountain_tile());
 		}
 	}
 }
@@ -355,10 +832,9 @@ void map::create_mountains(int x, int y, int width)
 int map::wrap_x(int x) const
 {
 	if(x_wrap) {
-		while(x < 0)
-			x += size_x();
-		while(x > size_x() - 1)
-			x -= size_x();
+		x %= tiles.size_x();
+		if(x < 0)
+			x += tiles.size_x();
 	}
 	return x;
 }
@@ -366,10 +842,9 @@ int map::wrap_x(int x) const
 int map::wrap_y(int y) const
 {
 	if(y_wrap) {
-		while(y < 0)
-			y += size_y();
-		while(y > size_y() - 1)
-			y -= size_y();
+		y %= tiles.size_y();
+		if(y < 0)
+			y += tiles.size_y();
 	}
 	return y;
 }
@@ -387,99 +862,124 @@ bool map::y_wrapped() const
 void map::set_x_wrap(bool w)
 {
 	x_wrap = w;
+	update_neighbourhood();
 }
 
 void map::set_y_wrap(bool w)
 {
 	y_wrap = w;
+	update_neighbourhood();
 }
 
 int map::get_data(int x, int y) const
 {
-	const int* v = data.get(wrap_x(x), wrap_y(y));
-	if(!v)
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
 		return -1;
-	return *v;
+	return tiles.get_terrain(tiles.index(x, y));
 }
 
 void map::set_data(int x, int y, int terr)
 {
-	data.set(wrap_x(x), wrap_y(y), terr);
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
+		return;
+	int i = tiles.index(x, y);
+	int owner = tiles.get_owner(i);
+	remove_owned_tile(i, owner);
+	tiles.set_terrain(i, terr);
+	add_owned_tile(i, owner);
+	hierarchy.invalidate_tile(x, y);
+	add_tile_change(x, y);
 }
 
 unsigned int map::get_resource(int x, int y) const
 {
-	const int* v = res_map.get(wrap_x(x), wrap_y(y));
-	if(!v)
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
 		return 0;
-	return *v;
+	return tiles.get_resource(tiles.index(x, y));
 }
 
 void map::set_resource(int x, int y, unsigned int res)
 {
-	res_map.set(wrap_x(x), wrap_y(y), res);
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
+		return;
+	tiles.set_resource(tiles.index(x, y), res);
+	add_tile_change(x, y);
 }
 
 bool map::has_river(int x, int y) const
 {
-	const bool* v = river_map.get(wrap_x(x), wrap_y(y));
-	if(!v)
-		return 0;
-	return *v;
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
+		return false;
+	return tiles.has_river(tiles.index(x, y));
 }
 
 void map::set_river(int x, int y, bool riv)
 {
-	river_map.set(wrap_x(x), wrap_y(y), riv);
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(tiles.in_bounds(x, y))
+		tiles.set_river(tiles.index(x, y), riv);
 }
 
 int map::size_x() const
 {
-	return data.size_x;
+	return tiles.size_x();
 }
 
 int map::size_y() const
 {
-	return data.size_y;
+	return tiles.size_y();
 }
 
 void map::get_resources_by_terrain(int terr, bool city, int* food, int* prod, int* comm) const
 {
-	*food = *prod = *comm = 0;
-	if(terr < 0 || terr >= num_terrain_types)
-		return;
-	*food = resconf.terrain_food_values[terr] + (city ? resconf.city_food_bonus : 0);
-	*prod = resconf.terrain_prod_values[terr] + (city ? resconf.city_prod_bonus : 0);
-	*comm = resconf.terrain_comm_values[terr] + (city ? resconf.city_comm_bonus : 0);
+	rules->get_terrain_yields(terr, city, food, prod, comm);
 }
 
 void map::get_resources_on_spot(int x, int y, int* food, int* prod, int* comm,
-		const std::set<unsigned int>* advances, int cap) const
+		const id_set* advances, int cap) const
+{
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y)) {
+		*food = *prod = *comm = 0;
+		return;
+	}
+	get_yields(tiles.get_yield_tile(tiles.index(x, y)), food, prod, comm,
+			advances, cap);
+}
+
+void map::get_yields(const yield_tile& t, int* food, int* prod, int* comm,
+		const id_set* advances, int cap) const
 {
-	get_resources_by_terrain(get_data(x, y), city_on_spot(x, y) != NULL, 
+	get_resources_by_terrain(t.terrain, t.flags & tile_store::city_flag,
 			food, prod, comm);
-	int imps = get_improvements_on(x, y);
-	if(imps & improv_irrigation)
+	if(t.flags & improv_irrigation)
 		(*food)++;
-	if(imps & improv_mine)
+	if(t.flags & improv_mine)
 		(*prod)++;
-	if(imps & improv_road)
+	if(t.flags & improv_road)
 		(*comm)++;
-	if(has_river(x, y))
+	if(t.flags & tile_store::river_flag)
 		(*comm)++;
-	if(advances) {
-		int res = get_resource(x, y);
-		if(res) {
-			resource_map::const_iterator rit = rmap.find(res);
-			if(rit != rmap.end()) {
-				std::set<unsigned int>::const_iterator it =
-					advances->find(rit->second.needed_advance);
-				if(rit->second.needed_advance == 0 ||
-						it != advances->end()) {
-					*food = *food + rit->second.food_bonus;
-					*prod = *prod + rit->second.prod_bonus;
-					*comm = *comm + rit->second.comm_bonus;
-				}
+	if(advances && t.resource) {
+		const resource* r = rules->get_resource(t.resource);
+		if(r) {
+			if(r->needed_advance == 0 ||
+					advances->count(r->needed_advance)) {
+				*food = *food + r->food_bonus;
+				*prod = *prod + r->prod_bonus;
+				*comm = *comm + r->comm_bonus;
 			}
 		}
 	}
@@ -495,20 +995,46 @@ void map::get_resources_on_spot(int x, int y, int* food, int* prod, int* comm,
 
 void map::add_unit(unit* u)
 {
-	std::list<unit*>* old = unit_map.get_mod(u->xpos, u->ypos);
-	if(!old)
+	unit** first = unit_map.get_mod(u->xpos, u->ypos);
+	if(!first || u->next_on_spot)
 		return;
-	old->push_back(u);
+	if(*first) {
+		unit* last = (*first)->prev_on_spot;
+		u->next_on_spot = *first;
+		u->prev_on_spot = last;
+		last->next_on_spot = u;
+		(*first)->prev_on_spot = u;
+	}
+	else {
+		u->next_on_spot = u;
+		u->prev_on_spot = u;
+		*first = u;
+	}
+	add_unit_change(u->xpos, u->ypos);
 }
 
 void map::remove_unit(unit* u)
 {
-	std::list<unit*>* old = unit_map.get_mod(u->xpos, u->ypos);
-	if(!old || old->size() == 0)
+	unit** first = unit_map.get_mod(u->xpos, u->ypos);
+	if(!first || !u->next_on_spot)
 		return;
-	old->remove(u);
+	if(u->next_on_spot == u) {
+		*first = NULL;
+	}
+	else {
+		u->prev_on_spot->next_on_spot = u->next_on_spot;
+		u->next_on_spot->prev_on_spot = u->prev_on_spot;
+		if(*first == u)
+			*first = u->next_on_spot;
+	}
+	u->next_on_spot = NULL;
+	u->prev_on_spot = NULL;
+	add_unit_change(u->xpos, u->ypos);
 }
 
+static_assert((int)village_type::max_village_type <= 8,
+		"villages must fit in the tile flags");
+
 void map::add_village(const coord& c)
 {
 	int x = wrap_x(c.x);
@@ -516,37 +1042,42 @@ void map::add_village(const coord& c)
 	if(village_on_spot(x, y) != village_type::none)
 		return;
 
-	int type = rand() % (int)village_type::max_village_type;
-	village_map.set(x, y, type);
+	if(!tiles.in_bounds(x, y))
+		return;
+
+	int type = random_gen((int)village_type::max_village_type);
+	tiles.set_village(tiles.index(x, y), type);
 }
 
 void map::remove_village(const coord& c)
 {
-	village_map.set(c.x, c.y, (int)village_type::none);
+	if(tiles.in_bounds(c.x, c.y))
+		tiles.set_village(tiles.index(c.x, c.y), (int)village_type::none);
 }
 
 village_type map::village_on_spot(int x, int y) const
 {
-	const int* c = village_map.get(wrap_x(x), wrap_y(y));
-	if(!c)
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
 		return village_type::none;
-	return village_type(*c);
+	return village_type(tiles.get_village(tiles.index(x, y)));
 }
 
 int map::get_spot_resident(int x, int y) const
 {
 	x = wrap_x(x);
 	y = wrap_y(y);
-	const std::list<unit*>* val = unit_map.get(x, y);
+	unit* const* val = unit_map.get(x, y);
 	if(!val)
 		return -1;
-	if(val->size() == 0) {
+	if(*val == NULL) {
 		city* const* c = city_map.get(x, y);
 		if(c == NULL || *c == NULL)
 			return -1;
 		return (*c)->civ_id;
 	}
-	return val->front()->civ_id;
+	return (*val)->civ_id;
 }
 
 int map::get_move_cost(const unit& u, int x1, int y1, int x2, int y2, bool* road) const
@@ -585,13 +1116,10 @@ bool map::terrain_allowed(const unit& u, int x, int y) const
 	}
 }
 
-const std::list<unit*>& map::units_on_spot(int x, int y) const
+unit_stack map::units_on_spot(int x, int y) const
 {
-	const std::list<unit*>* us = unit_map.get(wrap_x(x), wrap_y(y));
-	if(us == NULL)
-		return map::empty_unit_spot;
-	else
-		return *us;
+	unit* const* first = unit_map.get(wrap_x(x), wrap_y(y));
+	return unit_stack(first ? *first : NULL);
 }
 
 city* map::city_on_spot(int x, int y) const
@@ -607,13 +1135,13 @@ class land_grabber {
 	int y;
 	float lr;
 	int civid;
-	const map* m;
+	map* m;
 	public:
-		land_grabber(int x_, int y_, float lr_, int civid_, const map* m_) 
+		land_grabber(int x_, int y_, float lr_, int civid_, map* m_) 
 			: x(x_), y(y_), lr(lr_), civid(civid_), m(m_) { }
-		void operator()(buf2d<int>& land_map, int xp, int yp) {
+		void operator()(int xp, int yp) {
 			if(xp == x && yp == y) {
-				land_map.set(xp, yp, civid);
+				m->set_land_owner(civid, xp, yp);
 				return;
 			}
 			int xd = xp - x;
@@ -621,9 +1149,8 @@ class land_grabber {
 			float dist = sqrt(xd * xd + yd * yd);
 			if(dist > lr)
 				return;
-			const int* v = land_map.get(m->wrap_x(xp), m->wrap_y(yp));
-			if(v && *v == -1)
-				land_map.set(m->wrap_x(xp), m->wrap_y(yp), civid);
+			if(m->get_land_owner(xp, yp) == -1)
+				m->set_land_owner(civid, xp, yp);
 		}
 };
 
@@ -633,21 +1160,40 @@ void map::add_city(city* c, int x, int y)
 	y = wrap_y(y);
 	if(city_on_spot(x, y))
 		return;
+	if(!tiles.in_bounds(x, y))
+		return;
 	city_map.set(x, y, c);
-	improv_map.set(x, y, 0x01);
+	tiles.set_city(tiles.index(x, y), true);
+	tiles.set_improvements(tiles.index(x, y), 0x01);
+	hierarchy.invalidate_tile(x, y);
+	add_tile_change(x, y);
 	grab_land(c);
 }
 
 void map::grab_land(city* c)
 {
 	float land_radius = c->culture_level + 0.5f;
+	int radius = land_radius;
 	land_grabber grab(c->xpos, c->ypos, land_radius, c->civ_id, this);
-	mod_rectangle(land_map, c->xpos, c->ypos, land_radius, x_wrap, y_wrap, grab);
+	for(int i = c->xpos - radius; i <= c->xpos + radius; i++) {
+		for(int j = c->ypos - radius; j <= c->ypos + radius; j++) {
+			if(!x_wrap && (i < 0 || i >= size_x()))
+				continue;
+			if(!y_wrap && (j < 0 || j >= size_y()))
+				continue;
+			grab(i, j);
+		}
+	}
 }
 
 void map::remove_city(const city* c)
 {
+	if(!tiles.in_bounds(c->xpos, c->ypos))
+		return;
 	city_map.set(c->xpos, c->ypos, NULL);
+	tiles.set_city(tiles.index(c->xpos, c->ypos), false);
+	hierarchy.invalidate_tile(c->xpos, c->ypos);
+	add_tile_change(c->xpos, c->ypos);
 }
 
 bool map::has_city_of(int x, int y, unsigned int civ_id) const
@@ -669,15 +1215,27 @@ int map::city_owner_on_spot(int x, int y) const
 
 void map::set_land_owner(int civ_id, int x, int y)
 {
-	land_map.set(wrap_x(x), wrap_y(y), civ_id);
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
+		return;
+	int i = tiles.index(x, y);
+	int old = tiles.get_owner(i);
+	if(old != civ_id) {
+		remove_owned_tile(i, old);
+		tiles.set_owner(i, civ_id);
+		add_owned_tile(i, civ_id);
+		add_tile_change(x, y);
+	}
 }
 
 int map::get_land_owner(int x, int y) const
 {
-	const int* v = land_map.get(wrap_x(x), wrap_y(y));
-	if(!v)
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
 		return -1;
-	return *v;
+	return tiles.get_owner(tiles.index(x, y));
 }
 
 int map::get_spot_owner(int x, int y) const
@@ -694,24 +1252,67 @@ int map::get_spot_owner(int x, int y) const
 
 void map::remove_civ_land(unsigned int civ_id)
 {
-	for(int i = 0; i < land_map.size_x; i++) {
-		for(int j = 0; j < land_map.size_y; j++) {
-			if(get_land_owner(i, j) == (int)civ_id) {
-				set_land_owner(-1, i, j);
-			}
-		}
+	if(civ_id >= owned_tiles.size())
+		return;
+	while(!owned_tiles[civ_id].empty()) {
+		int i = owned_tiles[civ_id].back();
+		set_land_owner(-1, i % tiles.size_x(), i / tiles.size_x());
 	}
 }
 
+int map::get_owned_land(unsigned int civ_id) const
+{
+	if(civ_id >= owned_land.size())
+		return 0;
+	return owned_land[civ_id];
+}
+
+void map::index_land_owners()
+{
+	owned_tiles.clear();
+	owned_land.clear();
+	owned_tile_pos.assign(tiles.size_x() * tiles.size_y(), -1);
+	for(unsigned int i = 0; i < owned_tile_pos.size(); i++)
+		add_owned_tile(i, tiles.get_owner(i));
+}
+
+void map::add_owned_tile(int i, int civ_id)
+{
+	if(civ_id < 0)
+		return;
+	if(civ_id >= (int)owned_tiles.size()) {
+		owned_tiles.resize(civ_id + 1);
+		owned_land.resize(civ_id + 1, 0);
+	}
+	owned_tile_pos[i] = owned_tiles[civ_id].size();
+	owned_tiles[civ_id].push_back(i);
+	if(!resconf.is_water_tile(tiles.get_terrain(i)))
+		owned_land[civ_id]++;
+}
+
+void map::remove_owned_tile(int i, int civ_id)
+{
+	if(civ_id < 0)
+		return;
+	std::vector<int>& owned = owned_tiles[civ_id];
+	int last = owned.back();
+	owned[owned_tile_pos[i]] = last;
+	owned_tile_pos[last] = owned_tile_pos[i];
+	owned.pop_back();
+	owned_tile_pos[i] = -1;
+	if(!resconf.is_water_tile(tiles.get_terrain(i)))
+		owned_land[civ_id]--;
+}
+
 std::vector<coord> map::random_starting_places(int num,
-		bool check_resources, unsigned int min_distance) const
+		bool check_resources, unsigned int min_distance)
 {
 	std::vector<coord> retval;
 	int tries = 0;
 	while(tries < num * 1000 && (int)retval.size() < num) {
 		tries++;
-		int xp = rand() % size_x();
-		int yp = rand() % size_y();
+		int xp = random_gen(size_x());
+		int yp = random_gen(size_y());
 		if(resconf.can_found_city_on(get_data(xp, yp))) {
 			coord v(xp, yp);
 			int f, p, c;
@@ -721,20 +1322,18 @@ std::vector<coord> map::random_starting_places(int num,
 			if(check_resources) {
 				int at_least_two_food = 0;
 				int at_least_one_prod = 0;
-				for(int i = -2; i <= 2; i++) {
-					for(int j = -2; j <= 2; j++) {
-						if(abs(i) == 2 && abs(j) == 2)
-							continue;
-
-						int terr = get_data(xp + i, yp + j);
-						int food = 0, prod = 0, comm = 0;
-						get_resources_by_terrain(terr, false,
-								&food, &prod, &comm);
-						if(food >= 2)
-							at_least_two_food++;
-						if(prod >= 1)
-							at_least_one_prod++;
-					}
+				int i = tiles.index(xp, yp);
+				const int* around = tile_neighbourhood.get_city_tiles(xp, yp);
+				for(int k = 0; k < neighbourhood::num_city_tiles; k++) {
+					int terr = around[k] == neighbourhood::off_map ? -1 :
+						tiles.get_terrain(i + around[k]);
+					int food = 0, prod = 0, comm = 0;
+					get_resources_by_terrain(terr, false,
+							&food, &prod, &comm);
+					if(food >= 2)
+						at_least_two_food++;
+					if(prod >= 1)
+						at_least_one_prod++;
 				}
 				if(at_least_two_food < 2)
 					continue;
@@ -818,22 +1417,25 @@ coord map::get_starting_place_of(int civid) const
 
 void map::get_total_city_resources(int x, int y, int* food_points, 
 		int* prod_points, int* comm_points,
-		const std::set<unsigned int>* advances, int cap) const
+		const id_set* advances, int cap) const
 {
 	*food_points = *prod_points = *comm_points = 0;
-	for(int i = -2; i <= 2; i++) {
-		for(int j = -2; j <= 2; j++) {
-			if(abs(i) == 2 && abs(j) == 2)
-				continue;
-
-			int food = 0, prod = 0, comm = 0;
-			get_resources_on_spot(x + i, y + j,
-					&food, &prod, &comm,
-					advances, cap);
-			*food_points += food;
-			*prod_points += prod;
-			*comm_points += comm;
-		}
+	x = wrap_x(x);
+	y = wrap_y(y);
+	if(!tiles.in_bounds(x, y))
+		return;
+	int i = tiles.index(x, y);
+	const int* around = tile_neighbourhood.get_city_tiles(x, y);
+	for(int k = 0; k < neighbourhood::num_city_tiles; k++) {
+		if(around[k] == neighbourhood::off_map)
+			continue;
+		int food = 0, prod = 0, comm = 0;
+		get_yields(tiles.get_yield_tile(i + around[k]),
+				&food, &prod, &comm,
+				advances, cap);
+		*food_points += food;
+		*prod_points += prod;
+		*comm_points += comm;
 	}
 }
 
@@ -841,15 +1443,18 @@ bool map::can_found_city_on(int x, int y) const
 {
 	x = wrap_x(x);
 	y = wrap_y(y);
-	if(city_on_spot(x, y) != NULL)
+	if(!tiles.in_bounds(x, y))
 		return false;
-	if(!resconf.can_found_city_on(get_data(x, y)))
+	int i = tiles.index(x, y);
+	if(tiles.has_city(i))
 		return false;
-	for(int i = -1; i <= 1; i++) {
-		for(int j = -1; j <= 1; j++) {
-			if(city_on_spot(x + i, y + j))
-				return false;
-		}
+	if(!resconf.can_found_city_on(tiles.get_terrain(i)))
+		return false;
+	const int* around = tile_neighbourhood.get_neighbours(x, y);
+	for(int k = 0; k < neighbourhood::num_neighbours; k++) {
+		if(around[k] != neighbourhood::off_map &&
+				tiles.has_city(i + around[k]))
+			return false;
 	}
 	return true;
 }
@@ -876,7 +1481,10 @@ bool map::try_improve_terrain(int x, int y,
 	int old = get_improvements_on(x, y);
 	if(i != improv_road)
 		old &= 0x01; // leave road, destroy rest
-	improv_map.set(x, y, old | i);
+	tiles.set_improvements(tiles.index(x, y), old | i);
+	if(i == improv_road)
+		hierarchy.invalidate_road(x, y);
+	add_tile_change(x, y);
 	return true;
 }
 
@@ -884,10 +1492,9 @@ int map::get_improvements_on(int x, int y) const
 {
 	x = wrap_x(x);
 	y = wrap_y(y);
-	const int* v = improv_map.get(x, y);
-	if(!v)
+	if(!tiles.in_bounds(x, y))
 		return 0;
-	return *v;
+	return tiles.get_improvements(tiles.index(x, y));
 }
 
 int map::get_needed_turns_for_improvement(improvement_type i) const
@@ -934,11 +1541,11 @@ int map::vector_from_to_x(int x1, int x2) const
 	if(x_wrap) {
 		x1 = wrap_x(x1);
 		x2 = wrap_x(x2);
-		if(x1 > data.size_x * 3 / 4 && x2 < data.size_x / 4) {
-			x2 += data.size_x;
+		if(x1 > tiles.size_x() * 3 / 4 && x2 < tiles.size_x() / 4) {
+			x2 += tiles.size_x();
 		}
-		else if(x2 > data.size_x * 3 / 4 && x1 < data.size_x / 4) {
-			x1 += data.size_x;
+		else if(x2 > tiles.size_x() * 3 / 4 && x1 < tiles.size_x() / 4) {
+			x1 += tiles.size_x();
 		}
 	}
 	return x1 - x2;
@@ -949,11 +1556,11 @@ int map::vector_from_to_y(int y1, int y2) const
 	if(y_wrap) {
 		y1 = wrap_y(y1);
 		y2 = wrap_y(y2);
-		if(y1 > data.size_y * 3 / 4 && y2 < data.size_y / 4) {
-			y2 += data.size_y;
+		if(y1 > tiles.size_y() * 3 / 4 && y2 < tiles.size_y() / 4) {
+			y2 += tiles.size_y();
 		}
-		else if(y2 > data.size_y * 3 / 4 && y1 < data.size_y / 4) {
-			y1 += data.size_y;
+		else if(y2 > tiles.size_y() * 3 / 4 && y1 < tiles.size_y() / 4) {
+			y1 += tiles.size_y();
 		}
 	}
 	return y1 - y2;
@@ -961,14 +1568,141 @@ int map::vector_from_to_y(int y1, int y2) const
 
 void map::resize(int x, int y)
 {
-	data = buf2d<int>(x, y, 0);
-	unit_map = buf2d<std::list<unit*> >(x, y, std::list<unit*>());
-	city_map = buf2d<city*>(x, y, NULL);
-	land_map = buf2d<int>(x, y, -1);
-	improv_map = buf2d<int>(x, y, 0);
-	res_map = buf2d<int>(x, y, 0);
-	river_map = buf2d<bool>(x, y, false);
+	tiles = tile_store(x, y, 0);
+	tiles.enable_yield_tiles();
+	unit_map = buf2d<unit*, map_layout>(x, y, NULL);
+	city_map = buf2d<city*, map_layout>(x, y, NULL);
 	starting_places.clear();
+	update_neighbourhood();
 	init_to_water();
+	index_land_owners();
+	hierarchy.invalidate_all();
+	drop_tile_changes();
+	drop_unit_changes();
+}
+
+void map::get_unit_stacks(buf2d<std::list<unit*> >& stacks) const
+{
+	stacks = buf2d<std::list<unit*> >(size_x(), size_y(), std::list<unit*>());
+	auto add_stack = [&stacks](int x, int y, unit* first) {
+		if(first) {
+			unit_stack us(first);
+			stacks.get_mod(x, y)->assign(us.begin(), us.end());
+		}
+	};
+	unit_map.for_rectangle(0, 0, unit_map.size_x - 1, unit_map.size_y - 1,
+			add_stack);
+}
+
+void map::set_unit_stacks(const buf2d<std::list<unit*> >& stacks)
+{
+	unit_map = buf2d<unit*, map_layout>(stacks.size_x, stacks.size_y, NULL);
+	for(int y = 0; y < stacks.size_y; y++) {
+		for(int x = 0; x < stacks.size_x; x++) {
+			const std::list<unit*>* us = stacks.get(x, y);
+			for(std::list<unit*>::const_iterator it = us->begin();
+					it != us->end();
+					++it) {
+				add_unit(*it);
+			}
+		}
+	}
+}
+
+// The cities, the yield tiles and the ruleset aren't saved with the
+// tiles.
+void map::tiles_loaded()
+{
+	auto mark_city = [this](int x, int y, city* c) {
+		if(c)
+			tiles.set_city(tiles.index(x, y), true);
+	};
+	city_map.for_rectangle(0, 0, city_map.size_x - 1, city_map.size_y - 1,
+			mark_city);
+	tiles.enable_yield_tiles();
+	update_neighbourhood();
+	rules.reset(new ruleset(resconf, rmap));
+	index_land_owners();
+}
+
+void map::update_neighbourhood()
+{
+	tile_neighbourhood = neighbourhood(tiles.size_x(), tiles.size_y(),
+			x_wrap, y_wrap);
+}
+
+const neighbourhood& map::get_neighbourhood() const
+{
+	return tile_neighbourhood;
+}
+
+const ruleset& map::get_ruleset() const
+{
+	return *rules;
+}
+
+// Appends the tiles of a journal from pos on, pos counting the dropped
+// entries too.
+static bool read_journal(const std::vector<uint32_t>& journal,
+		unsigned int dropped, int sx, unsigned int& pos,
+		std::vector<coord>& changed)
+{
+	unsigned int end = dropped + journal.size();
+	if(pos < dropped || pos > end) {
+		pos = end;
+		return false;
+	}
+	for(unsigned int i = pos - dropped; i < journal.size(); i++)
+		changed.push_back(coord(journal[i] % sx, journal[i] / sx));
+	pos = end;
+	return true;
+}
+
+bool map::get_tile_changes(unsigned int& pos, std::vector<coord>& changed) const
+{
+	return read_journal(tile_changes, dropped_tile_changes, size_x(),
+			pos, changed);
+}
+
+// More changes than tiles are cheaper to follow by rebuilding, as the
+// readers do when the changes have been dropped, e.g. after the land
+// owners were updated from scratch.
+void map::add_tile_change(int x, int y)
+{
+	if((int)tile_changes.size() >= size_x() * size_y())
+		drop_tile_changes();
+	tile_changes.push_back(y * size_x() + x);
+}
+
+void map::drop_tile_changes()
+{
+	dropped_tile_changes += tile_changes.size();
+	tile_changes.clear();
+}
+
+bool map::get_unit_changes(unsigned int& pos, std::vector<coord>& changed) const
+{
+	return read_journal(unit_changes, dropped_unit_changes, size_x(),
+			pos, changed);
+}
+
+// two entries per move; a reader that missed more than a map's worth
+// checks all its tiles instead
+void map::add_unit_change(int x, int y)
+{
+	if((int)unit_changes.size() >= size_x() * size_y())
+		drop_unit_changes();
+	unit_changes.push_back(y * size_x() + x);
+}
+
+void map::drop_unit_changes()
+{
+	dropped_unit_changes += unit_changes.size();
+	unit_changes.clear();
+}
+
+map_hierarchy& map::get_hierarchy() const
+{
+	return hierarchy;
 }
 
@@ -2,6 +2,8 @@
 #define CIV_MAP_H
 
 #include <set>
+#include <memory>
+#include <stdint.h>
 
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
@@ -10,10 +12,24 @@
 
 #include "unit.h"
 #include "coord.h"
+#include "id-set.h"
 #include "buf2d.h"
 #include "resource.h"
 #include "resource_configuration.h"
 #include "city.h"
+#include "map-hierarchy.h"
+#include "tile-store.h"
+#include "neighbourhood.h"
+#include "rng.h"
+#include "ruleset.h"
+
+// The layout of the per tile layers kept in buf2ds. The tile store, the
+// fog and the neighbourhoods index the tiles row by row whatever this is.
+#ifdef TILED_MAP_LAYERS
+typedef tiled_layout map_layout;
+#else
+typedef row_major_layout map_layout;
+#endif
 
 enum class village_type {
 	none,
@@ -32,7 +48,12 @@ class map {
 		map(int x, int y, const resource_configuration& resconf_,
 				const resource_map& rmap_);
 		map(); // for serialization
-		void create();
+		// Generates the map with the random numbers drawn from the seed.
+		void create(unsigned int seed);
+		// Generates the map in chunks, each with its own random numbers
+		// drawn from the seed, so that the map is the same however many
+		// threads (0 = one per core) generate it.
+		void create_parallel(unsigned int seed, unsigned int num_threads);
 		void add_random_resources();
 		int get_data(int x, int y) const;
 		void set_data(int x, int y, int terr);
@@ -40,10 +61,10 @@ class map {
 		int size_y() const;
 		void get_resources_by_terrain(int terr, bool city, int* food, int* prod, int* comm) const;
 		void get_resources_on_spot(int x, int y, int* food, int* prod, int* comm,
-				const std::set<unsigned int>* advances, int cap) const;
+				const id_set* advances, int cap) const;
 		void get_total_city_resources(int x, int y, int* food_points,
 				int* prod_points, int* comm_points,
-				const std::set<unsigned int>* advances, int cap) const;
+				const id_set* advances, int cap) const;
 		unsigned int get_resource(int x, int y) const;
 		void set_resource(int x, int y, unsigned int res);
 		void add_unit(unit* u);
@@ -55,7 +76,7 @@ class map {
 		void set_river(int x, int y, bool riv);
 		int get_spot_owner(int x, int y) const; // land, unit or city
 		int get_spot_resident(int x, int y) const; // unit or city
-		const std::list<unit*>& units_on_spot(int x, int y) const;
+		unit_stack units_on_spot(int x, int y) const;
 		city* city_on_spot(int x, int y) const;
 		int city_owner_on_spot(int x, int y) const;
 		bool has_city_of(int x, int y, unsigned int civ_id) const;
@@ -67,10 +88,12 @@ class map {
 		void set_land_owner(int civ_id, int x, int y);
 		int get_land_owner(int x, int y) const;
 		void remove_civ_land(unsigned int civ_id);
+		// the tiles that aren't water owned by the civ
+		int get_owned_land(unsigned int civ_id) const;
 		int wrap_x(int x) const;
 		int wrap_y(int y) const;
 		std::vector<coord> random_starting_places(int num,
-				bool check_resources, unsigned int min_distance) const;
+				bool check_resources, unsigned int min_distance);
 		std::map<int, coord> get_starting_places() const;
 		int get_starter_at(int x, int y) const;
 		void add_starting_place(const coord& c, int civid);
@@ -94,42 +117,133 @@ class map {
 		int vector_from_to_x(int x1, int x2) const;
 		int vector_from_to_y(int y1, int y2) const;
 		void resize(int newx, int newy);
+		map_hierarchy& get_hierarchy() const;
+		const neighbourhood& get_neighbourhood() const;
+		// of the terrain and the resources only
+		const ruleset& get_ruleset() const;
+		// Appends the tiles whose terrain, improvements, cities, resources
+		// or land owners changed since pos and moves pos past them. Returns false if some of the
+		// changes have been dropped since.
+		bool get_tile_changes(unsigned int& pos, std::vector<coord>& changed) const;
+		// The same for the tiles units were put on or taken off.
+		bool get_unit_changes(unsigned int& pos, std::vector<coord>& changed) const;
 	private:
+		// the range of dist_to_sea_incl_mountains() for each tile
+		struct sea_distances {
+			buf2d<int, map_layout> min;
+			buf2d<int, map_layout> max;
+		};
+		void add_tile_change(int x, int y);
+		void add_unit_change(int x, int y);
+		void tiles_loaded();
+		void get_unit_stacks(buf2d<std::list<unit*> >& stacks) const;
+		void set_unit_stacks(const buf2d<std::list<unit*> >& stacks);
+		void update_neighbourhood();
+		void get_yields(const yield_tile& t, int* food, int* prod, int* comm,
+				const id_set* advances, int cap) const;
+		void drop_tile_changes();
+		void drop_unit_changes();
+		void index_land_owners();
+		void add_owned_tile(int i, int civ_id);
+		void remove_owned_tile(int i, int civ_id);
 		void init_to_water();
 		int get_index(int x, int y) const;
 		void create_mountains(int x, int y, int width);
-		int get_temperature(int x, int y) const;
+		int get_temperature(int x, int y, const sea_distances& sd) const;
+		int temperature_at(int y, int dist_to_sea) const;
 		std::vector<int> get_types_by_temperature(int temp) const;
-		int get_humidity_at(int x, int y) const;
+		int get_humidity_at(int x, int y, const sea_distances& sd) const;
+		int humidity_at(int y, int dist_to_sea) const;
 		std::vector<int> get_terrain_candidates(const std::vector<int>& types, 
 				int humidity) const;
 		float get_latitude(int y) const;
 		void sea_around_land(int x, int y, int sea_tile);
+		template<typename Random>
+		int random_terrain(int x, int y, const sea_distances& sd,
+				Random& rnd) const;
+		template<typename Random>
+		bool random_river(int x, int y, const sea_distances& sd,
+				Random& rnd, std::vector<coord>& path) const;
+		template<typename Random>
+		bool random_resource(int x, int y, Random& rnd,
+				unsigned int* res) const;
 		int dist_to_sea_incl_mountains(int x, int y) const;
-		buf2d<int> data;
-		buf2d<std::list<unit*> > unit_map;
-		buf2d<city*> city_map;
-		buf2d<int> land_map;
-		buf2d<int> improv_map;
-		buf2d<int> res_map;
-		buf2d<bool> river_map;
+		void get_sea_distances(sea_distances& sd) const;
+		void get_sea_distances(sea_distances& sd, int x0, int y0,
+				int x1, int y1, int radius) const;
+		tile_store tiles;
+		// the first unit on each tile; the units link to the others
+		buf2d<unit*, map_layout> unit_map;
+		buf2d<city*, map_layout> city_map;
 		std::map<int, coord> starting_places;
-		buf2d<int> village_map;
 	public:
 		const resource_configuration resconf;
 		const resource_map rmap;
 	private:
 		bool x_wrap;
 		bool y_wrap;
-		static const std::list<unit*> empty_unit_spot;
+		// for the villages and the starting places once the map is
+		// created
+		rng random_gen;
+		neighbourhood tile_neighbourhood; // not serialized
+		std::shared_ptr<const ruleset> rules; // not serialized
+		mutable map_hierarchy hierarchy; // not serialized, rebuilt on demand
+		// tile indices, at most a map's worth each; not serialized
+		std::vector<uint32_t> tile_changes;
+		std::vector<uint32_t> unit_changes;
+		// the tiles of each land owner by civ id, the place of each
+		// tile in the list of its owner and the number of the tiles
+		// that aren't water; not serialized
+		std::vector<std::vector<int> > owned_tiles;
+		std::vector<int> owned_tile_pos;
+		std::vector<int> owned_land;
+		unsigned int dropped_tile_changes;
+		unsigned int dropped_unit_changes;
 
 		friend class boost::serialization::access;
+		// the tiles and the units are saved in the layers they were
+		// once kept in
+		template<class Archive>
+		void save(Archive& ar, const unsigned int version) const
+		{
+			buf2d<std::list<unit*> > stacks;
+			get_unit_stacks(stacks);
+			buf2d<int> data;
+			buf2d<int> land_map;
+			buf2d<int> improv_map;
+			buf2d<int> res_map;
+			buf2d<bool> river_map;
+			buf2d<int> village_map;
+			tiles.to_buffers(data, land_map, improv_map, res_map,
+					river_map, village_map);
+			ar & data;
+			ar & stacks;
+			save_rows(ar, city_map);
+			ar & land_map;
+			ar & improv_map;
+			ar & res_map;
+			ar & river_map;
+			ar & starting_places;
+			ar & village_map;
+			ar & resconf;
+			ar & rmap;
+			ar & x_wrap;
+			ar & y_wrap;
+			ar & random_gen;
+		}
 		template<class Archive>
-		void serialize(Archive& ar, const unsigned int version)
+		void load(Archive& ar, const unsigned int version)
 		{
+			buf2d<std::list<unit*> > stacks;
+			buf2d<int> data;
+			buf2d<int> land_map;
+			buf2d<int> improv_map;
+			buf2d<int> res_map;
+			buf2d<bool> river_map;
+			buf2d<int> village_map;
 			ar & data;
-			ar & unit_map;
-			ar & city_map;
+			ar & stacks;
+			load_rows(ar, city_map);
 			ar & land_map;
 			ar & improv_map;
 			ar & res_map;
@@ -137,14 +251,23 @@ class map {
 			ar & starting_places;
 			if(version > 0)
 				ar & village_map;
+			else
+				village_map = buf2d<int>(data.size_x, data.size_y, 0);
 			ar & const_cast<resource_configuration&>(resconf);
 			ar & const_cast<resource_map&>(rmap);
 			ar & x_wrap;
 			ar & y_wrap;
+			if(version > 1)
+				ar & random_gen;
+			tiles.from_buffers(data, land_map, improv_map, res_map,
+					river_map, village_map);
+			set_unit_stacks(stacks);
+			tiles_loaded();
 		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER();
 };
 
-BOOST_CLASS_VERSION(map, 1)
+BOOST_CLASS_VERSION(map, 2)
 
 #endif
 
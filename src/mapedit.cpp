@@ -42,7 +42,7 @@ void run_editor()
 			&resconf, &govmap, &rmap);
 	map m(map_x, map_y, resconf, rmap);
 	pompelmous r(uconfmap, amap, cimap, govmap, &m, road_moves,
-			food_eaten_per_citizen, anarchy_period, num_turns);
+			food_eaten_per_citizen, anarchy_period, num_turns, 0);
 	for(unsigned int i = 0; i < civs.size(); i++) {
 		civs[i]->set_map(&m);
 		civs[i]->set_government(&govmap.begin()->second);
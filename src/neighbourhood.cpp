@@ -0,0 +1,81 @@
+#include "neighbourhood.h"
+
+const int neighbourhood::city_offsets[num_city_tiles][2] = {
+	{-2, -1}, {-2, 0}, {-2, 1},
+	{-1, -2}, {-1, -1}, {-1, 0}, {-1, 1}, {-1, 2},
+	{0, -2}, {0, -1}, {0, 0}, {0, 1}, {0, 2},
+	{1, -2}, {1, -1}, {1, 0}, {1, 1}, {1, 2},
+	{2, -1}, {2, 0}, {2, 1},
+};
+
+const int neighbourhood::neighbour_offsets[num_neighbours][2] = {
+	{-1, -1}, {-1, 0}, {-1, 1},
+	{0, -1}, {0, 1},
+	{1, -1}, {1, 0}, {1, 1},
+};
+
+// The tile of the class to work the differences out from, or -1 if no
+// tile is in the class on a map this small.
+static int class_tile(int cls, int size)
+{
+	int v = cls < 3 ? cls : size - 5 + cls;
+	if(v < 0 || v >= size)
+		return -1;
+	if(cls == 2 && v >= size - 2)
+		return -1;
+	if(cls > 2 && v < 2)
+		return -1;
+	return v;
+}
+
+// -1 if off the map
+static int step(int v, int d, int size, bool wrap)
+{
+	v += d;
+	if(wrap)
+		return ((v % size) + size) % size;
+	return v >= 0 && v < size ? v : -1;
+}
+
+template<int N>
+static void fill_differences(int x, int y, int sx, int sy,
+		bool x_wrap, bool y_wrap, const int (&offsets)[N][2], int* diffs)
+{
+	for(int k = 0; k < N; k++) {
+		int nx = x == -1 ? -1 : step(x, offsets[k][0], sx, x_wrap);
+		int ny = y == -1 ? -1 : step(y, offsets[k][1], sy, y_wrap);
+		if(nx == -1 || ny == -1)
+			diffs[k] = neighbourhood::off_map;
+		else
+			diffs[k] = (ny * sx + nx) - (y * sx + x);
+	}
+}
+
+neighbourhood::neighbourhood(int x, int y, bool x_wrap, bool y_wrap)
+	: sx(x),
+	sy(y)
+{
+	for(int cx = 0; cx < 5; cx++) {
+		for(int cy = 0; cy < 5; cy++) {
+			int tx = class_tile(cx, sx);
+			int ty = class_tile(cy, sy);
+			fill_differences(tx, ty, sx, sy, x_wrap, y_wrap,
+					city_offsets, city_tiles[cx * 5 + cy]);
+			fill_differences(tx, ty, sx, sy, x_wrap, y_wrap,
+					neighbour_offsets, neighbours[cx * 5 + cy]);
+		}
+	}
+}
+
+neighbourhood::neighbourhood()
+	: sx(0),
+	sy(0)
+{
+	for(int c = 0; c < 25; c++) {
+		for(int k = 0; k < num_city_tiles; k++)
+			city_tiles[c][k] = off_map;
+		for(int k = 0; k < num_neighbours; k++)
+			neighbours[c][k] = off_map;
+	}
+}
+
@@ -0,0 +1,55 @@
+#ifndef NEIGHBOURHOOD_H
+#define NEIGHBOURHOOD_H
+
+#include <limits.h>
+
+// The tiles around a tile of a map as differences of tile indices,
+// wrapped as the map wraps: the 8 neighbours and the 21 tiles of the
+// city radius, i.e. the 5x5 square less its corners. The differences
+// are the same for all the tiles but those within two tiles of an edge,
+// so they're kept for the 5x5 classes of tiles by their nearness to the
+// edges.
+class neighbourhood {
+	public:
+		neighbourhood(int x, int y, bool x_wrap, bool y_wrap);
+		neighbourhood();
+		// for (x, y) on the map, in the order of city_offsets; off_map
+		// for the tiles off an unwrapped map
+		const int* get_city_tiles(int x, int y) const;
+		// for (x, y) on the map, in the order of neighbour_offsets
+		const int* get_neighbours(int x, int y) const;
+		static const int num_city_tiles = 21;
+		static const int num_neighbours = 8;
+		static const int off_map = INT_MIN;
+		// x and y, by x first as the loops over the tiles go
+		static const int city_offsets[num_city_tiles][2];
+		static const int neighbour_offsets[num_neighbours][2];
+	private:
+		static int edge_class(int v, int size);
+		int sx;
+		int sy;
+		int city_tiles[25][num_city_tiles];
+		int neighbours[25][num_neighbours];
+};
+
+inline int neighbourhood::edge_class(int v, int size)
+{
+	if(v < 2)
+		return v;
+	if(v >= size - 2)
+		return 4 - (size - 1 - v);
+	return 2;
+}
+
+inline const int* neighbourhood::get_city_tiles(int x, int y) const
+{
+	return city_tiles[edge_class(x, sx) * 5 + edge_class(y, sy)];
+}
+
+inline const int* neighbourhood::get_neighbours(int x, int y) const
+{
+	return neighbours[edge_class(x, sx) * 5 + edge_class(y, sy)];
+}
+
+#endif
+
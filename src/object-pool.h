@@ -0,0 +1,83 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <vector>
+#include <mutex>
+#include <type_traits>
+#include <new>
+
+// Memory for the objects of one type, taken a chunk of many objects at a
+// time so that creating and destroying them doesn't go to the heap each
+// time. The memory freed is reused first. For the class specific
+// operator new and delete of T; the chunks are never freed.
+template<typename T>
+class object_pool {
+	public:
+		static void* allocate(size_t sz);
+		static void deallocate(void* p, size_t sz);
+	private:
+		object_pool();
+		static object_pool& instance();
+		union block {
+			block* next;
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		};
+		static const int blocks_per_chunk = 256;
+		std::vector<block*> chunks;
+		block* free_blocks;
+		std::mutex mutex;
+};
+
+template<typename T>
+object_pool<T>::object_pool()
+	: free_blocks(NULL)
+{
+}
+
+template<typename T>
+object_pool<T>& object_pool<T>::instance()
+{
+	// never destroyed, as objects may be deleted at exit
+	static object_pool<T>* pool = new object_pool<T>();
+	return *pool;
+}
+
+template<typename T>
+void* object_pool<T>::allocate(size_t sz)
+{
+	// a class derived from T is bigger
+	if(sz != sizeof(T))
+		return ::operator new(sz);
+	object_pool<T>& p = instance();
+	std::lock_guard<std::mutex> lock(p.mutex);
+	if(!p.free_blocks) {
+		block* chunk = new block[blocks_per_chunk];
+		p.chunks.push_back(chunk);
+		for(int i = blocks_per_chunk - 1; i >= 0; i--) {
+			chunk[i].next = p.free_blocks;
+			p.free_blocks = &chunk[i];
+		}
+	}
+	block* b = p.free_blocks;
+	p.free_blocks = b->next;
+	return b;
+}
+
+template<typename T>
+void object_pool<T>::deallocate(void* ptr, size_t sz)
+{
+	if(!ptr)
+		return;
+	if(sz != sizeof(T)) {
+		::operator delete(ptr);
+		return;
+	}
+	object_pool<T>& p = instance();
+	std::lock_guard<std::mutex> lock(p.mutex);
+	block* b = static_cast<block*>(ptr);
+	b->next = p.free_blocks;
+	p.free_blocks = b;
+}
+
+#endif
+
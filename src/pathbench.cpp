@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iterator>
+#include <new>
+
+#include "pompelmous.h"
+#include "parse_rules.h"
+#include "map-astar.h"
+#include "map-graph.h"
+#include "rng.h"
+
+void usage(char* pn)
+{
+	fprintf(stderr, "Usage: %s [-r <ruleset name>] [-s <seed>] [-x <width>] [-y <height>] [-n <queries>] [-d]\n\n", pn);
+	fprintf(stderr, "\tRuns the A* search of the land units between random pairs of land tiles\n");
+	fprintf(stderr, "\ton a generated map and prints the tiles expanded per second and the\n");
+	fprintf(stderr, "\tnumber of allocations made.\n\n");
+	fprintf(stderr, "\t-r ruleset:         use custom ruleset\n");
+	fprintf(stderr, "\t-s seed:            seed of the map and of the queries (default: 1)\n");
+	fprintf(stderr, "\t-x width:           map width (default: 180)\n");
+	fprintf(stderr, "\t-y height:          map height (default: 99)\n");
+	fprintf(stderr, "\t-n queries:         number of queries (default: 500)\n");
+	fprintf(stderr, "\t-d:                 also compare replanning along the paths with\n");
+	fprintf(stderr, "\t                    map_dstar() to searching anew\n");
+}
+
+static std::string ruleset_name = "default";
+static unsigned int seed = 1;
+static int size_x = 180;
+static int size_y = 99;
+static int num_queries = 500;
+static bool replans = false;
+
+static unsigned long allocations = 0;
+
+void* operator new(std::size_t size)
+{
+	allocations++;
+	void* p = malloc(size);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+// counts the tiles expanded, the goal being tested once for each
+class counting_goal {
+	public:
+		counting_goal(const coord& goal_, unsigned long* expanded_)
+			: goal(goal_), expanded(expanded_) { }
+		bool operator()(const coord& a) const
+		{
+			(*expanded)++;
+			return a == goal;
+		}
+	private:
+		coord goal;
+		unsigned long* expanded;
+};
+
+static int path_cost(const std::list<coord>& path, const map_cost_t& cost)
+{
+	int ret = 0;
+	if(path.empty())
+		return ret;
+	std::list<coord>::const_iterator prev = path.begin();
+	for(std::list<coord>::const_iterator it = ++path.begin();
+			it != path.end();
+			++it) {
+		ret += cost(*prev, *it);
+		prev = it;
+	}
+	return ret;
+}
+
+// Follows the path of each query, turning the tile three steps ahead into
+// water every two steps up to ten times, and finds the path again both
+// with the replanner and with A* as map_astar() runs it.
+void run_replans(map& m, const civilization& civ, const unit& u,
+		const std::vector<std::pair<coord, coord> >& queries, int water)
+{
+	unsigned long num_replans = 0;
+	unsigned long dstar_expanded = 0;
+	unsigned long astar_expanded = 0;
+	unsigned long costlier = 0;
+	double dstar_secs = 0.0;
+	double astar_secs = 0.0;
+	map_cost_t cost(m, u, false);
+	for(unsigned int i = 0; i < queries.size(); i++) {
+		const coord& goal = queries[i].second;
+		map_replanner* planner = map_dstar(civ, u, false, goal);
+		std::list<coord> path = planner->find(queries[i].first);
+		std::vector<std::pair<coord, int> > blocked;
+		for(int k = 0; k < 10 && path.size() > 5; k++) {
+			path.pop_front();
+			path.pop_front();
+			coord pos = path.front();
+			std::list<coord>::const_iterator it = path.begin();
+			std::advance(it, 3);
+			if(*it == goal)
+				break;
+			blocked.push_back(std::make_pair(*it, m.get_data(it->x, it->y)));
+			m.set_data(it->x, it->y, water);
+
+			unsigned int expansions = planner->get_expansions();
+			auto start = std::chrono::steady_clock::now();
+			path = planner->find(pos);
+			dstar_secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			dstar_expanded += planner->get_expansions() - expansions;
+
+			start = std::chrono::steady_clock::now();
+			std::list<coord> plain = make_astar(land_graph(civ, u, false, NULL),
+					cost, manhattan_heur(goal),
+					counting_goal(goal, &astar_expanded)).find(
+						m.size_x(), m.size_y(), pos);
+			astar_secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			if(path.empty() != plain.empty() ||
+					path_cost(path, cost) > path_cost(plain, cost))
+				costlier++;
+			num_replans++;
+			if(path.empty())
+				break;
+		}
+		for(std::vector<std::pair<coord, int> >::reverse_iterator it = blocked.rbegin();
+				it != blocked.rend();
+				++it) {
+			m.set_data(it->first.x, it->first.y, it->second);
+		}
+		delete planner;
+	}
+	if(!num_replans)
+		return;
+	printf("%-20s: %lu\n", "Replans", num_replans);
+	printf("%-20s: %.1f tiles, %.3f ms per replan\n", "D* replanning",
+			dstar_expanded / (double)num_replans,
+			dstar_secs * 1000.0 / num_replans);
+	printf("%-20s: %.1f tiles, %.3f ms per replan\n", "A* anew",
+			astar_expanded / (double)num_replans,
+			astar_secs * 1000.0 / num_replans);
+	printf("%-20s: %lu\n", "Costlier D* paths", costlier);
+}
+
+void run_queries()
+{
+	resource_configuration resconf;
+	resource_map rmap;
+	unit_configuration_map uconfmap;
+	advance_map amap;
+	city_improv_map cimap;
+	government_map govmap;
+	std::vector<civilization*> civs;
+	get_configuration(ruleset_name, &civs, &uconfmap, &amap, &cimap,
+			&resconf, &govmap, &rmap);
+
+	map m(size_x, size_y, resconf, rmap);
+	m.create(seed);
+
+	std::vector<coord> land;
+	int water = -1;
+	for(int j = 0; j < size_y; j++) {
+		for(int i = 0; i < size_x; i++) {
+			if(!resconf.is_water_tile(m.get_data(i, j)))
+				land.push_back(coord(i, j));
+			else
+				water = m.get_data(i, j);
+		}
+	}
+	if(land.empty())
+		throw std::runtime_error("No land on the map");
+
+	civilization* civ = civs[0];
+	civ->civ_id = 0;
+	civ->set_map(&m);
+	civ->set_government(&govmap.begin()->second);
+	civ->set_city_improvement_map(&cimap);
+	unit* u = civ->add_unit(WARRIOR_UNIT_CONFIGURATION_ID,
+			land[0].x, land[0].y,
+			uconfmap.find(WARRIOR_UNIT_CONFIGURATION_ID)->second, 3);
+	// the civ knows the whole map
+	fog_of_war& fog = const_cast<fog_of_war&>(civ->get_fog());
+	for(int j = 0; j < size_y; j++) {
+		for(int i = 0; i < size_x; i++) {
+			fog.reveal(i, j, 0);
+			fog.shade(i, j, 0);
+		}
+	}
+
+	rng r(seed);
+	std::vector<std::pair<coord, coord> > queries;
+	for(int tries = 0; (int)queries.size() < num_queries && tries < 100 * num_queries; tries++) {
+		const coord& a = land[r(land.size())];
+		const coord& b = land[r(land.size())];
+		if(m.manhattan_distance(a.x, a.y, b.x, b.y) >= 10 &&
+				map_connected(m, *u, a, b))
+			queries.push_back(std::make_pair(a, b));
+	}
+
+	unsigned long expanded = 0;
+	unsigned long path_length = 0;
+	unsigned long allocations_before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	for(unsigned int i = 0; i < queries.size(); i++) {
+		std::list<coord> path = make_astar(land_graph(*civ, *u, false, NULL),
+				map_cost_t(m, *u, false),
+				manhattan_heur(queries[i].second),
+				counting_goal(queries[i].second, &expanded)).find(
+					size_x, size_y, queries[i].first);
+		path_length += path.size();
+	}
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	unsigned long search_allocations = allocations - allocations_before;
+
+	printf("Map %dx%d, seed %u: %zu queries\n", size_x, size_y, seed, queries.size());
+	printf("%-20s: %lu\n", "Tiles expanded", expanded);
+	printf("%-20s: %lu\n", "Path tiles", path_length);
+	printf("%-20s: %lu (%.1f per query)\n", "Allocations", search_allocations,
+			search_allocations / (double)queries.size());
+	printf("%-20s: %.3f ms\n", "Time", secs * 1000.0);
+	printf("%-20s: %.0f\n", "Tiles per second", expanded / secs);
+
+	if(replans && water != -1)
+		run_replans(m, *civ, *u, queries, water);
+}
+
+int main(int argc, char** argv)
+{
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+			usage(argv[0]);
+			exit(2);
+		}
+		else if(i + 1 < argc && !strcmp(argv[i], "-r")) {
+			ruleset_name = std::string(argv[++i]);
+		}
+		else if(i + 1 < argc && !strcmp(argv[i], "-s")) {
+			seed = atoi(argv[++i]);
+		}
+		else if(i + 1 < argc && !strcmp(argv[i], "-x")) {
+			size_x = atoi(argv[++i]);
+		}
+		else if(i + 1 < argc && !strcmp(argv[i], "-y")) {
+			size_y = atoi(argv[++i]);
+		}
+		else if(i + 1 < argc && !strcmp(argv[i], "-n")) {
+			num_queries = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "-d")) {
+			replans = true;
+		}
+		else {
+			fprintf(stderr, "Unknown option '%s'.\n", argv[i]);
+			usage(argv[0]);
+			exit(2);
+		}
+	}
+	if(size_x <= 0 || size_y <= 0 || num_queries <= 0) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	try {
+		run_queries();
+	}
+	catch (std::exception& e) {
+		printf("std::exception: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -118,7 +118,8 @@ pompelmous::pompelmous(const unit_configuration_map& uconfmap_,
 		map* m_, unsigned int road_moves_,
 		unsigned int food_eaten_per_citizen_,
 		unsigned int anarchy_period_turns_,
-		int num_turns_)
+		int num_turns_,
+		unsigned int seed)
 	: uconfmap(uconfmap_),
 	amap(amap_),
 	cimap(cimap_),
@@ -130,9 +131,11 @@ pompelmous::pompelmous(const unit_configuration_map& uconfmap_,
 	anarchy_period_turns(anarchy_period_turns_),
 	num_turns(num_turns_),
 	winning_civ(-1),
-	victory(victory_none)
+	victory(victory_none),
+	random_root(seed)
 {
 	current_civ = civs.begin();
+	compile_ruleset();
 }
 
 pompelmous::pompelmous()
@@ -147,8 +150,26 @@ void pompelmous::add_diplomat(int civid, diplomat* d)
 	diplomat_handlers[civid] = d;
 }
 
+// The tables point to the rules of this game and of its map.
+void pompelmous::compile_ruleset()
+{
+	rules.reset(new ruleset(m->resconf, m->rmap, uconfmap, amap,
+				cimap, govmap));
+	for(std::vector<civilization*>::iterator it = civs.begin();
+			it != civs.end();
+			++it) {
+		(*it)->set_ruleset(rules);
+	}
+}
+
+const ruleset& pompelmous::get_ruleset() const
+{
+	return *rules;
+}
+
 void pompelmous::add_civilization(civilization* civ)
 {
+	civ->set_ruleset(rules);
 	civs.push_back(civ);
 	current_civ = civs.begin();
 	refill_moves();
@@ -159,23 +180,62 @@ void pompelmous::add_village(const coord& c)
 	m->add_village(c);
 }
 
-void pompelmous::refill_moves()
+void pompelmous::set_round_threads(unsigned int num)
+{
+	round_pool.reset(new thread_pool(num));
+}
+
+// A civ changes only its own state and its own units and cities, and
+// reads the map, while the changes it makes to the map wait until all
+// the civs are done and are then made in the order of the civs.
+void pompelmous::for_each_civ(const std::function<void(civilization*)>& func)
 {
+	if(!round_pool || round_pool->get_num_threads() < 2 || civs.size() < 2) {
+		for(std::vector<civilization*>::iterator it = civs.begin();
+				it != civs.end();
+				++it) {
+			func(*it);
+		}
+		return;
+	}
 	for(std::vector<civilization*>::iterator it = civs.begin();
-	    it != civs.end();
-	    ++it) {
-		(*it)->refill_moves(uconfmap);
+			it != civs.end();
+			++it) {
+		(*it)->defer_map_changes();
+	}
+	round_pool->parallel_for(civs.size(), [&](unsigned int i) {
+		func(civs[i]);
+	});
+	for(std::vector<civilization*>::iterator it = civs.begin();
+			it != civs.end();
+			++it) {
+		(*it)->apply_map_changes();
+	}
+}
+
+rng& pompelmous::get_random(unsigned int civ_id, random_stream s)
+{
+	unsigned int i = civ_id * num_random_streams + s;
+	while(random_streams.size() <= i) {
+		unsigned int k = random_streams.size();
+		random_streams.push_back(random_root.split(k / num_random_streams).split(k % num_random_streams));
 	}
+	return random_streams[i];
+}
+
+void pompelmous::refill_moves()
+{
+	for_each_civ([&](civilization* civ) {
+		civ->refill_moves(uconfmap);
+	});
 }
 
 void pompelmous::increment_resources()
 {
-	for(std::vector<civilization*>::iterator it = civs.begin();
-	    it != civs.end();
-	    ++it) {
-		(*it)->increment_resources(uconfmap, amap,
+	for_each_civ([&](civilization* civ) {
+		civ->increment_resources(uconfmap, amap,
 				road_moves, food_eaten_per_citizen);
-	}
+	});
 }
 
 int pompelmous::get_winning_civ() const
@@ -233,21 +293,10 @@ void pompelmous::check_for_victory_conditions()
 
 	// win by domination
 	int controlled_area[civs.size()];
-	for(unsigned int i = 0; i < civs.size(); i++) {
-		controlled_area[i] = 0;
-	}
 	int total_controlled_area = 0;
-	for(int i = 0; i < m->size_x(); i++) {
-		for(int j = 0; j < m->size_y(); j++) {
-			int val = m->get_data(i, j);
-			if(!m->resconf.is_water_tile(val)) {
-				int lo = m->get_land_owner(i, j);
-				if(lo >= 0 && lo < (int)civs.size()) {
-					total_controlled_area++;
-					controlled_area[lo]++;
-				}
-			}
-		}
+	for(unsigned int i = 0; i < civs.size(); i++) {
+		controlled_area[i] = m->get_owned_land(i);
+		total_controlled_area += controlled_area[i];
 	}
 	for(unsigned int i = 0; i < civs.size(); i++) {
 		float area = controlled_area[i] / (float)total_controlled_area;
@@ -292,18 +341,16 @@ bool pompelmous::next_civ()
 
 void pompelmous::update_civ_points()
 {
-	for(std::vector<civilization*>::iterator it = civs.begin();
-	    it != civs.end();
-	    ++it) {
+	for_each_civ([](civilization* civ) {
 		unsigned int added = 0;
-		for(std::map<unsigned int, city*>::iterator cit = (*it)->cities.begin();
-				cit != (*it)->cities.end();
+		for(slot_map<city*>::iterator cit = civ->cities.begin();
+				cit != civ->cities.end();
 				++cit) {
 			added += cit->second->get_city_size();
 			added += cit->second->culture_level;
 		}
-		(*it)->add_points(added);
-	}
+		civ->add_points(added);
+	});
 }
 
 int pompelmous::needed_food_for_growth(int city_size) const
@@ -322,13 +369,13 @@ void pompelmous::check_for_city_updates()
 	for(std::vector<civilization*>::iterator it = civs.begin();
 	    it != civs.end();
 	    ++it) {
-		for(std::map<unsigned int, city*>::iterator cit = (*it)->cities.begin();
+		for(slot_map<city*>::iterator cit = (*it)->cities.begin();
 				cit != (*it)->cities.end();
 				++cit) {
 			city* c = cit->second;
 			if(c->stored_food < 0) {
 				if(c->get_city_size() <= 1) {
-					std::map<unsigned int, city*>::iterator cit2(cit);
+					slot_map<city*>::iterator cit2(cit);
 					cit2--;
 					(*it)->remove_city(c, true);
 					update_land = true;
@@ -343,7 +390,7 @@ void pompelmous::check_for_city_updates()
 				c->increment_city_size();
 				coord rescoord = civs[c->civ_id]->next_good_resource_spot(c);
 				c->add_resource_worker(rescoord);
-				if(c->has_granary(cimap)) {
+				if(c->has_granary(*rules)) {
 					c->stored_food = needed_food_for_growth(c->get_city_size()) / 2;
 				}
 				else {
@@ -363,10 +410,7 @@ void pompelmous::check_for_city_updates()
 
 const unit_configuration* pompelmous::get_unit_configuration(int uid) const
 {
-	unit_configuration_map::const_iterator it = uconfmap.find(uid);
-	if(it == uconfmap.end())
-		return NULL;
-	return &it->second;
+	return rules->get_unit_configuration(uid);
 }
 
 void pompelmous::broadcast_action(const visible_move_action& a) const
@@ -407,14 +451,9 @@ bool pompelmous::perform_action(int civid, const action& a)
 							city* c = (*current_civ)->add_city(a.data.unit_data.u->xpos,
 									a.data.unit_data.u->ypos);
 							if((*current_civ)->cities.size() == 1) {
-								for(city_improv_map::const_iterator pit = cimap.begin();
-										pit != cimap.end();
-										++pit) {
-									if(pit->second.palace) {
-										c->built_improvements.insert(pit->first);
-										break;
-									}
-								}
+								const id_set& palaces = rules->get_palaces();
+								if(!palaces.empty())
+									c->built_improvements.insert(*palaces.begin());
 							}
 							set_default_city_production(c, uconfmap);
 							(*current_civ)->remove_unit(a.data.unit_data.u);
@@ -501,11 +540,11 @@ void pompelmous::check_city_conquer(int tgtxpos, int tgtypos, int conquering_civ
 
 void pompelmous::destroy_improvements(city* c)
 {
-	for(std::set<unsigned int>::iterator it = c->built_improvements.begin();
+	for(id_set::iterator it = c->built_improvements.begin();
 			it != c->built_improvements.end();) {
-		city_improv_map::const_iterator ciit = cimap.find(*it);
-		if(ciit != cimap.end() && (ciit->second.palace || ((rand() % 3) == 0))) {
-			c->built_improvements.erase(it++);
+		const city_improvement* ci = rules->get_city_improvement(*it);
+		if(ci && (ci->palace || get_random(c->civ_id, random_improvements)(3) == 0)) {
+			c->built_improvements.erase(*it++);
 		}
 		else {
 			it++;
@@ -515,19 +554,7 @@ void pompelmous::destroy_improvements(city* c)
 
 void pompelmous::update_land_owners()
 {
-	for(int i = 0; i < m->size_x(); i++)
-		for(int j = 0; j < m->size_y(); j++)
-			m->set_land_owner(-1, i, j);
-
-	for(std::vector<civilization*>::iterator it = civs.begin();
-	    it != civs.end();
-	    ++it) {
-		for(std::map<unsigned int, city*>::iterator cit = (*it)->cities.begin();
-				cit != (*it)->cities.end();
-				++cit) {
-			m->grab_land(cit->second);
-		}
-	}
+	land.update(m, civs);
 }
 
 void pompelmous::check_civ_elimination(int civ_id)
@@ -535,7 +562,7 @@ void pompelmous::check_civ_elimination(int civ_id)
 	civilization* civ = civs[civ_id];
 	if(civ->cities.size() == 0) {
 		bool no_settlers = true;
-		for(std::map<unsigned int, unit*>::const_iterator uit = civ->units.begin();
+		for(slot_map<unit*>::const_iterator uit = civ->units.begin();
 				uit != civ->units.end();
 				++uit) {
 			if(uit->second->is_settler()) {
@@ -560,13 +587,13 @@ int pompelmous::get_defense_bonus(const unit* def, const unit* off) const
 	int city_bonus = 0;
 	city* c = m->city_on_spot(def->xpos, def->ypos);
 	if(c) {
-		for(std::set<unsigned int>::const_iterator cit = c->built_improvements.begin();
+		for(id_set::const_iterator cit = c->built_improvements.begin();
 				cit != c->built_improvements.end();
 				++cit) {
-			city_improv_map::const_iterator ciit = cimap.find(*cit);
-			if(ciit != cimap.end()) {
-				if(ciit->second.defense_bonus > city_bonus) {
-					city_bonus = ciit->second.defense_bonus;
+			const city_improvement* ci = rules->get_city_improvement(*cit);
+			if(ci) {
+				if(ci->defense_bonus > city_bonus) {
+					city_bonus = ci->defense_bonus;
 				}
 			}
 		}
@@ -611,7 +638,7 @@ bool pompelmous::try_move_unit(unit* u, int chx, int chy)
 	int def_id = m->get_spot_resident(tgtxpos, tgtypos);
 	if(def_id >= 0 && def_id != u->civ_id) {
 		if(!u->carried() && in_war(u->civ_id, def_id)) {
-			const std::list<unit*>& units = m->units_on_spot(tgtxpos, tgtypos);
+			unit_stack units = m->units_on_spot(tgtxpos, tgtypos);
 			if(units.size() != 0) {
 				unit* defender = units.front();
 				if(!can_attack(m, *u, *defender)) {
@@ -689,11 +716,11 @@ bool pompelmous::try_move_unit(unit* u, int chx, int chy)
 					break;
 
 				case village_type::some_gold:
-					add_gold(rand() % 25 + 5);
+					add_gold(get_random(u->civ_id, random_villages)(25) + 5);
 					break;
 
 				case village_type::lots_gold:
-					add_gold(rand() % 70 + 30);
+					add_gold(get_random(u->civ_id, random_villages)(70) + 30);
 					break;
 
 				case village_type::friendly_mercenaries:
@@ -760,8 +787,8 @@ bool pompelmous::can_load_unit(unit* u, int x, int y) const
 		return false;
 	if(u->carried())
 		return false;
-	const std::list<unit*>& units = m->units_on_spot(x, y);
-	for(std::list<unit*>::const_iterator it = units.begin();
+	unit_stack units = m->units_on_spot(x, y);
+	for(unit_stack::const_iterator it = units.begin();
 			it != units.end();
 			++it) {
 		if((*it)->civ_id != u->civ_id)
@@ -775,8 +802,8 @@ bool pompelmous::can_load_unit(unit* u, int x, int y) const
 
 void pompelmous::load_unit(unit* u, int x, int y)
 {
-	const std::list<unit*>& units = m->units_on_spot(x, y);
-	for(std::list<unit*>::const_iterator it = units.begin();
+	unit_stack units = m->units_on_spot(x, y);
+	for(unit_stack::const_iterator it = units.begin();
 			it != units.end();
 			++it) {
 		if((*it)->civ_id != u->civ_id)
@@ -859,17 +886,17 @@ unsigned int pompelmous::get_city_production_turns(const city* c,
 {
 	if(cp.current_production_id >= 0) {
 		if(cp.producing_unit) {
-			unit_configuration_map::const_iterator it = 
-				uconfmap.find(cp.current_production_id);
-			if(it != uconfmap.end()) {
-				return get_city_production_turns(c, it->second);
+			const unit_configuration* uc =
+				rules->get_unit_configuration(cp.current_production_id);
+			if(uc) {
+				return get_city_production_turns(c, *uc);
 			}
 		}
 		else {
-			city_improv_map::const_iterator it = 
-				cimap.find(cp.current_production_id);
-			if(it != cimap.end()) {
-				return get_city_production_turns(c, it->second);
+			const city_improvement* ci =
+				rules->get_city_improvement(cp.current_production_id);
+			if(ci) {
+				return get_city_production_turns(c, *ci);
 			}
 		}
 	}
@@ -916,7 +943,7 @@ void pompelmous::combat(unit* u1, unit* u2)
 		u2->strength = 0;
 		return;
 	}
-	unsigned int val = rand() % (u1chance + u2chance);
+	unsigned int val = get_random(u1->civ_id, random_combat)(u1chance + u2chance);
 	printf("Combat on (%d, %d) - chances: (%d vs %d - %3.2f) - ",
 			u2->xpos, u2->ypos, u1chance, u2chance,
 			u1chance / ((float)u1chance + u2chance));
@@ -944,35 +971,17 @@ bool pompelmous::combat_chances(const unit* u1, const unit* u2,
 		return false;
 	unsigned int s1 = u1->strength;
 	unsigned int s2 = u2->uconf->max_strength ? u2->strength : 0;
+	const float* group1 = rules->get_group_bonuses(u1->uconf_id, u2->uconf_id);
+	const float* group2 = rules->get_group_bonuses(u2->uconf_id, u1->uconf_id);
+	const float* city1 = rules->get_city_bonuses(u1->uconf_id);
+	bool in_city = m->city_on_spot(u2->xpos, u2->ypos) != NULL;
 	for(unsigned int i = 0; i < max_num_unit_bonuses; i++) {
-		switch(u1->uconf->unit_bonuses[i].type) {
-			case unit_bonus_group:
-				if(u1->uconf->unit_bonuses[i].bonus_data.group_mask & u2->uconf->unit_group_mask) {
-					s1 *= (100 + u1->uconf->unit_bonuses[i].bonus_amount) / 100.0f;
-				}
-				break;
-			case unit_bonus_city:
-				if(m->city_on_spot(u2->xpos, u2->ypos) != NULL) {
-					s1 *= (100 + u1->uconf->unit_bonuses[i].bonus_amount) / 100.0f;
-				}
-				break;
-			case unit_bonus_none:
-			default:
-				break;
-		}
+		s1 *= group1[i];
+		if(in_city)
+			s1 *= city1[i];
 	}
 	for(unsigned int i = 0; i < max_num_unit_bonuses; i++) {
-		switch(u2->uconf->unit_bonuses[i].type) {
-			case unit_bonus_group:
-				if(u2->uconf->unit_bonuses[i].bonus_data.group_mask & u1->uconf->unit_group_mask) {
-					s2 *= (100 + u2->uconf->unit_bonuses[i].bonus_amount) / 100.0f;
-				}
-				break;
-			case unit_bonus_city:
-			case unit_bonus_none:
-			default:
-				break;
-		}
+		s2 *= group2[i];
 	}
 	if(u1->veteran)
 		s1 *= 1.5f;
@@ -999,9 +1008,9 @@ void pompelmous::start_revolution(civilization* civ)
 
 void pompelmous::set_government(civilization* civ, int gov_id)
 {
-	government_map::const_iterator git = govmap.find(gov_id);
-	if(git != govmap.end()) {
-		civ->set_government(&git->second);
+	const government* g = rules->get_government(gov_id);
+	if(g) {
+		civ->set_government(g);
 	}
 }
 
@@ -1029,9 +1038,10 @@ void pompelmous::try_add_random_barbarians(const coord& c, int num)
 	if(civ_id == -1)
 		return;
 
+	rng& rnd = get_random((*current_civ)->civ_id, random_barbarians);
 	for(int n = 0; n < num; n++) {
-		int xv = rand() % 3 - 1;
-		int yv = rand() % 3 - 1;
+		int xv = (int)rnd(3) - 1;
+		int yv = (int)rnd(3) - 1;
 		if(xv || yv) {
 			int nx = c.x + xv;
 			int ny = c.y + yv;
@@ -1040,7 +1050,7 @@ void pompelmous::try_add_random_barbarians(const coord& c, int num)
 			// (not water, not already a city, etc.)
 			if(units.size() == 0 && m->can_found_city_on(nx, ny)) {
 				civs[civ_id]->add_unit(WARRIOR_UNIT_CONFIGURATION_ID,
-						nx, ny, (*(uconfmap.find(WARRIOR_UNIT_CONFIGURATION_ID))).second,
+						nx, ny, *rules->get_unit_configuration(WARRIOR_UNIT_CONFIGURATION_ID),
 						road_moves);
 			}
 		}
@@ -1055,7 +1065,7 @@ void pompelmous::add_gold(int i)
 void pompelmous::add_unit(const coord& c, int uconf_id)
 {
 	(*current_civ)->add_unit(uconf_id,
-			c.x, c.y, (*(uconfmap.find(uconf_id))).second,
+			c.x, c.y, *rules->get_unit_configuration(uconf_id),
 			road_moves);
 }
 
@@ -12,6 +12,10 @@
 #include "city_improvement.h"
 #include "civ.h"
 #include "map.h"
+#include "ruleset.h"
+#include "territory.h"
+#include "thread-pool.h"
+#include "rng.h"
 #include "diplomat.h"
 
 #define SETTLER_UNIT_CONFIGURATION_ID	0
@@ -119,6 +123,17 @@ enum victory_type {
 	victory_domination
 };
 
+// Each civ draws from a stream of random numbers of its own for each of
+// these, so that what one civ or one part of the game draws doesn't
+// change what the others get.
+enum random_stream {
+	random_combat,
+	random_villages,
+	random_barbarians,
+	random_improvements,
+	num_random_streams // must be last
+};
+
 class pompelmous
 {
 	public:
@@ -130,7 +145,8 @@ class pompelmous
 				unsigned int road_moves_,
 				unsigned int food_eaten_per_citizen_,
 				unsigned int anarchy_period_turns_,
-				int num_turns_);
+				int num_turns_,
+				unsigned int seed);
 		pompelmous(); // for serialization
 		void add_civilization(civilization* civ);
 		void add_village(const coord& c);
@@ -145,6 +161,7 @@ class pompelmous
 		const advance_map amap;
 		const city_improv_map cimap;
 		const government_map govmap;
+		const ruleset& get_ruleset() const;
 		bool in_war(unsigned int civ1, unsigned int civ2) const;
 		int get_round_number() const;
 		unsigned int get_num_road_moves() const;
@@ -174,6 +191,10 @@ class pompelmous
 		void start_revolution(civilization* civ);
 		void set_government(civilization* civ, int gov_id);
 		bool suggest_peace(int civ_id1, int civ_id2);
+		// Processes the civs at the end of a round on num threads
+		// (0 = one per core) instead of one after another. The result
+		// is the same.
+		void set_round_threads(unsigned int num);
 
 	private:
 		void broadcast_action(const visible_move_action& a) const;
@@ -199,6 +220,9 @@ class pompelmous
 		void add_unit(const coord& c, int uconf_id);
 		void add_friendly_mercenary(const coord& c);
 		void add_settler(const coord& c);
+		void compile_ruleset();
+		void for_each_civ(const std::function<void(civilization*)>& func);
+		rng& get_random(unsigned int civ_id, random_stream s);
 
 		std::vector<civilization*>::iterator current_civ;
 		map* m;
@@ -211,6 +235,14 @@ class pompelmous
 		int winning_civ;
 		victory_type victory;
 		std::map<int, diplomat*> diplomat_handlers;
+		std::shared_ptr<const ruleset> rules; // not serialized
+		territory land; // not serialized, built on demand
+		std::shared_ptr<thread_pool> round_pool; // not serialized
+		// only split, never drawn from, so that the streams don't
+		// depend on when they are split off
+		rng random_root;
+		// by civ and stream, split off the root as needed
+		std::vector<rng> random_streams;
 
 		friend class boost::serialization::access;
 
@@ -238,6 +270,10 @@ class pompelmous
 			// remember to modify run_game() in main to not
 			// readd the diplomat handlers.
 			// ar & diplomat_handlers;
+			if(version > 0) {
+				ar & random_root;
+				ar & random_streams;
+			}
 		}
 		template<class Archive>
 		void save(Archive& ar, const unsigned int version) const
@@ -254,6 +290,7 @@ class pompelmous
 		void load(Archive& ar, const unsigned int version)
 		{
 			archive_helper(ar, version);
+			compile_ruleset();
 			int curr_civ;
 			ar & curr_civ;
 			current_civ = civs.end();
@@ -269,5 +306,7 @@ class pompelmous
 		BOOST_SERIALIZATION_SPLIT_MEMBER();
 };
 
+BOOST_CLASS_VERSION(pompelmous, 1)
+
 #endif
 
@@ -0,0 +1,48 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// A SplitMix64 random number generator. Unlike with rand(), each generator
+// has its own state, and the streams split off one another are independent
+// of each other, so that work divided into chunks, each with a stream of
+// its own, gives the same results however the chunks are scheduled. A
+// split-off stream depends on the state of its parent, i.e. on how many
+// numbers were drawn from it before, so a parent that streams are split
+// off on demand must not be drawn from. The state is saved with the games.
+class rng {
+	public:
+		explicit rng(uint64_t seed) : state(seed) { }
+		rng() : state(0) { } // for serialization
+		rng split(uint64_t id) const
+		{
+			return rng(mix(state ^ mix(id + golden)));
+		}
+		uint32_t next()
+		{
+			state += golden;
+			return mix(state) >> 32;
+		}
+		// between 0 and n - 1, as rand() % n
+		unsigned int operator()(unsigned int n)
+		{
+			return next() % n;
+		}
+		template<class Archive>
+		void serialize(Archive& ar, const unsigned int version)
+		{
+			ar & state;
+		}
+	private:
+		static const uint64_t golden = 0x9e3779b97f4a7c15ULL;
+		static uint64_t mix(uint64_t z)
+		{
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			return z ^ (z >> 31);
+		}
+		uint64_t state;
+};
+
+#endif
+
@@ -0,0 +1,197 @@
+#include "road-network.h"
+#include "civ.h"
+
+road_network::road_network()
+	: built(false),
+	m(NULL),
+	sx(0),
+	sy(0),
+	tile_changes_pos(0),
+	newly_known_pos(0)
+{
+}
+
+void road_network::invalidate_all()
+{
+	built = false;
+}
+
+bool road_network::has_access(const civilization& civ, const city& c,
+		unsigned int res_id)
+{
+	update(civ);
+	// the city itself is where the search along the roads starts
+	if(owned_resource(civ, c.xpos, c.ypos) == res_id)
+		return true;
+	for(int i = -1; i <= 1; i++) {
+		for(int j = -1; j <= 1; j++) {
+			int ni;
+			if((i || j) && neighbour(c.xpos, c.ypos, i, j, &ni) &&
+					parent[ni] != -1) {
+				std::map<int, std::map<unsigned int, int> >::const_iterator it =
+					resources.find(find(ni));
+				if(it != resources.end() &&
+						it->second.find(res_id) != it->second.end())
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+void road_network::update(const civilization& civ)
+{
+	if(!built || m != civ.m || sx != civ.m->size_x() || sy != civ.m->size_y()) {
+		build(civ);
+		return;
+	}
+	changes.clear();
+	if(!civ.m->get_tile_changes(tile_changes_pos, changes) ||
+			!civ.get_fog().get_newly_known(newly_known_pos, changes)) {
+		build(civ);
+		return;
+	}
+	for(std::vector<coord>::const_iterator it = changes.begin();
+			it != changes.end();
+			++it) {
+		if(!update_tile(civ, *it)) {
+			build(civ);
+			return;
+		}
+	}
+}
+
+void road_network::build(const civilization& civ)
+{
+	m = civ.m;
+	sx = m->size_x();
+	sy = m->size_y();
+	changes.clear();
+	m->get_tile_changes(tile_changes_pos, changes);
+	civ.get_fog().get_newly_known(newly_known_pos, changes);
+	parent.assign(sx * sy, -1);
+	size.assign(sx * sy, 1);
+	counted.assign(sx * sy, 0);
+	resources.clear();
+	for(int y = 0; y < sy; y++) {
+		for(int x = 0; x < sx; x++) {
+			if(on_network(civ, x, y))
+				add_tile(civ, x, y);
+		}
+	}
+	built = true;
+}
+
+// Tiles may only be added to a union-find, so returns false if the tile
+// was removed from the network.
+bool road_network::update_tile(const civilization& civ, const coord& co)
+{
+	int i = co.y * sx + co.x;
+	bool was_on = parent[i] != -1;
+	bool is_on = on_network(civ, co.x, co.y);
+	if(was_on && !is_on)
+		return false;
+	if(!was_on && is_on) {
+		add_tile(civ, co.x, co.y);
+	}
+	else if(was_on) {
+		unsigned int res = owned_resource(civ, co.x, co.y);
+		if(res != counted[i]) {
+			int root = find(i);
+			if(counted[i])
+				count_resource(root, counted[i], -1);
+			counted[i] = res;
+			if(res)
+				count_resource(root, res, 1);
+		}
+	}
+	return true;
+}
+
+void road_network::add_tile(const civilization& civ, int x, int y)
+{
+	int i = y * sx + x;
+	parent[i] = i;
+	size[i] = 1;
+	counted[i] = owned_resource(civ, x, y);
+	if(counted[i])
+		count_resource(i, counted[i], 1);
+	for(int k = -1; k <= 1; k++) {
+		for(int l = -1; l <= 1; l++) {
+			int ni;
+			if((k || l) && neighbour(x, y, k, l, &ni) && parent[ni] != -1)
+				join(i, ni);
+		}
+	}
+}
+
+bool road_network::on_network(const civilization& civ, int x, int y) const
+{
+	if(!(m->get_improvements_on(x, y) & improv_road))
+		return false;
+	if(civ.fog_at(x, y) == 0)
+		return false;
+	int civid = m->get_land_owner(x, y);
+	return civid == -1 || civid == (int)civ.civ_id ||
+		civ.get_relationship_to_civ(civid) != relationship_war;
+}
+
+unsigned int road_network::owned_resource(const civilization& civ, int x, int y) const
+{
+	if(civ.m->get_land_owner(x, y) != (int)civ.civ_id)
+		return 0;
+	return civ.m->get_resource(x, y);
+}
+
+bool road_network::neighbour(int x, int y, int i, int j, int* ni) const
+{
+	int nx = m->wrap_x(x + i);
+	int ny = m->wrap_y(y + j);
+	if(nx < 0 || ny < 0 || nx >= sx || ny >= sy)
+		return false;
+	*ni = ny * sx + nx;
+	return true;
+}
+
+int road_network::find(int i)
+{
+	while(parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+void road_network::join(int a, int b)
+{
+	a = find(a);
+	b = find(b);
+	if(a == b)
+		return;
+	if(size[a] < size[b])
+		std::swap(a, b);
+	parent[b] = a;
+	size[a] += size[b];
+	std::map<int, std::map<unsigned int, int> >::iterator it = resources.find(b);
+	if(it != resources.end()) {
+		std::map<unsigned int, int>& to = resources[a];
+		for(std::map<unsigned int, int>::const_iterator rit = it->second.begin();
+				rit != it->second.end();
+				++rit) {
+			to[rit->first] += rit->second;
+		}
+		resources.erase(it);
+	}
+}
+
+void road_network::count_resource(int root, unsigned int res, int num)
+{
+	std::map<unsigned int, int>& r = resources[root];
+	r[res] += num;
+	if(r[res] == 0) {
+		r.erase(res);
+		if(r.empty())
+			resources.erase(root);
+	}
+}
+
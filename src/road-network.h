@@ -0,0 +1,53 @@
+#ifndef ROAD_NETWORK_H
+#define ROAD_NETWORK_H
+
+#include <vector>
+#include <map>
+
+#include "coord.h"
+
+class map;
+class city;
+class civilization;
+
+// The roads of a civ as map_along_roads() with no_enemy_territory and
+// known_territory sees them: known road tiles outside the land of the
+// civs at war with it, joined into connected components with a
+// union-find. Each component counts the resources on the civ's own land
+// in it. Built lazily; the roads, land owners and tiles revealed since
+// are added as needed, and the whole network is rebuilt when a tile is
+// cut off, e.g. by a declaration of war.
+class road_network {
+	public:
+		road_network();
+		void invalidate_all();
+		// whether a road leads from the city to the resource on the
+		// civ's own land
+		bool has_access(const civilization& civ, const city& c,
+				unsigned int res_id);
+	private:
+		void update(const civilization& civ);
+		void build(const civilization& civ);
+		bool update_tile(const civilization& civ, const coord& co);
+		void add_tile(const civilization& civ, int x, int y);
+		bool on_network(const civilization& civ, int x, int y) const;
+		unsigned int owned_resource(const civilization& civ, int x, int y) const;
+		bool neighbour(int x, int y, int i, int j, int* ni) const;
+		int find(int i);
+		void join(int a, int b);
+		void count_resource(int root, unsigned int res, int num);
+		bool built;
+		const map* m;
+		int sx;
+		int sy;
+		unsigned int tile_changes_pos;
+		unsigned int newly_known_pos;
+		std::vector<int> parent; // -1 if not on the network
+		std::vector<int> size;
+		std::vector<unsigned int> counted; // resource counted for the tile
+		std::map<int, std::map<unsigned int, int> > resources; // per root
+		std::vector<coord> changes;
+};
+
+#endif
+
@@ -0,0 +1,120 @@
+#include "ruleset.h"
+
+const float ruleset::no_bonuses[max_num_unit_bonuses] = { 1.0f, 1.0f, 1.0f, 1.0f };
+const id_set ruleset::no_advances;
+const std::vector<std::pair<int, unsigned int> > ruleset::no_resources;
+
+ruleset::ruleset(const resource_configuration& resconf,
+		const resource_map& rmap)
+{
+	compile_terrain(resconf, rmap);
+}
+
+ruleset::ruleset(const resource_configuration& resconf,
+		const resource_map& rmap,
+		const unit_configuration_map& uconfmap,
+		const advance_map& amap,
+		const city_improv_map& cimap,
+		const government_map& govmap)
+{
+	compile_terrain(resconf, rmap);
+	compile_table(uconfmap, uconfs);
+	compile_table(amap, advances);
+	compile_table(cimap, improvements);
+	compile_table(govmap, governments);
+
+	unsigned int n = uconfs.size();
+	group_bonuses.assign(n * n * max_num_unit_bonuses, 1.0f);
+	city_bonuses.assign(n * max_num_unit_bonuses, 1.0f);
+	for(unsigned int i = 0; i < n; i++) {
+		if(!uconfs[i])
+			continue;
+		for(unsigned int k = 0; k < max_num_unit_bonuses; k++) {
+			const unit_bonus& b = uconfs[i]->unit_bonuses[k];
+			float mult = (100 + b.bonus_amount) / 100.0f;
+			if(b.type == unit_bonus_city) {
+				city_bonuses[i * max_num_unit_bonuses + k] = mult;
+			}
+			else if(b.type == unit_bonus_group) {
+				for(unsigned int j = 0; j < n; j++) {
+					if(uconfs[j] && (b.bonus_data.group_mask & uconfs[j]->unit_group_mask))
+						group_bonuses[(i * n + j) * max_num_unit_bonuses + k] = mult;
+				}
+			}
+		}
+	}
+
+	needed_advances.resize(advances.size());
+	for(unsigned int i = 0; i < advances.size(); i++) {
+		if(!advances[i])
+			continue;
+		for(int k = 0; k < max_num_needed_advances; k++) {
+			if(advances[i]->needed_advances[k])
+				needed_advances[i].insert(advances[i]->needed_advances[k]);
+		}
+	}
+
+	for(unsigned int i = 0; i < improvements.size(); i++) {
+		if(!improvements[i])
+			continue;
+		if(improvements[i]->barracks)
+			barracks.insert(i);
+		if(improvements[i]->granary)
+			granaries.insert(i);
+		if(improvements[i]->palace)
+			palaces.insert(i);
+	}
+}
+
+void ruleset::compile_terrain(const resource_configuration& resconf,
+		const resource_map& rmap)
+{
+	compile_table(rmap, resources);
+	for(int i = 0; i < num_terrain_types; i++) {
+		for(int c = 0; c < 2; c++) {
+			terrain_yields[i][c][0] = resconf.terrain_food_values[i] + (c ? resconf.city_food_bonus : 0);
+			terrain_yields[i][c][1] = resconf.terrain_prod_values[i] + (c ? resconf.city_prod_bonus : 0);
+			terrain_yields[i][c][2] = resconf.terrain_comm_values[i] + (c ? resconf.city_comm_bonus : 0);
+		}
+	}
+	for(resource_map::const_iterator it = rmap.begin();
+			it != rmap.end();
+			++it) {
+		for(unsigned int k = 0; k < max_num_resource_terrains; k++) {
+			unsigned int t = it->second.terrain[k];
+			if(t && t <= (unsigned int)num_terrain_types &&
+					it->second.terrain_abundance[k]) {
+				terrain_resources[t - 1].push_back(std::make_pair(it->first,
+							it->second.terrain_abundance[k]));
+			}
+		}
+	}
+}
+
+const id_set& ruleset::get_needed_advances(unsigned int id) const
+{
+	return id < needed_advances.size() ? needed_advances[id] : no_advances;
+}
+
+const id_set& ruleset::get_barracks() const
+{
+	return barracks;
+}
+
+const id_set& ruleset::get_granaries() const
+{
+	return granaries;
+}
+
+const id_set& ruleset::get_palaces() const
+{
+	return palaces;
+}
+
+const std::vector<std::pair<int, unsigned int> >& ruleset::get_terrain_resources(int terr) const
+{
+	if(terr < 0 || terr >= num_terrain_types)
+		return no_resources;
+	return terrain_resources[terr];
+}
+
@@ -0,0 +1,146 @@
+#ifndef RULESET_H
+#define RULESET_H
+
+#include <vector>
+#include <utility>
+
+#include "unit_configuration.h"
+#include "advance.h"
+#include "city_improvement.h"
+#include "government.h"
+#include "resource.h"
+#include "resource_configuration.h"
+#include "id-set.h"
+
+// The rules of a game compiled into tables by the ids of the rules, with
+// the data derived from them that is needed every turn. The tables point
+// to the rules they were compiled from, so those must outlive the
+// ruleset. A ruleset is not changed after it's made, and it's shared by
+// the game, the map and the civs.
+class ruleset {
+	public:
+		// only the terrain and the resources, for a map without a game
+		ruleset(const resource_configuration& resconf,
+				const resource_map& rmap);
+		ruleset(const resource_configuration& resconf,
+				const resource_map& rmap,
+				const unit_configuration_map& uconfmap,
+				const advance_map& amap,
+				const city_improv_map& cimap,
+				const government_map& govmap);
+		// NULL for the ids with no rule
+		const unit_configuration* get_unit_configuration(int id) const;
+		const advance* get_advance(unsigned int id) const;
+		const city_improvement* get_city_improvement(unsigned int id) const;
+		const government* get_government(unsigned int id) const;
+		const resource* get_resource(int id) const;
+		// the strength multipliers of the bonuses of the unit
+		// configuration off, in the order of the bonuses, 1 where the
+		// bonus does not apply
+		const float* get_group_bonuses(int off_id, int def_id) const;
+		const float* get_city_bonuses(int off_id) const;
+		void get_terrain_yields(int terr, bool city,
+				int* food, int* prod, int* comm) const;
+		// the advances needed for researching the advance
+		const id_set& get_needed_advances(unsigned int id) const;
+		// the improvements with the flags
+		const id_set& get_barracks() const;
+		const id_set& get_granaries() const;
+		const id_set& get_palaces() const;
+		// the resources that can be placed on the terrain and their
+		// abundance on it, in the order of the resource ids
+		const std::vector<std::pair<int, unsigned int> >& get_terrain_resources(int terr) const;
+	private:
+		void compile_terrain(const resource_configuration& resconf,
+				const resource_map& rmap);
+		template<typename K, typename T>
+		static void compile_table(const std::map<K, T>& m,
+				std::vector<const T*>& table);
+		std::vector<const unit_configuration*> uconfs;
+		std::vector<const advance*> advances;
+		std::vector<const city_improvement*> improvements;
+		std::vector<const government*> governments;
+		std::vector<const resource*> resources;
+		// by offense and defense unit configuration
+		std::vector<float> group_bonuses;
+		std::vector<float> city_bonuses;
+		int terrain_yields[num_terrain_types][2][3];
+		std::vector<id_set> needed_advances;
+		id_set barracks;
+		id_set granaries;
+		id_set palaces;
+		std::vector<std::pair<int, unsigned int> > terrain_resources[num_terrain_types];
+		static const float no_bonuses[max_num_unit_bonuses];
+		static const id_set no_advances;
+		static const std::vector<std::pair<int, unsigned int> > no_resources;
+};
+
+template<typename K, typename T>
+void ruleset::compile_table(const std::map<K, T>& m,
+		std::vector<const T*>& table)
+{
+	if(m.empty() || m.begin()->first < 0)
+		return;
+	table.resize(m.rbegin()->first + 1, NULL);
+	for(typename std::map<K, T>::const_iterator it = m.begin();
+			it != m.end();
+			++it) {
+		table[it->first] = &it->second;
+	}
+}
+
+inline const unit_configuration* ruleset::get_unit_configuration(int id) const
+{
+	return id >= 0 && id < (int)uconfs.size() ? uconfs[id] : NULL;
+}
+
+inline const advance* ruleset::get_advance(unsigned int id) const
+{
+	return id < advances.size() ? advances[id] : NULL;
+}
+
+inline const city_improvement* ruleset::get_city_improvement(unsigned int id) const
+{
+	return id < improvements.size() ? improvements[id] : NULL;
+}
+
+inline const government* ruleset::get_government(unsigned int id) const
+{
+	return id < governments.size() ? governments[id] : NULL;
+}
+
+inline const resource* ruleset::get_resource(int id) const
+{
+	return id >= 0 && id < (int)resources.size() ? resources[id] : NULL;
+}
+
+inline const float* ruleset::get_group_bonuses(int off_id, int def_id) const
+{
+	int n = uconfs.size();
+	if(off_id < 0 || off_id >= n || def_id < 0 || def_id >= n)
+		return no_bonuses;
+	return &group_bonuses[(off_id * n + def_id) * max_num_unit_bonuses];
+}
+
+inline const float* ruleset::get_city_bonuses(int off_id) const
+{
+	if(off_id < 0 || off_id >= (int)uconfs.size())
+		return no_bonuses;
+	return &city_bonuses[off_id * max_num_unit_bonuses];
+}
+
+inline void ruleset::get_terrain_yields(int terr, bool city,
+		int* food, int* prod, int* comm) const
+{
+	if(terr < 0 || terr >= num_terrain_types) {
+		*food = *prod = *comm = 0;
+		return;
+	}
+	const int* y = terrain_yields[terr][city ? 1 : 0];
+	*food = y[0];
+	*prod = y[1];
+	*comm = y[2];
+}
+
+#endif
+
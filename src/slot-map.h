@@ -0,0 +1,280 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+#include <assert.h>
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/split_member.hpp>
+
+// Values by the keys the map hands out. A key is the index of a slot and
+// the generation of the slot, which is bumped when the value is erased,
+// so that the key of an erased value finds nothing even when the slot
+// has been reused. Slot 0 is never used, so no key is 0. The values are
+// iterated over in the order of their slots, and an iterator stays valid
+// whatever is inserted or erased, save for its own value.
+// There are at most index_mask slots. The generation has 11 bits and
+// wraps after 2048 reuses of a slot, after which a key kept from the
+// first use finds the value again.
+template<typename T>
+class slot_map {
+	public:
+		typedef unsigned int key_type;
+		typedef std::pair<key_type, T> value_type;
+		class const_iterator {
+			public:
+				typedef std::bidirectional_iterator_tag iterator_category;
+				typedef typename slot_map::value_type value_type;
+				typedef std::ptrdiff_t difference_type;
+				typedef const value_type* pointer;
+				typedef const value_type& reference;
+				const_iterator() : sm(NULL), i(npos) { }
+				reference operator*() const { return sm->slots[i].entry; }
+				pointer operator->() const { return &sm->slots[i].entry; }
+				const_iterator& operator++();
+				const_iterator operator++(int);
+				const_iterator& operator--();
+				const_iterator operator--(int);
+				bool operator==(const const_iterator& oth) const { return i == oth.i; }
+				bool operator!=(const const_iterator& oth) const { return i != oth.i; }
+			private:
+				const_iterator(const slot_map* sm_, unsigned int i_) : sm(sm_), i(i_) { }
+				const slot_map* sm;
+				unsigned int i;
+				friend class slot_map;
+		};
+		typedef const_iterator iterator;
+		slot_map();
+		// the key the next value inserted will get
+		key_type next_key() const;
+		key_type insert(const T& val);
+		// for the values of the old saves, kept by keys of their own;
+		// returns false if the key doesn't fit in a slot index
+		bool insert_at(key_type k, const T& val);
+		const_iterator find(key_type k) const;
+		unsigned int count(key_type k) const;
+		void erase(const_iterator it);
+		const_iterator begin() const;
+		const_iterator end() const;
+		unsigned int size() const;
+		bool empty() const;
+		// the index of the slot of the key; the values are iterated
+		// over in the order of the indices
+		static unsigned int index_of(key_type k);
+	private:
+		static const unsigned int npos = (unsigned int)-1;
+		static const unsigned int index_bits = 20;
+		static const key_type index_mask = (1 << index_bits) - 1;
+		static const key_type generation_mask = (1 << 11) - 1;
+		// saved with the key
+		static const key_type used_bit = 1u << 31;
+		struct slot {
+			slot() : entry(0, T()), used(false) { }
+			value_type entry; // the key for the next value if unused
+			bool used;
+		};
+		void add_free_slot();
+		std::vector<slot> slots;
+		std::vector<unsigned int> free_slots; // the last is used first
+		unsigned int num_used;
+
+		friend class boost::serialization::access;
+		template<class Archive>
+		void save(Archive& ar, const unsigned int version) const
+		{
+			unsigned int n = slots.size();
+			ar << n;
+			for(unsigned int i = 1; i < n; i++) {
+				key_type k = slots[i].entry.first;
+				if(slots[i].used)
+					k |= used_bit;
+				ar << k;
+				if(slots[i].used)
+					ar << slots[i].entry.second;
+			}
+			ar << free_slots;
+		}
+		template<class Archive>
+		void load(Archive& ar, const unsigned int version)
+		{
+			unsigned int n;
+			ar >> n;
+			slots.assign(n > 0 ? n : 1, slot());
+			num_used = 0;
+			for(unsigned int i = 1; i < n; i++) {
+				key_type k;
+				ar >> k;
+				slots[i].entry.first = k & ~used_bit;
+				slots[i].used = (k & used_bit) != 0;
+				if(slots[i].used) {
+					ar >> slots[i].entry.second;
+					num_used++;
+				}
+			}
+			ar >> free_slots;
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER();
+};
+
+template<typename T>
+slot_map<T>::slot_map()
+	: slots(1),
+	num_used(0)
+{
+}
+
+template<typename T>
+typename slot_map<T>::key_type slot_map<T>::next_key() const
+{
+	if(free_slots.empty())
+		return slots.size();
+	return slots[free_slots.back()].entry.first;
+}
+
+template<typename T>
+typename slot_map<T>::key_type slot_map<T>::insert(const T& val)
+{
+	if(free_slots.empty())
+		add_free_slot();
+	slot& s = slots[free_slots.back()];
+	free_slots.pop_back();
+	s.entry.second = val;
+	s.used = true;
+	num_used++;
+	return s.entry.first;
+}
+
+template<typename T>
+void slot_map<T>::add_free_slot()
+{
+	assert(slots.size() <= index_mask);
+	slot s;
+	s.entry.first = slots.size();
+	free_slots.push_back(slots.size());
+	slots.push_back(s);
+}
+
+template<typename T>
+bool slot_map<T>::insert_at(key_type k, const T& val)
+{
+	if(k == 0 || k > index_mask)
+		return false;
+	unsigned int i = k;
+	while(slots.size() <= i)
+		add_free_slot();
+	for(std::vector<unsigned int>::iterator it = free_slots.begin();
+			it != free_slots.end();
+			++it) {
+		if(*it == i) {
+			free_slots.erase(it);
+			slots[i].entry = value_type(k, val);
+			slots[i].used = true;
+			num_used++;
+			return true;
+		}
+	}
+	return false;
+}
+
+template<typename T>
+typename slot_map<T>::const_iterator slot_map<T>::find(key_type k) const
+{
+	unsigned int i = k & index_mask;
+	if(i < slots.size() && slots[i].used && slots[i].entry.first == k)
+		return const_iterator(this, i);
+	return end();
+}
+
+template<typename T>
+unsigned int slot_map<T>::count(key_type k) const
+{
+	return find(k) != end() ? 1 : 0;
+}
+
+template<typename T>
+void slot_map<T>::erase(const_iterator it)
+{
+	slot& s = slots[it.i];
+	key_type gen = ((s.entry.first >> index_bits) + 1) & generation_mask;
+	s.entry = value_type((gen << index_bits) | it.i, T());
+	s.used = false;
+	free_slots.push_back(it.i);
+	num_used--;
+}
+
+template<typename T>
+typename slot_map<T>::const_iterator slot_map<T>::begin() const
+{
+	const_iterator it(this, 0);
+	return ++it;
+}
+
+template<typename T>
+typename slot_map<T>::const_iterator slot_map<T>::end() const
+{
+	return const_iterator(this, npos);
+}
+
+template<typename T>
+unsigned int slot_map<T>::size() const
+{
+	return num_used;
+}
+
+template<typename T>
+bool slot_map<T>::empty() const
+{
+	return num_used == 0;
+}
+
+template<typename T>
+unsigned int slot_map<T>::index_of(key_type k)
+{
+	return k & index_mask;
+}
+
+template<typename T>
+typename slot_map<T>::const_iterator& slot_map<T>::const_iterator::operator++()
+{
+	do {
+		i++;
+	} while(i < sm->slots.size() && !sm->slots[i].used);
+	if(i >= sm->slots.size())
+		i = npos;
+	return *this;
+}
+
+template<typename T>
+typename slot_map<T>::const_iterator slot_map<T>::const_iterator::operator++(int)
+{
+	const_iterator old(*this);
+	++(*this);
+	return old;
+}
+
+template<typename T>
+typename slot_map<T>::const_iterator& slot_map<T>::const_iterator::operator--()
+{
+	if(i == npos)
+		i = sm->slots.size();
+	do {
+		i--;
+	} while(i > 0 && !sm->slots[i].used);
+	return *this;
+}
+
+template<typename T>
+typename slot_map<T>::const_iterator slot_map<T>::const_iterator::operator--(int)
+{
+	const_iterator old(*this);
+	--(*this);
+	return old;
+}
+
+#endif
+
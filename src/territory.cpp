@@ -0,0 +1,237 @@
+#include <math.h>
+#include <algorithm>
+
+#include "territory.h"
+#include "civ.h"
+
+bool territory::claim::operator==(const claim& oth) const
+{
+	return city_id == oth.city_id && civ_id == oth.civ_id &&
+		x == oth.x && y == oth.y && land_radius == oth.land_radius &&
+		order == oth.order;
+}
+
+territory::territory()
+	: built(false),
+	m(NULL),
+	sx(0),
+	sy(0),
+	bx(0),
+	tile_changes_pos(0),
+	stamp(0)
+{
+}
+
+void territory::invalidate_all()
+{
+	built = false;
+}
+
+void territory::update(map* m_, const std::vector<civilization*>& civs)
+{
+	if(!built || m != m_ || sx != m_->size_x() || sy != m_->size_y()) {
+		m = m_;
+		build(civs);
+		return;
+	}
+	changes.clear();
+	if(!m->get_tile_changes(tile_changes_pos, changes)) {
+		build(civs);
+		return;
+	}
+	dirty.clear();
+	for(std::vector<coord>::const_iterator it = changes.begin();
+			it != changes.end();
+			++it) {
+		add_tile(it->x, it->y);
+	}
+	update_claims(civs, true);
+	for(std::vector<coord>::const_iterator it = dirty.begin();
+			it != dirty.end();
+			++it) {
+		is_dirty[it->y * sx + it->x] = false;
+		m->set_land_owner(owner_of(it->x, it->y), it->x, it->y);
+	}
+	// skip the changes made here
+	changes.clear();
+	m->get_tile_changes(tile_changes_pos, changes);
+}
+
+void territory::build(const std::vector<civilization*>& civs)
+{
+	sx = m->size_x();
+	sy = m->size_y();
+	for(int i = 0; i < sx; i++)
+		for(int j = 0; j < sy; j++)
+			m->set_land_owner(-1, i, j);
+
+	for(std::vector<civilization*>::const_iterator it = civs.begin();
+	    it != civs.end();
+	    ++it) {
+		for(slot_map<city*>::iterator cit = (*it)->cities.begin();
+				cit != (*it)->cities.end();
+				++cit) {
+			m->grab_land(cit->second);
+		}
+	}
+	claims.clear();
+	bx = (sx + (1 << block_shift) - 1) >> block_shift;
+	int by = (sy + (1 << block_shift) - 1) >> block_shift;
+	blocks.clear();
+	blocks.resize(bx * by);
+	update_claims(civs, false);
+	is_dirty.assign(sx * sy, false);
+	changes.clear();
+	m->get_tile_changes(tile_changes_pos, changes);
+	built = true;
+}
+
+void territory::update_claims(const std::vector<civilization*>& civs, bool mark)
+{
+	stamp++;
+	uint64_t civ_order = 0;
+	for(std::vector<civilization*>::const_iterator it = civs.begin();
+	    it != civs.end();
+	    ++it, ++civ_order) {
+		for(slot_map<city*>::iterator cit = (*it)->cities.begin();
+				cit != (*it)->cities.end();
+				++cit) {
+			const city* c = cit->second;
+			claim cl;
+			cl.city_id = c->city_id;
+			cl.civ_id = c->civ_id;
+			cl.x = c->xpos;
+			cl.y = c->ypos;
+			// as in map::grab_land()
+			cl.land_radius = c->culture_level + 0.5f;
+			cl.radius = cl.land_radius;
+			cl.order = (civ_order << 32) | slot_map<city*>::index_of(cit->first);
+			cl.seen = stamp;
+			std::map<const city*, claim>::iterator clit = claims.find(c);
+			if(clit == claims.end()) {
+				clit = claims.insert(std::make_pair(c, cl)).first;
+				add_to_blocks(&clit->second);
+			}
+			else if(!(clit->second == cl)) {
+				if(mark)
+					add_claim_tiles(clit->second);
+				remove_from_blocks(&clit->second);
+				clit->second = cl;
+				add_to_blocks(&clit->second);
+			}
+			else {
+				clit->second.seen = stamp;
+				continue;
+			}
+			if(mark)
+				add_claim_tiles(cl);
+		}
+	}
+	for(std::map<const city*, claim>::iterator it = claims.begin();
+			it != claims.end();) {
+		if(it->second.seen != stamp) {
+			if(mark)
+				add_claim_tiles(it->second);
+			remove_from_blocks(&it->second);
+			claims.erase(it++);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void territory::add_claim_tiles(const claim& cl)
+{
+	for(int i = cl.x - cl.radius; i <= cl.x + cl.radius; i++) {
+		for(int j = cl.y - cl.radius; j <= cl.y + cl.radius; j++) {
+			int x = m->wrap_x(i);
+			int y = m->wrap_y(j);
+			if(x >= 0 && x < sx && y >= 0 && y < sy)
+				add_tile(x, y);
+		}
+	}
+}
+
+void territory::add_to_blocks(const claim* cl)
+{
+	for(int i = cl->x - cl->radius; i <= cl->x + cl->radius; i++) {
+		for(int j = cl->y - cl->radius; j <= cl->y + cl->radius; j++) {
+			std::vector<const claim*>* b = block_of(m->wrap_x(i), m->wrap_y(j));
+			if(!b || std::find(b->begin(), b->end(), cl) != b->end())
+				continue;
+			std::vector<const claim*>::iterator it = b->begin();
+			while(it != b->end() && (*it)->order < cl->order)
+				++it;
+			b->insert(it, cl);
+		}
+	}
+}
+
+void territory::remove_from_blocks(const claim* cl)
+{
+	for(int i = cl->x - cl->radius; i <= cl->x + cl->radius; i++) {
+		for(int j = cl->y - cl->radius; j <= cl->y + cl->radius; j++) {
+			std::vector<const claim*>* b = block_of(m->wrap_x(i), m->wrap_y(j));
+			if(!b)
+				continue;
+			std::vector<const claim*>::iterator it = std::find(b->begin(), b->end(), cl);
+			if(it != b->end())
+				b->erase(it);
+		}
+	}
+}
+
+std::vector<const territory::claim*>* territory::block_of(int x, int y)
+{
+	if(x < 0 || x >= sx || y < 0 || y >= sy)
+		return NULL;
+	return &blocks[(y >> block_shift) * bx + (x >> block_shift)];
+}
+
+void territory::add_tile(int x, int y)
+{
+	int i = y * sx + x;
+	if(!is_dirty[i]) {
+		is_dirty[i] = true;
+		dirty.push_back(coord(x, y));
+	}
+}
+
+// As the land_grabber of map::grab_land() does.
+bool territory::reaches(const claim& cl, int x, int y) const
+{
+	for(int yd = -cl.radius; yd <= cl.radius; yd++) {
+		if(m->wrap_y(cl.y + yd) != y)
+			continue;
+		for(int xd = -cl.radius; xd <= cl.radius; xd++) {
+			if(m->wrap_x(cl.x + xd) != x)
+				continue;
+			if(!xd && !yd)
+				return true;
+			float dist = sqrt(xd * xd + yd * yd);
+			if(dist <= cl.land_radius)
+				return true;
+		}
+	}
+	return false;
+}
+
+int territory::owner_of(int x, int y)
+{
+	const city* c = m->city_on_spot(x, y);
+	if(c) {
+		std::map<const city*, claim>::const_iterator it = claims.find(c);
+		if(it != claims.end())
+			return it->second.civ_id;
+	}
+	const std::vector<const claim*>* b = block_of(x, y);
+	for(std::vector<const claim*>::const_iterator it = b->begin();
+			it != b->end();
+			++it) {
+		if(reaches(**it, x, y))
+			return (*it)->civ_id;
+	}
+	return -1;
+}
+
@@ -0,0 +1,66 @@
+#ifndef TERRITORY_H
+#define TERRITORY_H
+
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "coord.h"
+
+class map;
+class city;
+class civilization;
+
+// The land owners as clearing the map and letting each city grab the
+// land within its culture radius, in the order of the civs and their
+// cities, sets them: a city owns its own tile, and any other tile goes
+// to the first city to reach it. The claims of the cities are kept, and
+// the owners are set anew only on the tiles reached by the claims that
+// changed and on the tiles whose owners were changed otherwise, e.g. by
+// a new city grabbing land. Built on the first update.
+class territory {
+	public:
+		territory();
+		void invalidate_all();
+		void update(map* m_, const std::vector<civilization*>& civs);
+	private:
+		struct claim {
+			unsigned int city_id;
+			int civ_id;
+			int x;
+			int y;
+			float land_radius;
+			int radius;
+			uint64_t order; // by civ and by city in the civ
+			unsigned int seen;
+			bool operator==(const claim& oth) const;
+		};
+		void build(const std::vector<civilization*>& civs);
+		// the tiles of the claims that changed are marked dirty if
+		// mark is set
+		void update_claims(const std::vector<civilization*>& civs, bool mark);
+		void add_claim_tiles(const claim& cl);
+		void add_to_blocks(const claim* cl);
+		void remove_from_blocks(const claim* cl);
+		std::vector<const claim*>* block_of(int x, int y);
+		void add_tile(int x, int y);
+		bool reaches(const claim& cl, int x, int y) const;
+		int owner_of(int x, int y);
+		static const int block_shift = 3;
+		bool built;
+		map* m;
+		int sx;
+		int sy;
+		int bx;
+		unsigned int tile_changes_pos;
+		unsigned int stamp;
+		std::map<const city*, claim> claims;
+		// the claims that may reach each block of tiles, in order
+		std::vector<std::vector<const claim*> > blocks;
+		std::vector<coord> changes;
+		std::vector<coord> dirty;
+		std::vector<bool> is_dirty;
+};
+
+#endif
+
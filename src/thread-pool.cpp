@@ -0,0 +1,75 @@
+#include "thread-pool.h"
+
+thread_pool::thread_pool(unsigned int num_threads)
+	: job(NULL),
+	job_size(0),
+	next(0),
+	generation(0),
+	running(0),
+	quit(false)
+{
+	if(num_threads == 0)
+		num_threads = std::thread::hardware_concurrency();
+	for(unsigned int i = 1; i < num_threads; i++)
+		threads.push_back(std::thread(&thread_pool::work, this));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	start_cond.notify_all();
+	for(unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+unsigned int thread_pool::get_num_threads() const
+{
+	return threads.size() + 1;
+}
+
+void thread_pool::parallel_for(unsigned int num,
+		const std::function<void(unsigned int)>& func)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &func;
+		job_size = num;
+		next = 0;
+		generation++;
+		running = threads.size();
+	}
+	start_cond.notify_all();
+	run_job();
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cond.wait(lock, [this] { return running == 0; });
+	job = NULL;
+}
+
+void thread_pool::work()
+{
+	unsigned int seen = 0;
+	while(1) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_cond.wait(lock, [&] { return quit || generation != seen; });
+			if(quit)
+				return;
+			seen = generation;
+		}
+		run_job();
+		std::lock_guard<std::mutex> lock(mutex);
+		if(--running == 0)
+			done_cond.notify_one();
+	}
+}
+
+void thread_pool::run_job()
+{
+	unsigned int i;
+	while((i = next++) < job_size)
+		(*job)(i);
+}
+
@@ -0,0 +1,42 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Worker threads for running the iterations of a loop in parallel. The
+// iterations are handed out in no particular order, so they may not
+// depend on each other. The calling thread works on them as well.
+class thread_pool {
+	public:
+		// 0 threads = one per core
+		thread_pool(unsigned int num_threads);
+		~thread_pool();
+		unsigned int get_num_threads() const;
+		// calls func(i) for each i from 0 to num - 1 and returns once all
+		// the calls are done
+		void parallel_for(unsigned int num,
+				const std::function<void(unsigned int)>& func);
+	private:
+		thread_pool(const thread_pool&);
+		thread_pool& operator=(const thread_pool&);
+		void work();
+		void run_job();
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable start_cond;
+		std::condition_variable done_cond;
+		const std::function<void(unsigned int)>* job;
+		unsigned int job_size;
+		std::atomic<unsigned int> next;
+		unsigned int generation; // of the job
+		unsigned int running; // workers still on the job
+		bool quit;
+};
+
+#endif
+
@@ -0,0 +1,74 @@
+#include "tile-store.h"
+
+tile_store::tile_store(int x, int y, int terr)
+	: sx(x),
+	sy(y),
+	terrain(x * y, terr),
+	resources(x * y, 0),
+	owners(x * y, -1),
+	flags(x * y, 0)
+{
+}
+
+tile_store::tile_store()
+	: sx(0),
+	sy(0)
+{
+}
+
+void tile_store::enable_yield_tiles()
+{
+	yield_tiles.resize(sx * sy);
+	for(int i = 0; i < sx * sy; i++) {
+		yield_tiles[i].terrain = terrain[i];
+		yield_tiles[i].resource = resources[i];
+		yield_tiles[i].flags = flags[i];
+		yield_tiles[i].unused = 0;
+	}
+}
+
+void tile_store::to_buffers(buf2d<int>& terr, buf2d<int>& owner,
+		buf2d<int>& improvements, buf2d<int>& res,
+		buf2d<bool>& rivers, buf2d<int>& villages) const
+{
+	terr = buf2d<int>(sx, sy, 0);
+	owner = buf2d<int>(sx, sy, -1);
+	improvements = buf2d<int>(sx, sy, 0);
+	res = buf2d<int>(sx, sy, 0);
+	rivers = buf2d<bool>(sx, sy, false);
+	villages = buf2d<int>(sx, sy, 0);
+	for(int y = 0; y < sy; y++) {
+		for(int x = 0; x < sx; x++) {
+			int i = index(x, y);
+			terr.set(x, y, get_terrain(i));
+			owner.set(x, y, get_owner(i));
+			improvements.set(x, y, get_improvements(i));
+			res.set(x, y, get_resource(i));
+			rivers.set(x, y, has_river(i));
+			villages.set(x, y, get_village(i));
+		}
+	}
+}
+
+// The cities aren't in the buffers, so they're set by the map afterwards.
+void tile_store::from_buffers(const buf2d<int>& terr, const buf2d<int>& owner,
+		const buf2d<int>& improvements, const buf2d<int>& res,
+		const buf2d<bool>& rivers, const buf2d<int>& villages)
+{
+	bool yields = !yield_tiles.empty();
+	*this = tile_store(terr.size_x, terr.size_y, 0);
+	for(int y = 0; y < sy; y++) {
+		for(int x = 0; x < sx; x++) {
+			int i = index(x, y);
+			set_terrain(i, *terr.get(x, y));
+			set_owner(i, *owner.get(x, y));
+			set_improvements(i, *improvements.get(x, y));
+			set_resource(i, *res.get(x, y));
+			set_river(i, *rivers.get(x, y));
+			set_village(i, *villages.get(x, y));
+		}
+	}
+	if(yields)
+		enable_yield_tiles();
+}
+
@@ -0,0 +1,189 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "buf2d.h"
+
+// The data of a tile that the yields of the tile depend on, packed
+// together for looking at many tiles at once.
+struct yield_tile {
+	uint8_t terrain;
+	uint8_t resource;
+	uint8_t flags; // as in tile_store
+	uint8_t unused;
+};
+
+// The plain data of the map tiles in compact layers: the terrain, the
+// resource (ids up to 255) and the land owner each in a layer of their
+// own, and the improvements, river, village and whether there's a city
+// on the tile together in a byte of flags. The tiles are addressed by
+// index, so the callers wrap and check the coordinates only once. The
+// layers the yields depend on can also be kept packed in yield_tiles.
+class tile_store {
+	public:
+		tile_store(int x, int y, int terrain);
+		tile_store(); // for serialization
+		int size_x() const;
+		int size_y() const;
+		bool in_bounds(int x, int y) const;
+		int index(int x, int y) const;
+		int get_terrain(int i) const;
+		void set_terrain(int i, int terr);
+		unsigned int get_resource(int i) const;
+		void set_resource(int i, unsigned int res);
+		int get_owner(int i) const;
+		void set_owner(int i, int civ_id);
+		int get_improvements(int i) const;
+		void set_improvements(int i, int imps);
+		bool has_river(int i) const;
+		void set_river(int i, bool riv);
+		int get_village(int i) const;
+		void set_village(int i, int vill);
+		bool has_city(int i) const;
+		void set_city(int i, bool c);
+		// from the yield tiles if they're enabled
+		yield_tile get_yield_tile(int i) const;
+		// NULL unless enabled
+		const yield_tile* get_yield_tiles() const;
+		void enable_yield_tiles();
+		// the layers as they are saved
+		void to_buffers(buf2d<int>& terrain, buf2d<int>& owner,
+				buf2d<int>& improvements, buf2d<int>& resources,
+				buf2d<bool>& rivers, buf2d<int>& villages) const;
+		void from_buffers(const buf2d<int>& terrain, const buf2d<int>& owner,
+				const buf2d<int>& improvements, const buf2d<int>& resources,
+				const buf2d<bool>& rivers, const buf2d<int>& villages);
+		static const int improvement_mask = 0x07;
+		static const int river_flag = 0x08;
+		static const int village_shift = 4;
+		static const int village_mask = 0x70;
+		static const int city_flag = 0x80;
+	private:
+		void set_flags(int i, int mask, int val);
+		int sx;
+		int sy;
+		std::vector<uint8_t> terrain;
+		std::vector<uint8_t> resources;
+		std::vector<int16_t> owners;
+		std::vector<uint8_t> flags;
+		std::vector<yield_tile> yield_tiles; // empty unless enabled
+};
+
+inline int tile_store::size_x() const
+{
+	return sx;
+}
+
+inline int tile_store::size_y() const
+{
+	return sy;
+}
+
+inline bool tile_store::in_bounds(int x, int y) const
+{
+	return x >= 0 && x < sx && y >= 0 && y < sy;
+}
+
+inline int tile_store::index(int x, int y) const
+{
+	return y * sx + x;
+}
+
+inline int tile_store::get_terrain(int i) const
+{
+	return terrain[i];
+}
+
+inline void tile_store::set_terrain(int i, int terr)
+{
+	terrain[i] = terr;
+	if(!yield_tiles.empty())
+		yield_tiles[i].terrain = terr;
+}
+
+inline unsigned int tile_store::get_resource(int i) const
+{
+	return resources[i];
+}
+
+inline void tile_store::set_resource(int i, unsigned int res)
+{
+	resources[i] = res;
+	if(!yield_tiles.empty())
+		yield_tiles[i].resource = res;
+}
+
+inline int tile_store::get_owner(int i) const
+{
+	return owners[i];
+}
+
+inline void tile_store::set_owner(int i, int civ_id)
+{
+	owners[i] = civ_id;
+}
+
+inline int tile_store::get_improvements(int i) const
+{
+	return flags[i] & improvement_mask;
+}
+
+inline void tile_store::set_improvements(int i, int imps)
+{
+	set_flags(i, improvement_mask, imps);
+}
+
+inline bool tile_store::has_river(int i) const
+{
+	return flags[i] & river_flag;
+}
+
+inline void tile_store::set_river(int i, bool riv)
+{
+	set_flags(i, river_flag, riv ? river_flag : 0);
+}
+
+inline int tile_store::get_village(int i) const
+{
+	return (flags[i] & village_mask) >> village_shift;
+}
+
+inline void tile_store::set_village(int i, int vill)
+{
+	set_flags(i, village_mask, vill << village_shift);
+}
+
+inline bool tile_store::has_city(int i) const
+{
+	return flags[i] & city_flag;
+}
+
+inline void tile_store::set_city(int i, bool c)
+{
+	set_flags(i, city_flag, c ? city_flag : 0);
+}
+
+inline yield_tile tile_store::get_yield_tile(int i) const
+{
+	if(!yield_tiles.empty())
+		return yield_tiles[i];
+	yield_tile t = { terrain[i], resources[i], flags[i], 0 };
+	return t;
+}
+
+inline const yield_tile* tile_store::get_yield_tiles() const
+{
+	return yield_tiles.empty() ? NULL : &yield_tiles[0];
+}
+
+inline void tile_store::set_flags(int i, int mask, int val)
+{
+	flags[i] = (flags[i] & ~mask) | (val & mask);
+	if(!yield_tiles.empty())
+		yield_tiles[i].flags = flags[i];
+}
+
+#endif
+
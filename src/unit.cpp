@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "unit.h"
+#include "object-pool.h"
 
 unit::unit(int uid, int uconfid, int x, int y, int civid, 
 		const unit_configuration& uconf_,
@@ -23,7 +24,9 @@ unit::unit(int uid, int uconfid, int x, int y, int civid,
 	improving(improv_none),
 	moves(0),
 	road_moves(0),
-	def_road_moves(def_road_moves_)
+	def_road_moves(def_road_moves_),
+	next_on_spot(NULL),
+	prev_on_spot(NULL)
 {
 }
 
@@ -33,7 +36,9 @@ unit::unit()
 	civ_id(-1337),
 	uconf(NULL),
 	carrying_unit(NULL),
-	def_road_moves(-1337)
+	def_road_moves(-1337),
+	next_on_spot(NULL),
+	prev_on_spot(NULL)
 {
 }
 
@@ -41,6 +46,16 @@ unit::~unit()
 {
 }
 
+void* unit::operator new(size_t sz)
+{
+	return object_pool<unit>::allocate(sz);
+}
+
+void unit::operator delete(void* p, size_t sz)
+{
+	object_pool<unit>::deallocate(p, sz);
+}
+
 void unit::new_round(improvement_type& i)
 {
 	i = improv_none;
@@ -2,6 +2,8 @@
 #define UNIT_H
 
 #include <list>
+#include <iterator>
+#include <cstddef>
 
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
@@ -18,6 +20,9 @@ class unit
 				unsigned int def_road_moves_);
 		unit(); // for serialization
 		~unit();
+		// from a pool of units
+		static void* operator new(size_t sz);
+		static void operator delete(void* p, size_t sz);
 		void new_round(improvement_type& i);
 		bool is_settler() const;
 		void fortify();
@@ -61,6 +66,12 @@ class unit
 		unsigned int moves;
 		unsigned int road_moves;
 		const unsigned int def_road_moves;
+		// the units on the same tile in a ring, kept by the map; not
+		// serialized
+		unit* next_on_spot;
+		unit* prev_on_spot;
+		friend class map;
+		friend class unit_stack;
 
 		friend class boost::serialization::access;
 		template<class Archive>
@@ -88,4 +99,57 @@ class unit
 		}
 };
 
+// The units on a tile, in the order they entered it.
+class unit_stack {
+	public:
+		class const_iterator {
+			public:
+				typedef std::forward_iterator_tag iterator_category;
+				typedef unit* value_type;
+				typedef std::ptrdiff_t difference_type;
+				typedef unit* const* pointer;
+				typedef unit* const& reference;
+				const_iterator(unit* u, unit* first_) : cur(u), first(first_) { }
+				reference operator*() const { return cur; }
+				const_iterator& operator++();
+				const_iterator operator++(int);
+				bool operator==(const const_iterator& oth) const { return cur == oth.cur; }
+				bool operator!=(const const_iterator& oth) const { return cur != oth.cur; }
+			private:
+				unit* cur;
+				unit* first;
+		};
+		explicit unit_stack(unit* first_) : first(first_) { }
+		const_iterator begin() const { return const_iterator(first, first); }
+		const_iterator end() const { return const_iterator(NULL, first); }
+		bool empty() const { return first == NULL; }
+		unsigned int size() const;
+		unit* front() const { return first; }
+	private:
+		unit* first;
+};
+
+inline unit_stack::const_iterator& unit_stack::const_iterator::operator++()
+{
+	cur = cur->next_on_spot;
+	if(cur == first)
+		cur = NULL;
+	return *this;
+}
+
+inline unit_stack::const_iterator unit_stack::const_iterator::operator++(int)
+{
+	const_iterator old(*this);
+	++(*this);
+	return old;
+}
+
+inline unsigned int unit_stack::size() const
+{
+	unsigned int n = 0;
+	for(const_iterator it = begin(); it != end(); ++it)
+		n++;
+	return n;
+}
+
 #endif
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include "worker-grid.h"
+#include "civ.h"
+
+worker_grid::worker_grid()
+	: m(NULL),
+	sx(0),
+	sy(0),
+	stamp(0)
+{
+}
+
+bool worker_grid::is_built() const
+{
+	return m != NULL;
+}
+
+bool worker_grid::is_free(int x, int y) const
+{
+	if(!m)
+		return true;
+	x = m->wrap_x(x);
+	y = m->wrap_y(y);
+	if(x < 0 || x >= sx || y < 0 || y >= sy)
+		return true;
+	return grid[y * sx + x] == 0;
+}
+
+void worker_grid::reset(const civilization& civ)
+{
+	m = civ.m;
+	sx = m->size_x();
+	sy = m->size_y();
+	grid.assign(sx * sy, 0);
+	entries.clear();
+}
+
+void worker_grid::update(const civilization& civ, std::vector<city*>& conflicts)
+{
+	if(m != civ.m || sx != civ.m->size_x() || sy != civ.m->size_y())
+		reset(civ);
+	stamp++;
+	std::vector<unsigned int> losers;
+	for(slot_map<city*>::const_iterator it = civ.cities.begin();
+			it != civ.cities.end();
+			++it) {
+		unsigned int index = slot_map<city*>::index_of(it->first);
+		get_tiles(*it->second, tiles);
+		if(entries.size() <= index) {
+			entry e;
+			e.key = 0;
+			e.seen = 0;
+			e.c = NULL;
+			entries.resize(index + 1, e);
+		}
+		entry& e = entries[index];
+		e.seen = stamp;
+		if(e.c == it->second && e.key == it->first && e.tiles == tiles)
+			continue;
+		release(index, false);
+		e.key = it->first;
+		e.c = it->second;
+		e.tiles = tiles;
+		for(unsigned int i = 0; i < e.tiles.size(); i++) {
+			if(!claim(e.tiles[i], index, i == 0, losers))
+				break;
+		}
+	}
+	for(unsigned int i = 0; i < entries.size(); i++) {
+		if(entries[i].c && entries[i].seen != stamp) {
+			release(i, false);
+			entries[i].c = NULL;
+		}
+	}
+
+	std::sort(losers.begin(), losers.end());
+	losers.erase(std::unique(losers.begin(), losers.end()), losers.end());
+	for(std::vector<unsigned int>::const_iterator it = losers.begin();
+			it != losers.end();
+			++it) {
+		release(*it, true);
+		entries[*it].tiles.resize(1);
+		conflicts.push_back(entries[*it].c);
+	}
+}
+
+void worker_grid::get_tiles(const city& c, std::vector<int>& tiles) const
+{
+	tiles.clear();
+	tiles.push_back(m->wrap_y(c.ypos) * sx + m->wrap_x(c.xpos));
+	const std::list<coord>& coords = c.get_resource_coords();
+	for(std::list<coord>::const_iterator it = coords.begin();
+			it != coords.end();
+			++it) {
+		int x = m->wrap_x(c.xpos + it->x);
+		int y = m->wrap_y(c.ypos + it->y);
+		if(x >= 0 && x < sx && y >= 0 && y < sy)
+			tiles.push_back(y * sx + x);
+	}
+}
+
+void worker_grid::release(unsigned int index, bool workers_only)
+{
+	entry& e = entries[index];
+	if(!e.c)
+		return;
+	for(unsigned int i = workers_only ? 1 : 0; i < e.tiles.size(); i++) {
+		unsigned int& v = grid[e.tiles[i]];
+		if((v & ~city_bit) != index + 1)
+			continue;
+		if(workers_only && (v & city_bit))
+			continue;
+		v = 0;
+	}
+}
+
+bool worker_grid::claim(int tile, unsigned int index, bool city_tile,
+		std::vector<unsigned int>& losers)
+{
+	unsigned int& v = grid[tile];
+	unsigned int mine = (index + 1) | (city_tile ? city_bit : 0);
+	if(v == 0 || (v & ~city_bit) == index + 1) {
+		v |= mine;
+		return true;
+	}
+	unsigned int other = (v & ~city_bit) - 1;
+	printf("Conflict %d <=> %d at (%d, %d)\n",
+			entries[index].key, entries[other].key,
+			tile % sx, tile / sx);
+	if(!city_tile && ((v & city_bit) || other < index)) {
+		losers.push_back(index);
+		return false;
+	}
+	losers.push_back(other);
+	v = mine;
+	return true;
+}
+
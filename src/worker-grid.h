@@ -0,0 +1,52 @@
+#ifndef WORKER_GRID_H
+#define WORKER_GRID_H
+
+#include <vector>
+
+class map;
+class city;
+class civilization;
+
+// The tiles the cities of a civ stand on and work, by tile, as of the
+// last update. An update registers again only the cities whose tiles
+// changed since. A tile goes to the city standing on it, or else to the
+// city first in the order of the cities; the cities losing a tile are
+// handed back to have their workers set anew.
+class worker_grid {
+	public:
+		worker_grid();
+		bool is_built() const;
+		// whether no city of the civ works the tile or stands on it
+		bool is_free(int x, int y) const;
+		// The cities losing a tile are added to conflicts, and their
+		// workers are dropped from the grid.
+		void update(const civilization& civ, std::vector<city*>& conflicts);
+	private:
+		struct entry {
+			unsigned int key;
+			unsigned int seen;
+			city* c;
+			// the tile of the city first
+			std::vector<int> tiles;
+		};
+		void reset(const civilization& civ);
+		void get_tiles(const city& c, std::vector<int>& tiles) const;
+		void release(unsigned int index, bool workers_only);
+		// returns false if the city loses the tile
+		bool claim(int tile, unsigned int index, bool city_tile,
+				std::vector<unsigned int>& losers);
+		// the index of the city plus one, with the bit set if the city
+		// stands on the tile
+		static const unsigned int city_bit = 1u << 31;
+		const map* m;
+		int sx;
+		int sy;
+		unsigned int stamp;
+		std::vector<unsigned int> grid;
+		// by the index of the city in the slot map
+		std::vector<entry> entries;
+		std::vector<int> tiles;
+};
+
+#endif
+
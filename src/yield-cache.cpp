@@ -0,0 +1,87 @@
+#include "yield-cache.h"
+#include "civ.h"
+
+yield_cache::yield_cache()
+	: m(NULL),
+	gov(NULL),
+	num_advances(0),
+	sx(0),
+	sy(0),
+	bx(0),
+	tile_changes_pos(0)
+{
+}
+
+void yield_cache::update(const civilization& civ)
+{
+	if(m != civ.m || sx != civ.m->size_x() || sy != civ.m->size_y() ||
+			gov != civ.gov ||
+			num_advances != civ.researched_advances.size()) {
+		reset(civ);
+		return;
+	}
+	changes.clear();
+	if(!m->get_tile_changes(tile_changes_pos, changes)) {
+		reset(civ);
+		return;
+	}
+	for(std::vector<coord>::const_iterator it = changes.begin();
+			it != changes.end();
+			++it) {
+		invalidate_tile(it->x, it->y);
+	}
+}
+
+void yield_cache::reset(const civilization& civ)
+{
+	m = civ.m;
+	gov = civ.gov;
+	num_advances = civ.researched_advances.size();
+	sx = m->size_x();
+	sy = m->size_y();
+	bx = (sx + block_mask) >> block_shift;
+	int by = (sy + block_mask) >> block_shift;
+	blocks.clear();
+	blocks.resize(bx * by);
+	changes.clear();
+	m->get_tile_changes(tile_changes_pos, changes);
+}
+
+void yield_cache::invalidate_tile(int x, int y)
+{
+	if(x < 0 || x >= sx || y < 0 || y >= sy)
+		return;
+	std::vector<uint32_t>& b = blocks[(y >> block_shift) * bx + (x >> block_shift)];
+	if(!b.empty())
+		b[((y & block_mask) << block_shift) | (x & block_mask)] = 0;
+}
+
+void yield_cache::get_yields(const civilization& civ, int x, int y,
+		int* food, int* prod, int* comm)
+{
+	x = m->wrap_x(x);
+	y = m->wrap_y(y);
+	if(x < 0 || x >= sx || y < 0 || y >= sy) {
+		*food = *prod = *comm = 0;
+		return;
+	}
+	std::vector<uint32_t>& b = blocks[(y >> block_shift) * bx + (x >> block_shift)];
+	if(b.empty())
+		b.assign(1 << (2 * block_shift), 0);
+	uint32_t& e = b[((y & block_mask) << block_shift) | (x & block_mask)];
+	if(e) {
+		*food = (int8_t)(e & 0xff);
+		*prod = (int8_t)((e >> 8) & 0xff);
+		*comm = (int8_t)((e >> 16) & 0xff);
+		return;
+	}
+	m->get_resources_on_spot(x, y, food, prod, comm,
+			&civ.researched_advances, gov->production_cap);
+	// the yields that don't fit are looked up every time
+	if(*food == (int8_t)*food && *prod == (int8_t)*prod &&
+			*comm == (int8_t)*comm) {
+		e = known_bit | (uint8_t)*food | ((uint8_t)*prod << 8) |
+			((uint32_t)(uint8_t)*comm << 16);
+	}
+}
+
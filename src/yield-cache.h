@@ -0,0 +1,45 @@
+#ifndef YIELD_CACHE_H
+#define YIELD_CACHE_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "coord.h"
+
+class map;
+class government;
+class civilization;
+
+// The food, production and commerce of the tiles as a civ gets them with
+// its advances and government, packed in a grid of blocks of tiles that
+// are allocated as the tiles are looked at. The tiles that changed on
+// the map are dropped as they're seen, and the whole grid when the civ
+// discovers an advance or changes its government.
+class yield_cache {
+	public:
+		yield_cache();
+		// brings the cache up to date with the map and the civ
+		void update(const civilization& civ);
+		// for any (x, y), after update()
+		void get_yields(const civilization& civ, int x, int y,
+				int* food, int* prod, int* comm);
+	private:
+		void reset(const civilization& civ);
+		void invalidate_tile(int x, int y);
+		static const int block_shift = 4;
+		static const int block_mask = (1 << block_shift) - 1;
+		// a packed entry with the known bit set, 0 if not known
+		static const uint32_t known_bit = 1u << 24;
+		const map* m;
+		const government* gov;
+		unsigned int num_advances;
+		int sx;
+		int sy;
+		int bx;
+		unsigned int tile_changes_pos;
+		std::vector<std::vector<uint32_t> > blocks;
+		std::vector<coord> changes;
+};
+
+#endif
+